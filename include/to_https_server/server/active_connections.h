@@ -0,0 +1,31 @@
+#ifndef TO_HTTPS_SERVER_ACTIVE_CONNECTIONS_H
+#define TO_HTTPS_SERVER_ACTIVE_CONNECTIONS_H
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_set>
+
+namespace to_https_server {
+
+// 记录正在处理的连接，平滑退出超时后可以强制断开它们
+// 处理函数要求在当前响应之后关闭连接(如过载时拒绝的请求)。httplib只在请求本身带Connection: close时
+// 才结束keep-alive，各服务器在process_request返回后取走这个标记
+void close_after_response();
+bool take_close_after_response();
+
+class active_connections {
+public:
+    void add(int sock);
+    void remove(int sock);
+    size_t size() const;
+    // 对全部连接执行shutdown，阻塞中的读写随即失败，处理线程得以结束
+    void shutdown_all();
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_set<int> sockets_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_ACTIVE_CONNECTIONS_H
@@ -0,0 +1,51 @@
+#ifndef TO_HTTPS_SERVER_ADMISSION_CONTROL_H
+#define TO_HTTPS_SERVER_ADMISSION_CONTROL_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace to_https_server {
+
+// 过载时的拒绝顺序：bulk最先，其次是其余请求，管理员请求始终放行。
+// 不再细分匿名请求：Referer、Cookie等都可以由客户端随意填写，而直接打开页面的请求反而不带Referer
+enum class request_priority { admin, interactive, bulk };
+
+struct admission_stats {
+    bool overloaded;
+    // 上一个完整间隔内排队时延的最小值
+    uint64_t min_delay_us;
+    uint64_t shed_bulk;
+    uint64_t shed_interactive;
+};
+
+// CoDel式的准入控制：不看瞬时排队时延(突发很快会消化)，而看一个间隔内的最小值。
+// 最小值仍超过target说明队列持续积压，进入过载状态，直到某个间隔的最小值回落。
+// 过载时新的bulk请求全部拒绝，其余请求排队超过target的拒绝，
+// 及早返回503，而不是让所有请求都慢到超时
+class admission_control {
+public:
+    admission_control();
+
+    // target为0时关闭
+    void configure(uint64_t target_ms, uint64_t interval_ms);
+    // sampled为false表示该请求没有经历排队(同一连接上的后续请求)，只按当前状态判断
+    bool admit(request_priority priority, std::chrono::microseconds delay, bool sampled);
+    admission_stats stats() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::chrono::microseconds target_;
+    std::chrono::microseconds interval_;
+    std::chrono::steady_clock::time_point interval_end_;
+    std::chrono::microseconds min_delay_;
+    std::chrono::microseconds last_min_delay_;
+    bool sampled_;
+    bool overloaded_;
+    uint64_t shed_bulk_;
+    uint64_t shed_interactive_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_ADMISSION_CONTROL_H
@@ -0,0 +1,110 @@
+#ifndef TO_HTTPS_SERVER_ARCHIVE_STREAM_H
+#define TO_HTTPS_SERVER_ARCHIVE_STREAM_H
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+typedef struct z_stream_s z_stream;
+
+namespace to_https_server {
+
+enum class archive_format { zip, tar };
+
+// 边读目录边生成ZIP64或TAR归档，不落临时文件，内存占用与目录大小无关(每个条目只保留元数据)。
+// TAR与全部不压缩的ZIP布局完全由文件名与大小决定，总长事先可知，可以按任意区间读取以支持断点续传；
+// 其中ZIP的CRC在顺序发送时顺带算出，区间从文件中间开始时再单独读取该文件计算。
+// ZIP中按类型需要deflate的条目压缩后大小未知，此时只能顺序生成。
+// 符号链接与特殊文件不收录，避免借链接读到www_root之外的内容。
+class archive_stream {
+public:
+    using sink = std::function<bool(const char*, size_t)>;
+
+    // root为目录的绝对路径，name为归档中的顶层目录名；compressible判断文件是否需要deflate(仅ZIP)
+    archive_stream(const std::string& root, const std::string& name, archive_format format,
+                   const std::function<bool(const std::string&)>& compressible, size_t chunk_size);
+    ~archive_stream();
+    archive_stream(const archive_stream&) = delete;
+    archive_stream& operator=(const archive_stream&) = delete;
+
+    bool sized() const { return sized_; }
+    uint64_t size() const { return size_; }
+    size_t entries() const { return entries_.size(); }
+
+    // sized()时可用：写出[offset, offset+length)中的一段，至少一个字节
+    bool read(uint64_t offset, size_t length, const sink& out);
+    // 顺序生成下一段，全部写完后done为true
+    bool next(const sink& out, bool& done);
+
+private:
+    struct entry {
+        // 归档中的路径，目录不带末尾的'/'
+        std::string name;
+        std::string path;
+        bool directory;
+        uint64_t size;
+        std::time_t mtime;
+        mode_t mode;
+        bool deflate;
+        bool zip64;
+        uint64_t offset;
+        uint64_t compressed;
+        uint32_t crc;
+        bool crc_known;
+    };
+
+    struct part {
+        enum kind_t { header, data, descriptor, central, trailer } kind;
+        size_t entry;
+        uint64_t start;
+        uint64_t length;
+    };
+
+    void scan(const std::string& path, const std::string& name);
+    void layout();
+
+    std::string tar_header(const entry& e) const;
+    std::string zip_local_header(const entry& e) const;
+    std::string zip_descriptor(const entry& e) const;
+    // 中央目录与结束记录，cd_offset为中央目录在归档中的起点
+    std::string zip_central(uint64_t cd_offset) const;
+
+    // 从文件读取，文件在扫描后变短时以零补足，保证与布局一致
+    void read_file(size_t index, uint64_t from, char* data, size_t length);
+    bool read_data(size_t index, uint64_t from, size_t length, const sink& out);
+    void compute_crc(entry& e);
+    bool deflate_step(size_t index, const sink& out, bool& finished);
+    void close_file();
+
+    archive_format format_;
+    std::function<bool(const std::string&)> compressible_;
+    std::vector<entry> entries_;
+    std::vector<part> parts_;
+    bool sized_;
+    uint64_t size_;
+    std::vector<char> buffer_;
+
+    // 按区间读取时的CRC：同一文件从头连续发送才能顺带算出
+    size_t crc_entry_;
+    uint64_t crc_position_;
+    uint32_t crc_running_;
+    std::string central_;
+
+    // 顺序生成的进度
+    size_t current_;
+    int phase_;
+    uint64_t position_;
+    int fd_;
+    size_t fd_entry_;
+    uint64_t file_position_;
+    z_stream* zs_;
+    std::vector<char> deflated_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_ARCHIVE_STREAM_H
@@ -0,0 +1,32 @@
+#ifndef TO_HTTPS_SERVER_ASYNC_FILE_IO_H
+#define TO_HTTPS_SERVER_ASYNC_FILE_IO_H
+
+#include <cstddef>
+#include <functional>
+
+namespace to_https_server {
+
+// 文件读写后端：优先使用io_uring批量提交请求（分块读使用注册缓冲区），
+// 内核不支持或被禁用时退回pread/pwrite。每个线程持有独立的ring，无需加锁。
+class async_file_io {
+public:
+    using consumer = std::function<bool(const char* data, size_t size)>;
+
+    // 读取[offset, offset + length)，按顺序分块交给on_data，on_data返回false时中止
+    static bool read(int fd, size_t offset, size_t length, const consumer& on_data);
+    // 读取[offset, offset + length)到out
+    static bool read(int fd, size_t offset, size_t length, char* out);
+    static bool write(int fd, size_t offset, const char* data, size_t length);
+
+    static bool uring_available();
+    // 强制使用pread/pwrite
+    static void disable_uring();
+
+private:
+    class ring;
+    static ring* thread_ring();
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_ASYNC_FILE_IO_H
@@ -0,0 +1,106 @@
+#ifndef TO_HTTPS_SERVER_BANDWIDTH_LIMITER_H
+#define TO_HTTPS_SERVER_BANDWIDTH_LIMITER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace to_https_server {
+
+struct bandwidth_stats {
+    size_t active_transfers;
+    size_t active_clients;
+    uint64_t bytes;
+    // 各传输因限速累计休眠的时间
+    uint64_t throttled_ms;
+};
+
+class bandwidth_limiter;
+
+// HTTP/2连接在一个线程上轮流驱动多个流，休眠会拖住同一连接上的其他响应。
+// 在其作用域内acquire不休眠：需要等待时返回0，并记下最早可以重试的时间，连接先去发送其他流
+class bandwidth_deferral {
+public:
+    bandwidth_deferral();
+    ~bandwidth_deferral();
+    bandwidth_deferral(const bandwidth_deferral&) = delete;
+    bandwidth_deferral& operator=(const bandwidth_deferral&) = delete;
+
+    bool deferred() const { return deferred_; }
+    std::chrono::steady_clock::time_point retry_at() const { return retry_at_; }
+
+private:
+    friend class bandwidth_transfer;
+
+    bandwidth_deferral* previous_;
+    bool deferred_;
+    std::chrono::steady_clock::time_point retry_at_;
+};
+
+// 一次进行中的大文件传输，析构时退出公平分配
+class bandwidth_transfer {
+public:
+    bandwidth_transfer(bandwidth_limiter& limiter, const std::string& ip);
+    ~bandwidth_transfer();
+    bandwidth_transfer(const bandwidth_transfer&) = delete;
+    bandwidth_transfer& operator=(const bandwidth_transfer&) = delete;
+
+    // 返回本次可以发送的字节数(不超过wanted)，令牌不足时先休眠到足够为止。
+    // 每次最多放行约100ms的量，调用方按返回值读取，不需要额外缓冲。
+    // 在bandwidth_deferral的作用域内不休眠，需要等待时返回0，调用方不写数据直接返回
+    size_t acquire(size_t wanted);
+    // 生成前不知道确切长度时(如deflate)：acquire放行了granted字节而实际发送sent字节，按差额补扣或退还
+    void settle(size_t granted, size_t sent);
+
+private:
+    friend class bandwidth_limiter;
+
+    bandwidth_limiter& limiter_;
+    std::string ip_;
+    double tokens_;
+    std::chrono::steady_clock::time_point refilled_;
+};
+
+// 大文件下载的带宽调度：全局与每个传输各一个令牌桶，另有按客户端IP的上限。
+// 全局带宽先在活跃的客户端IP之间平分，再在同一IP的各传输之间平分，
+// 多开连接不能多占带宽。小响应不经过这里，设置的全局上限低于出口带宽时，剩余部分始终留给页面请求
+class bandwidth_limiter {
+public:
+    bandwidth_limiter();
+
+    // 单位字节/秒，0为不限制
+    void configure(uint64_t global_rate, uint64_t per_ip_rate, uint64_t per_transfer_rate);
+    bool enabled() const;
+    // 未启用任何限制时返回nullptr
+    std::unique_ptr<bandwidth_transfer> start(const std::string& ip);
+    bandwidth_stats stats() const;
+
+private:
+    friend class bandwidth_transfer;
+
+    void join(const std::string& ip);
+    void leave(const std::string& ip);
+    // 在锁内扣除令牌，返回需要等待的时间；不能等待(can_wait为false)且需要等待时不扣除，length置0
+    std::chrono::microseconds reserve(bandwidth_transfer& transfer, size_t& length, bool can_wait);
+    void settle(bandwidth_transfer& transfer, double bytes);
+
+    mutable std::mutex mutex_;
+    uint64_t global_rate_;
+    uint64_t per_ip_rate_;
+    uint64_t per_transfer_rate_;
+    double global_tokens_;
+    std::chrono::steady_clock::time_point global_refilled_;
+    // 每个IP的活跃传输数
+    std::unordered_map<std::string, size_t> clients_;
+    size_t transfers_;
+    uint64_t bytes_;
+    uint64_t throttled_us_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_BANDWIDTH_LIMITER_H
@@ -0,0 +1,55 @@
+#ifndef TO_HTTPS_SERVER_CHECKSUM_H
+#define TO_HTTPS_SERVER_CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+namespace to_https_server {
+
+// CRC32C(Castagnoli)。x86-64上支持SSE4.2与PCLMUL时用crc32指令三路交错计算、
+// 再以无进位乘法合并，否则查表
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+std::string base64_encode(const unsigned char* data, size_t size);
+
+struct file_digests {
+    uint32_t crc32c;
+    // 小写十六进制
+    std::string sha256;
+};
+
+// 响应中Digest头的值(RFC 3230)："sha-256=<base64>,crc32c=<base64>"
+std::string digest_header_value(const file_digests& digests);
+
+// 在同一遍扫描中增量计算CRC32C、SHA-256，以及按需计算MD5(用于核对客户端的Content-MD5)。
+// SHA-256与MD5由OpenSSL计算，CPU支持SHA扩展指令时自动使用
+class checksum_stream {
+public:
+    explicit checksum_stream(bool with_md5);
+    ~checksum_stream();
+    checksum_stream(const checksum_stream&) = delete;
+    checksum_stream& operator=(const checksum_stream&) = delete;
+
+    void update(const char* data, size_t size);
+    void finish();
+
+    file_digests digests() const;
+    // 以下均为base64，与HTTP头中的写法一致
+    std::string sha256_base64() const;
+    std::string crc32c_base64() const;
+    std::string md5_base64() const;
+
+private:
+    uint32_t crc_;
+    EVP_MD_CTX* sha256_;
+    EVP_MD_CTX* md5_;
+    unsigned char sha256_digest_[32];
+    unsigned char md5_digest_[16];
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_CHECKSUM_H
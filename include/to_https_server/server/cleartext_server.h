@@ -0,0 +1,38 @@
+#ifndef TO_HTTPS_SERVER_CLEARTEXT_SERVER_H
+#define TO_HTTPS_SERVER_CLEARTEXT_SERVER_H
+
+#include <to_https_server/server/active_connections.h>
+#include <to_https_server/server/http2_session.h>
+#include <to_https_server/server/listener_handover.h>
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <to_https_server/external/httplib.h>
+
+namespace to_https_server {
+
+// 明文监听：启用HTTP/2后，以连接序言开头的连接按h2c(prior knowledge)处理，
+// 其余连接仍交给httplib按HTTP/1.1处理
+class cleartext_server : public httplib::Server, public handover_listener {
+public:
+    cleartext_server();
+
+    void enable_http2(const http2_options& options, http2_session::handler h);
+
+    void adopt_socket(int sock) override;
+    int listening_socket() const override;
+    void stop_accepting() override;
+    void close_listener() override;
+    void track_connections(active_connections* connections) override;
+
+private:
+    bool process_and_close_socket(socket_t sock) override;
+    bool peek_preface(socket_t sock);
+
+    bool http2_enabled_;
+    http2_options http2_options_;
+    http2_session::handler http2_handler_;
+    active_connections* connections_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_CLEARTEXT_SERVER_H
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <atomic>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 
 namespace to_https_server {
@@ -13,10 +15,40 @@ struct server_config {
 	// 默认全部留空，为http
     std::string ssl_cert_path = "";
     std::string ssl_key_path = "";
+    // TLS会话复用：会话缓存容量(0为关闭)、会话有效期(秒)、是否发放会话票据及票据密钥轮换周期(秒)
+    size_t tls_session_cache_size = 20480;
+    size_t tls_session_timeout = 3600;
+    bool tls_session_tickets = true;
+    size_t tls_ticket_rotate_interval = 3600;
+    // 启用内核TLS，HTTPS下载可走SSL_sendfile；内核或加密套件不支持时自动退回
+    bool ktls = false;
+    // 启用HTTP/2：HTTPS下通过ALPN协商h2，明文HTTP下支持h2c(prior knowledge，不支持Upgrade)
+    bool http2 = false;
+    size_t http2_max_concurrent_streams = 100;
     
     // 线程池配置
     size_t thread_pool_size = 8;
     size_t task_queue_size = 1000;
+    // 工作线程是否绑定CPU
+    bool thread_pool_pin_cpu = false;
+    // 大于thread_pool_size时启用自动伸缩，线程数在[thread_pool_size, thread_pool_max_size]间变化
+    size_t thread_pool_max_size = 0;
+    // 排队任务数或最长排队时间(毫秒)超过阈值时扩容
+    size_t thread_pool_grow_queue_depth = 4;
+    size_t thread_pool_grow_wait_ms = 50;
+    // 线程空闲超过该秒数后缩容
+    size_t thread_pool_idle_timeout = 60;
+
+    // I/O模型：threaded 为每个连接占用一个线程；epoll 为事件驱动，仅明文HTTP可用；
+    // reuseport 为多个SO_REUSEPORT监听套接字各自accept，每个有独立的线程池
+    std::string io_model = "threaded";
+    size_t io_threads = 2;
+    // reuseport模式下的监听数，0为CPU数
+    size_t acceptor_count = 0;
+    // 平滑升级：非空时在该路径监听Unix域套接字，新版本进程启动时从这里接管监听套接字；
+    // 交出后旧进程最多等待drain_timeout秒让已有传输完成
+    std::string upgrade_socket = "";
+    size_t drain_timeout = 300;
     
     // 攻击检测(Useless now)
     size_t max_requests_per_second = 1000;
@@ -26,11 +58,49 @@ struct server_config {
     std::string www_root = "www";
     std::string log_dir = "logs";
     std::string trash_dir = "trashfiles";
+    // 回收站保留时间(秒)与总大小上限(字节)，0为不限制；超出时从最早删除的开始清理。默认都不限制，与以前一直保留相同
+    size_t trash_max_age = 0;
+    size_t trash_max_size = 0;
+    // 按内容去重的上传存储目录，为空时关闭；应与www_root在同一文件系统，才能以reflink或硬链接放到可见路径。
+    // 小于content_store_min_size的上传照常直接写入
+    std::string content_store_dir = "";
+    size_t content_store_min_size = 64 * 1024;
     
     // 传输配置
     size_t buffer_chunk_size = 5 * 1024 * 1024; // 5MB
     size_t max_file_size = 2ULL * 1024 * 1024 * 1024; // 2GB
 	size_t cache_max_age = 14400; // 4 hours
+    // 大文件下载与目录归档的带宽上限(字节/秒)，0为不限制：全局、每个客户端IP、每个传输。
+    // 全局带宽在活跃的IP之间平分，小响应不受限制
+    size_t bandwidth_limit = 0;
+    size_t bandwidth_per_ip_limit = 0;
+    size_t bandwidth_per_transfer_limit = 0;
+    // 不小于bulk_min_size的上传下载与目录归档归为bulk请求：最多bulk_threads个同时进行，由线程池另行补足线程，
+    // 其余最多bulk_queue_size个排队(排队期间占用常规线程)，等待超过bulk_queue_timeout_ms返回503。bulk_threads为0时不区分
+    size_t bulk_min_size = 1024 * 1024;
+    size_t bulk_threads = 8;
+    size_t bulk_queue_size = 64;
+    size_t bulk_queue_timeout_ms = 30000;
+    // 准入控制：一个间隔内任务的最小排队时延超过admission_target_ms即视为过载，按优先级提前返回503，
+    // Retry-After为admission_retry_after秒。admission_target_ms为0时关闭
+    size_t admission_target_ms = 20;
+    size_t admission_interval_ms = 100;
+    size_t admission_retry_after = 1;
+    // 文件读写优先使用io_uring，内核不支持时自动退回pread/pwrite
+    bool use_io_uring = true;
+    // 缓存的目录列表数，0为关闭；ergodic每页最多返回的条目数
+    size_t listing_cache_size = 1024;
+    size_t listing_page_limit = 1000;
+    // /api/batch单次请求的操作数上限，以及并行执行的线程数(所有批量请求共用这些线程)
+    size_t batch_max_operations = 10000;
+    size_t batch_concurrency = 8;
+    // gzip压缩的线程数，0为按CPU核数；响应体不小于compress_parallel_min_size时分块并行压缩
+    size_t compress_threads = 0;
+    size_t compress_parallel_min_size = 1024 * 1024;
+    // 按CPU占用与线程池排队情况选择gzip级别，过载时不压缩；关闭时固定为zlib默认级别
+    bool gzip_adaptive = true;
+    // 文件名搜索索引，启动时在后台扫描www_root，之后通过inotify增量维护
+    bool search_index = true;
     
     // 运行时目录
     std::string runtime_dir = ".";
@@ -39,19 +109,29 @@ struct server_config {
 	std::string admin_password = "123456";
 };
 
+// 配置以不可变快照的形式发布：读取只是一次原子加载，不加锁；
+// 重新加载时解析出新快照后整体替换。get_config()返回共享指针，持有者用完后旧快照才释放。
 class config_manager {
 public:
     static config_manager& instance();
     
-    void load_config(const std::string& config_path);
-    const server_config& get_config() const;
+    // 解析失败（文件无法打开）时保留当前配置并返回false
+    bool load_config(const std::string& config_path);
+    // 按上次load_config的路径重新读取
+    bool reload();
+    std::shared_ptr<const server_config> get_config() const;
+    // 每发布一次新快照加一
+    uint64_t generation() const;
     
 private:
-    config_manager() = default;
+    config_manager();
     ~config_manager() = default;
     
-    server_config config_;
-    mutable std::mutex config_mutex_;
+    // 只通过std::atomic_load/std::atomic_store访问
+    std::shared_ptr<const server_config> current_;
+    std::atomic<uint64_t> generation_;
+    std::string config_path_;
+    std::mutex config_mutex_;
 };
 
 } // namespace to_https_server
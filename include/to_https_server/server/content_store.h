@@ -0,0 +1,86 @@
+#ifndef TO_HTTPS_SERVER_CONTENT_STORE_H
+#define TO_HTTPS_SERVER_CONTENT_STORE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+
+namespace to_https_server {
+
+struct content_store_stats {
+    size_t objects;
+    uint64_t bytes;
+    size_t references;
+    // 只凭摘要完成、未传输内容的上传数
+    uint64_t dedup_hits;
+    // 因内容已存在而未写入磁盘的字节数
+    uint64_t saved_bytes;
+    uint64_t collected_objects;
+};
+
+// 按内容寻址的去重存储：上传内容以SHA-256为名存为objects/xx/yyyy...，只存一份，
+// 再以reflink(文件系统支持时，各路径为独立inode，之后互不影响)或硬链接放到可见路径。
+// 引用以“路径+inode+mtime”记在追加日志.index中，路径被删除、移动或覆盖后inode不再匹配，
+// 引用即失效；后台线程定期核对引用，删除无人引用的对象。
+// 删除对象只会减少以后的去重机会，已链接出去的文件仍各自持有数据。
+class content_store {
+public:
+    explicit content_store(const std::string& store_dir);
+    ~content_store();
+
+    void start();
+    void stop();
+
+    // 小写十六进制的SHA-256
+    static std::string sha256_hex(const char* data, size_t size);
+    static bool valid_digest(const std::string& digest);
+
+    // 以content替换target(绝对路径)。digest为空时在此计算。
+    // 存储与target不在同一文件系统等无法链接的情况返回false，由调用方按普通文件写入
+    bool store(const std::string& target, const std::string& content, const std::string& digest);
+    // 只凭摘要把已有对象链接到target，对象不存在时返回false
+    bool link_existing(const std::string& target, const std::string& digest);
+    content_store_stats stats() const;
+
+private:
+    struct reference {
+        std::string digest;
+        ino_t ino;
+        int64_t mtime_ns;
+    };
+
+    std::string object_path(const std::string& digest) const;
+    bool link_object(const std::string& digest, const std::string& target);
+    void load_index();
+    void rewrite_index();
+    void collect();
+    void run();
+
+    std::string store_dir_;
+    std::string index_path_;
+
+    mutable std::mutex mutex_;
+    // 摘要 -> 对象大小
+    std::map<std::string, uint64_t> objects_;
+    // 可见路径 -> 引用
+    std::map<std::string, reference> references_;
+    std::ofstream journal_;
+    size_t journal_lines_;
+    uint64_t dedup_hits_;
+    uint64_t saved_bytes_;
+    uint64_t collected_objects_;
+
+    std::condition_variable wake_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_CONTENT_STORE_H
@@ -0,0 +1,88 @@
+#ifndef TO_HTTPS_SERVER_DIRECTORY_CACHE_H
+#define TO_HTTPS_SERVER_DIRECTORY_CACHE_H
+
+#include <to_https_server/server/file_manager.h>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+namespace to_https_server {
+
+enum class listing_sort { name, size, mtime };
+
+// 一次目录读取的快照，创建后不再修改，可被多个请求同时使用
+class directory_listing {
+public:
+    explicit directory_listing(std::vector<file_info> entries);
+
+    const std::vector<file_info>& entries() const { return entries_; }
+    // 按指定方式排好序的下标：目录总在文件之前，键相同时按名称；
+    // 每种顺序只在第一次使用时排序一次
+    const std::vector<uint32_t>& order(listing_sort sort, bool descending) const;
+    // 排序中位于a之前时返回true
+    static bool before(const file_info& a, const file_info& b, listing_sort sort, bool descending);
+
+private:
+    std::vector<file_info> entries_;
+    mutable std::once_flag sorted_[6];
+    mutable std::vector<uint32_t> orders_[6];
+};
+
+struct directory_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+    size_t cached_directories;
+};
+
+// 目录列表缓存：按绝对路径缓存directory_listing，LRU淘汰。
+// 每个缓存的目录挂一个inotify监视，目录下有增删改时作废；
+// 另外比较目录自身的mtime与inode，inotify不可用或监视数达到上限时仍能发现增删。
+class directory_cache {
+public:
+    explicit directory_cache(size_t capacity);
+    ~directory_cache();
+
+    // 返回path的当前列表，path不是目录时返回nullptr。容量为0时每次都重新读取
+    std::shared_ptr<const directory_listing> get(const std::string& path, const file_manager& files);
+    void set_capacity(size_t capacity);
+    directory_cache_stats stats() const;
+
+private:
+    struct node {
+        std::shared_ptr<const directory_listing> listing;
+        int watch;
+        // 每收到一次该目录的inotify事件加一，读取目录期间有变化时结果不能当作最新
+        uint64_t version;
+        uint64_t built_version;
+        struct timespec mtime;
+        ino_t inode;
+        std::list<std::string>::iterator lru;
+    };
+
+    void drain_events();
+    void evict(size_t limit);
+
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    int inotify_fd_;
+    std::unordered_map<std::string, node> nodes_;
+    std::unordered_map<int, std::string> watches_;
+    // 最近使用的在前，满时淘汰末尾
+    std::list<std::string> lru_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> invalidations_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_DIRECTORY_CACHE_H
@@ -0,0 +1,86 @@
+#ifndef TO_HTTPS_SERVER_EVENT_SERVER_H
+#define TO_HTTPS_SERVER_EVENT_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <to_https_server/external/httplib.h>
+#include <to_https_server/server/active_connections.h>
+#include <to_https_server/server/listener_handover.h>
+
+namespace to_https_server {
+
+// 基于epoll(边沿触发)的事件驱动服务器：少量I/O线程复用全部连接，并以非阻塞方式读入请求头，
+// 请求头完整后才交给工作线程池处理，空闲的keep-alive连接与慢速发送的客户端都不占用工作线程。
+// 路由与处理函数与httplib::Server完全相同，仅支持明文HTTP。
+class event_server : public httplib::Server, public handover_listener {
+public:
+    explicit event_server(size_t io_threads);
+    ~event_server() override;
+
+    // 绑定端口并运行事件循环，阻塞直到stop()；已通过adopt_socket接管监听套接字时不再绑定
+    bool run(const std::string& host, int port);
+    void stop();
+
+    void adopt_socket(int sock) override;
+    int listening_socket() const override;
+    // 从事件循环中摘除监听套接字；空闲连接立即关闭，处理中的连接在当前响应之后关闭
+    void stop_accepting() override;
+    // 即stop()：事件循环退出时只close监听套接字而不shutdown
+    void close_listener() override;
+    void track_connections(active_connections* connections) override;
+
+private:
+    class connection_stream;
+
+    struct connection {
+        int fd;
+        std::string remote_addr;
+        int remote_port;
+        std::string local_addr;
+        int local_port;
+        size_t requests_left;
+        bool busy;
+        std::chrono::steady_clock::time_point last_active;
+        // 与连接同生命周期：缓冲中可能已有I/O线程读入的请求头或下一个(流水线)请求的数据
+        std::unique_ptr<connection_stream> stream;
+        active_connections* tracker;
+
+        ~connection();
+    };
+
+    struct io_loop {
+        int epoll_fd = -1;
+        int wake_fd = -1;
+        std::thread thread;
+        std::mutex mutex;
+        std::unordered_map<int, std::shared_ptr<connection>> connections;
+    };
+
+    void io_thread(io_loop& loop);
+    void accept_connections(io_loop& loop);
+    void process_connection(io_loop& loop, std::shared_ptr<connection> conn);
+    // 处理完请求或请求头未收完时把连接挂回epoll；served为true时刷新空闲计时
+    void rearm_connection(io_loop& loop, const std::shared_ptr<connection>& conn, bool served);
+    void close_connection(io_loop& loop, int fd);
+    void close_idle_connections(io_loop& loop);
+    void wake_loops();
+
+    size_t io_thread_count_;
+    std::vector<std::unique_ptr<io_loop>> loops_;
+    std::unique_ptr<httplib::TaskQueue> task_queue_;
+    std::atomic<bool> running_;
+    // 监听套接字已交出，正在排空连接
+    std::atomic<bool> draining_;
+    active_connections* connections_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_EVENT_SERVER_H
@@ -0,0 +1,83 @@
+#ifndef TO_HTTPS_SERVER_FILE_JOBS_H
+#define TO_HTTPS_SERVER_FILE_JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+namespace to_https_server {
+
+enum class file_job_state { queued, running, done, failed };
+
+const char* file_job_state_name(file_job_state state);
+
+struct file_job_status {
+    uint64_t id;
+    // "copy" 或 "move"
+    std::string operation;
+    // URL路径
+    std::string source;
+    std::string destination;
+    file_job_state state;
+    uint64_t total_bytes;
+    uint64_t done_bytes;
+    uint64_t files;
+    // 通过FICLONE共享数据块完成的文件数，其余走copy_file_range或读写
+    uint64_t cloned_files;
+    std::string error;
+};
+
+// 服务器端复制/移动：由后台线程依次执行，请求线程只负责登记并返回任务号。
+// 单个文件优先FICLONE(reflink，Btrfs/XFS等支持时不复制数据)，其次copy_file_range
+// (在内核中复制，不经过用户态)，都不支持时退回pread/pwrite。
+// 先复制到目标旁的临时名下，全部成功后再改名为目标，失败时不留下残缺的目标；
+// 移动在同一文件系统内直接rename，不创建任务，跨文件系统时复制完成后删除源。
+class file_jobs {
+public:
+    file_jobs();
+    ~file_jobs();
+
+    void start();
+    void stop();
+
+    // source与destination为绝对路径，source_url与destination_url用于展示
+    uint64_t submit(const std::string& operation, const std::string& source, const std::string& destination,
+                    const std::string& source_url, const std::string& destination_url);
+    bool status(uint64_t id, file_job_status& result) const;
+    std::vector<file_job_status> list() const;
+
+private:
+    struct job {
+        file_job_status status;
+        std::string source;
+        std::string destination;
+    };
+
+    void run();
+    void execute(job& j);
+    bool copy_tree(job& j, const std::string& source, const std::string& destination);
+    bool copy_file(job& j, const std::string& source, const std::string& destination, mode_t mode);
+    void update(job& j, uint64_t bytes);
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::map<uint64_t, std::shared_ptr<job>> jobs_;
+    std::deque<std::shared_ptr<job>> queue_;
+    // 已结束的任务按完成顺序保留最近的若干个
+    std::deque<uint64_t> finished_;
+    uint64_t next_id_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_FILE_JOBS_H
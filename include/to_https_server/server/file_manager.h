@@ -3,7 +3,13 @@
 
 #include <string>
 #include <vector>
+#include <ctime>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <to_https_server/server/trash_manager.h>
+#include <to_https_server/server/content_store.h>
+#include <to_https_server/server/checksum.h>
 
 namespace fs = std::filesystem;
 
@@ -13,7 +19,8 @@ struct file_info {
     std::string name;
     bool is_directory;
     size_t size;
-    std::string last_modified;
+    // Unix时间戳，需要显示时再格式化
+    std::time_t last_modified;
 };
 
 class file_manager {
@@ -28,10 +35,29 @@ public:
     bool read_file_range(const std::string& path, size_t start, size_t end, 
                         std::string& content) const;
     
-    bool write_file(const std::string& path, const std::string& content);
+    // 打开文件供多次分块读取，返回fd，由调用者close
+    int open_file(const std::string& path) const;
+    bool read_range(int fd, size_t offset, size_t length,
+                    const std::function<bool(const char*, size_t)>& consumer) const;
+    
+    // 启用去重存储时，不小于min_size的内容经content_store存放；sha256为已校验过的摘要，可免去重复计算
+    bool write_file(const std::string& path, const std::string& content, const std::string& sha256 = "");
     bool append_file(const std::string& path, const std::string& content);
     
+    // 摘要以扩展属性保存在文件上，并记下当时的大小与修改时间；文件之后被改动则视为没有摘要
+    bool set_digests(const std::string& path, const file_digests& digests);
+    bool get_digests(const std::string& path, file_digests& digests) const;
+    
+    // 移入回收站，可通过restore_file恢复
     bool delete_file(const std::string& path);
+    restore_result restore_file(const std::string& trash_id);
+    trash_manager& trash() { return *trash_; }
+    void enable_content_store(const std::string& store_dir, size_t min_size);
+    // 未启用时为空
+    content_store* store() { return store_.get(); }
+    // 只凭摘要创建文件，内容不在存储中时返回false
+    bool link_content(const std::string& path, const std::string& sha256);
+    // 只做rename：目标已存在时失败(EEXIST)，跨文件系统时失败(EXDEV)
     bool move_file(const std::string& src, const std::string& dest);
     bool create_directory(const std::string& path);
     
@@ -44,9 +70,11 @@ public:
 private:
     std::string root_path_;
     std::string trash_path_;
+    std::unique_ptr<trash_manager> trash_;
+    std::unique_ptr<content_store> store_;
+    size_t store_min_size_;
     
     std::string get_safe_path(const std::string& path) const;
-    std::string generate_trash_filename(const std::string& original_name) const;
 };
 
 } // namespace to_https_server
@@ -1,24 +1,80 @@
 #ifndef TO_HTTPS_SERVER_GZIP_COMPRESSOR_H
 #define TO_HTTPS_SERVER_GZIP_COMPRESSOR_H
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace to_https_server {
 
 class gzip_compressor {
 public:
-    gzip_compressor();
+    // threads为并行压缩的线程数，0表示按CPU核数；输入不小于parallel_min_size时分块并行压缩。
+    // 除调用线程外另有threads-1个常驻的压缩线程，所有并行压缩共用，同时压缩的响应再多也不会超出
+    explicit gzip_compressor(size_t threads = 0, size_t parallel_min_size = 1024 * 1024);
     ~gzip_compressor();
     
-    bool compress(const std::string& input, std::string& output);
+    // zlib的级别：-1为默认(6)，1最快，9压缩率最高。写入持久缓存等一次压缩多次使用的内容应使用BEST_LEVEL
+    static const int DEFAULT_LEVEL = -1;
+    static const int BEST_LEVEL = 9;
+
+    bool compress(const std::string& input, std::string& output, int level = DEFAULT_LEVEL);
+    // pigz的做法：按块在多个线程上各自压缩，每块以前一块末尾32KB为预设字典，压缩率与单线程几乎相同；
+    // 非末块以同步刷新结束(字节对齐、不置BFINAL)，直接首尾相接即为合法的deflate流，CRC按块计算后合并
+    bool compress_parallel(const std::string& input, std::string& output, int level = DEFAULT_LEVEL);
     bool decompress(const std::string& input, std::string& output);
     
     bool is_gzip_supported(const std::string& accept_encoding) const;
+
+    // 按CPU占用、线程池每线程排队任务数与响应大小选择级别：空闲时压得更狠，饱和时降级，
+    // 过载时返回0表示不压缩(压缩只会进一步拉长排队)
+    int choose_level(size_t size, size_t queued_tasks, size_t pool_threads);
+    // 最近一次采样的整机CPU占用百分比
+    int cpu_percent() const { return cpu_percent_.load(); }
     
 private:
+    // 一次并行压缩：调用线程自己处理块，同时请常驻线程协助；running为正在协助的线程数
+    struct parallel_job {
+        std::function<void()> work;
+        size_t running = 0;
+    };
+
+    void sample_cpu();
+    void start_workers();
+    void worker_loop();
+
     static const int GZIP_WINDOW_BITS = 15 + 16;
     static const int GZIP_ENCODING = 16;
+    static const size_t PARALLEL_BLOCK_SIZE = 128 * 1024;
+    static const size_t DICTIONARY_SIZE = 32 * 1024;
+
+    size_t threads_;
+    size_t parallel_min_size_;
+
+    // 常驻压缩线程在第一次并行压缩时才启动
+    std::once_flag workers_started_;
+    std::vector<std::thread> workers_;
+    std::mutex jobs_mutex_;
+    std::condition_variable jobs_cv_;
+    std::condition_variable job_done_cv_;
+    // 每项代表请一个线程协助，同一任务可以出现多次
+    std::deque<std::shared_ptr<parallel_job>> jobs_;
+    bool stopping_;
+
+    // /proc/stat采样，多个请求同时到达时只有一个去读
+    std::atomic<int> cpu_percent_;
+    std::atomic<int64_t> cpu_sampled_ms_;
+    std::mutex cpu_mutex_;
+    uint64_t last_cpu_total_;
+    uint64_t last_cpu_idle_;
 };
 
 } // namespace to_https_server
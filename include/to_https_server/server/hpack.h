@@ -0,0 +1,48 @@
+#ifndef TO_HTTPS_SERVER_HPACK_H
+#define TO_HTTPS_SERVER_HPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace to_https_server {
+
+using header_list = std::vector<std::pair<std::string, std::string>>;
+
+enum class hpack_result { ok, malformed, too_large };
+
+// HPACK(RFC 7541)头部解码：静态表、动态表与Huffman解码
+class hpack_decoder {
+public:
+    explicit hpack_decoder(size_t max_table_size = 4096);
+
+    // 解码一个完整的头部块。解出的头部按RFC 7541 §4.1计算的总大小(每个字段名字与值的长度加32)
+    // 超过max_list_size时停止并返回too_large；此时动态表已与对端不一致，与格式错误一样只能关闭连接
+    hpack_result decode(const uint8_t* data, size_t size, header_list& headers, size_t max_list_size);
+
+private:
+    bool lookup(size_t index, std::string& name, std::string& value) const;
+    void insert(const std::string& name, const std::string& value);
+    void evict(size_t limit);
+
+    std::deque<std::pair<std::string, std::string>> dynamic_table_;
+    size_t table_size_;
+    size_t max_table_size_;
+    // 我方SETTINGS_HEADER_TABLE_SIZE，对端的大小更新不能超过它
+    size_t table_size_limit_;
+};
+
+// HPACK头部编码：只使用静态表和不索引的字面量，不维护动态表，
+// 字符串在更短时使用Huffman编码
+class hpack_encoder {
+public:
+    static void encode_status(int status, std::string& out);
+    static void encode(const std::string& name, const std::string& value, std::string& out);
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_HPACK_H
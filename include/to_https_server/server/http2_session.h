@@ -0,0 +1,122 @@
+#ifndef TO_HTTPS_SERVER_HTTP2_SESSION_H
+#define TO_HTTPS_SERVER_HTTP2_SESSION_H
+
+#include <to_https_server/server/hpack.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <to_https_server/external/httplib.h>
+
+namespace to_https_server {
+
+struct http2_options {
+    size_t max_concurrent_streams = 100;
+    // 我方的流初始接收窗口，连接级窗口另外放大到16MB
+    size_t initial_window_size = 1024 * 1024;
+    // 头部块编码后与解码后(按RFC 7541 §4.1计算)的大小上限
+    size_t max_header_list_size = 64 * 1024;
+    size_t max_body_size = 2ULL * 1024 * 1024 * 1024;
+    time_t idle_timeout_sec = 5;
+    time_t read_timeout_sec = 5;
+};
+
+// 一条HTTP/2连接(RFC 9113)：读取帧、HPACK解码后组装成httplib::Request交给handler，
+// 再把httplib::Response编码成HEADERS/DATA帧发回。
+// 收齐的请求交给连接线程所在的线程池处理，连接线程只负责收发帧，慢请求不阻塞其他流；
+// 线程池迟迟没有执行时由连接线程自己执行。响应体（尤其是content provider）在连接线程中
+// 按流轮流分帧发送，并遵守双方的流量控制窗口，多个下载可以在同一条连接上交错进行。
+class http2_session {
+public:
+    using handler = std::function<void(const httplib::Request&, httplib::Response&)>;
+
+    static const char PREFACE[];
+    static const size_t PREFACE_SIZE = 24;
+
+    http2_session(httplib::Stream& strm, handler h, const http2_options& options);
+    ~http2_session();
+
+    void set_remote(const std::string& addr, int port);
+    void set_local(const std::string& addr, int port);
+    void set_ssl(const SSL* ssl);
+
+    // 处理整条连接直到关闭；调用前客户端的连接序言尚未读取
+    bool run();
+
+private:
+    struct stream_state;
+    struct completion_queue;
+
+    bool read_exact(char* data, size_t size);
+    bool wait_input(time_t timeout_sec, time_t timeout_usec = 0);
+    bool input_ready();
+    bool flush();
+
+    bool read_frame();
+    bool on_headers(uint32_t stream_id, uint8_t flags, const std::string& payload);
+    bool on_continuation(uint32_t stream_id, uint8_t flags, const std::string& payload);
+    bool on_data(uint32_t stream_id, uint8_t flags, const std::string& payload);
+    bool on_settings(uint8_t flags, const std::string& payload);
+    bool on_window_update(uint32_t stream_id, const std::string& payload);
+    bool end_headers(stream_state& s, bool end_stream);
+
+    bool build_request(stream_state& s, const header_list& headers);
+    void dispatch(stream_state& s);
+    // 执行请求处理并把结果放入完成队列；已被其他线程取走时返回false
+    static bool execute(const std::shared_ptr<stream_state>& s, const handler& h,
+                        const std::shared_ptr<completion_queue>& completions);
+    static void handle_request(stream_state& s, const handler& h);
+    // 为处理完成的请求发送响应头
+    void collect_responses();
+    // 线程池等待过久的请求由连接线程执行
+    void run_stalled_handler();
+    void send_response_headers(stream_state& s);
+    bool has_sendable_data();
+    // 有流因限速被推迟或有请求等待线程池执行时返回true，及距最早需要处理的时刻还有多久
+    bool pending_delay(std::chrono::microseconds& delay);
+    bool fill_buffer(stream_state& s);
+    void send_round();
+    void close_stream(uint32_t stream_id);
+
+    void write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const char* payload, size_t size);
+    void write_settings();
+    void write_window_update(uint32_t stream_id, uint32_t increment);
+    void reset_stream(uint32_t stream_id, uint32_t error_code);
+    bool connection_error(uint32_t error_code);
+
+    httplib::Stream& strm_;
+    handler handler_;
+    http2_options options_;
+    std::string remote_addr_;
+    int remote_port_;
+    std::string local_addr_;
+    int local_port_;
+    const SSL* ssl_;
+
+    hpack_decoder decoder_;
+    // 请求处理期间流可能被重置，处理线程另持有一份引用
+    std::map<uint32_t, std::shared_ptr<stream_state>> streams_;
+    // 已交给线程池、结果尚未取回的请求
+    std::vector<std::shared_ptr<stream_state>> handling_;
+    std::shared_ptr<completion_queue> completions_;
+    uint32_t last_stream_id_;
+    // 正在接收头部块（HEADERS后跟CONTINUATION）的流
+    uint32_t continuation_stream_;
+    uint32_t next_send_stream_;
+
+    int64_t connection_send_window_;
+    int64_t peer_initial_window_;
+    size_t peer_max_frame_size_;
+
+    bool goaway_received_;
+    bool closed_;
+    std::string out_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_HTTP2_SESSION_H
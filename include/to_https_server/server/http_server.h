@@ -2,9 +2,25 @@
 #define TO_HTTPS_SERVER_HTTP_SERVER_H
 
 #include <to_https_server/external/toFileMemory/toFileMemory.h>
+#include <to_https_server/server/config.h>
 #include <to_https_server/server/file_manager.h>
+#include <to_https_server/server/directory_cache.h>
+#include <to_https_server/server/search_index.h>
+#include <to_https_server/server/file_jobs.h>
+#include <to_https_server/server/archive_stream.h>
+#include <to_https_server/server/bandwidth_limiter.h>
+#include <to_https_server/server/request_lanes.h>
+#include <to_https_server/server/admission_control.h>
 #include <to_https_server/server/security_manager.h>
 #include <to_https_server/server/gzip_compressor.h>
+#include <to_https_server/server/router.h>
+#include <to_https_server/server/event_server.h>
+#include <to_https_server/server/thread_pool.h>
+#include <to_https_server/server/tls_session_manager.h>
+#include <to_https_server/server/tls_server.h>
+#include <to_https_server/server/cleartext_server.h>
+#include <to_https_server/server/listener_handover.h>
+#include <to_https_server/server/active_connections.h>
 #include <to_https_server/utils/logger.h>
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <to_https_server/external/httplib.h>
@@ -19,45 +35,120 @@ public:
     void initialize(const std::string& runtime_dir);
     void start();
     void stop();
+    // 重新读取配置文件并应用可在线修改的部分；也可通过SIGHUP触发
+    bool reload_config();
     
 private:
+    // 单个文件操作的结果：HTTP状态码与说明；复制/移动转为后台任务时状态为202，说明为任务号
+    struct operation_result {
+        int status;
+        std::string message;
+    };
+    
+    std::shared_ptr<const server_config> current_config() const;
+    void apply_config(const server_config& config);
+    void watch_reload_signal();
+    bool open_listener(size_t index, int inherited);
+    void on_handed_over();
+    std::unique_ptr<httplib::Server> create_server();
     void setup_routes();
+    void install_handlers(httplib::Server& server);
+    // 路由前的统一检查（攻击、限流、上传大小），已生成拒绝响应时返回true
+    bool reject_request(const httplib::Request& req, httplib::Response& res);
+    void handle_http2_request(const httplib::Request& req, httplib::Response& res);
+    void dispatch_request(const httplib::Request& req, httplib::Response& res);
 	bool check_admin_password(const httplib::Request& req) const;
     void handle_file_request(const httplib::Request& req, httplib::Response& res);
+    void handle_file_request(const httplib::Request& req, httplib::Response& res, const std::string& request_path);
+    void handle_cloud_drive_request(const httplib::Request& req, httplib::Response& res);
     void handle_head_request(const httplib::Request& req, httplib::Response& res);
     void handle_upload_request(const httplib::Request& req, httplib::Response& res);
     void handle_delete_request(const httplib::Request& req, httplib::Response& res);
     void handle_mkdir_request(const httplib::Request& req, httplib::Response& res);
+    void handle_transfer_request(const httplib::Request& req, httplib::Response& res, const std::string& operation);
+    void handle_batch_request(const httplib::Request& req, httplib::Response& res);
+    void handle_archive_request(const httplib::Request& req, httplib::Response& res);
     void handle_list_request(const httplib::Request& req, httplib::Response& res);
 
 	void handle_visits_request(const httplib::Request& req, httplib::Response& res);
+	void handle_stats_request(const httplib::Request& req, httplib::Response& res);
+	void handle_reload_request(const httplib::Request& req, httplib::Response& res);
+	void handle_search_request(const httplib::Request& req, httplib::Response& res);
+	void handle_trash_list_request(const httplib::Request& req, httplib::Response& res);
+	void handle_trash_restore_request(const httplib::Request& req, httplib::Response& res);
+	void handle_jobs_request(const httplib::Request& req, httplib::Response& res);
+	operation_result start_transfer(const std::string& operation, const std::string& source_path, const std::string& dest_path);
+	operation_result run_batch_operation(const std::string& line);
+	std::vector<std::vector<size_t>> group_batch_operations(const std::vector<std::string>& lines) const;
     
     void handle_chunked_download(const std::string& path, const httplib::Request& req, httplib::Response& res);
     bool handle_chunked_upload(const httplib::Request& req, httplib::Response& res);
+    void store_upload(const httplib::Request& req, httplib::Response& res,
+                      const std::string& file_path, const std::string& filename, const std::string& content);
     
     std::string get_client_ip(const httplib::Request& req) const;
+	pool_stats total_pool_stats() const;
+	request_class classify_request(const httplib::Request& req) const;
+	// 按排队时延决定是否放行，拒绝时已写好503响应
+	bool admit_request(const httplib::Request& req, httplib::Response& res, request_class cls);
+	// bulk请求取得通道名额，失败时已写好503响应
+	bool enter_lane(httplib::Response& res, request_class cls);
+	void leave_lane();
+    bool is_compressible(const std::string& path) const;
     bool should_compress(const std::string& path, size_t size, const std::string& accept_encoding) const;
 
 	std::string query_real_ip(const httplib::Request& req) const;
 	std::string query_user_agent(const httplib::Request& req) const;
     
-    std::unique_ptr<httplib::Server> server_;
+    // threaded/epoll模式只有一个，reuseport模式每个监听套接字一个
+    std::vector<std::unique_ptr<httplib::Server>> servers_;
+    event_server* event_server_ = nullptr;
+    router router_;
     std::unique_ptr<file_manager> file_manager_;
+    std::unique_ptr<directory_cache> listing_cache_;
+    std::unique_ptr<search_index> search_index_;
+    std::unique_ptr<file_jobs> file_jobs_;
+    std::unique_ptr<bandwidth_limiter> bandwidth_;
+    std::unique_ptr<request_lanes> lanes_;
+    std::unique_ptr<admission_control> admission_;
     std::unique_ptr<gzip_compressor> compressor_;
     std::unique_ptr<security_manager> security_;
     std::unique_ptr<logger> logger_;
+    std::unique_ptr<tls_session_manager> tls_sessions_;
+    // /api/batch的辅助线程，所有批量请求共用；最后析构，执行中的操作仍可使用上面的成员
+    std::unique_ptr<work_stealing_pool> batch_pool_;
     
     bool running_;
 	int port_;
-	size_t thread_count_;
-	size_t task_queue_size_;
-    size_t buffer_chunk_size_;
-    size_t max_file_size_;
-	size_t cache_max_age_;
+	pool_options pool_options_;
+	// 由各server持有，仅用于读取统计
+	std::unique_ptr<std::atomic<work_stealing_pool*>[]> pools_;
+	std::string io_model_;
+	size_t io_threads_;
+	size_t acceptor_count_;
 	std::string cert_path_;
 	std::string privkey_path_;
-	std::string admin_password_;
+	tls_session_options tls_session_options_;
+	bool ktls_;
+	std::string upgrade_socket_;
+	size_t drain_timeout_;
+	std::unique_ptr<listener_handover> handover_;
+	// 与servers_一一对应
+	std::vector<handover_listener*> listeners_;
+	active_connections connections_;
+	// 监听套接字已交给新进程，正在排空已有连接
+	std::atomic<bool> draining_{false};
+	std::chrono::steady_clock::time_point drain_deadline_;
+	bool http2_;
+	http2_options http2_options_;
 	std::string runtime_dir_;
+	// 启动时的配置，用于提示哪些修改需要重启才能生效；保存副本，旧快照会被释放
+	server_config startup_config_;
+
+	// SIGHUP由信号处理函数置位，后台线程轮询后执行重新加载
+	std::thread reload_thread_;
+	std::mutex reload_mutex_;
+	std::condition_variable reload_cv_;
 
 	toFileMemory visitors_db_;
 	uint64_t *visitors_cnt_;
@@ -0,0 +1,77 @@
+#ifndef TO_HTTPS_SERVER_LISTENER_HANDOVER_H
+#define TO_HTTPS_SERVER_LISTENER_HANDOVER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace to_https_server {
+
+class active_connections;
+
+// 支持平滑升级的服务器：可以接管或交出监听套接字
+class handover_listener {
+public:
+    virtual ~handover_listener() = default;
+
+    // 使用从旧进程接管的监听套接字，代替bind_to_port
+    virtual void adopt_socket(int sock) = 0;
+    virtual int listening_socket() const = 0;
+    // 停止accept，只关闭本进程的描述符而不shutdown（监听套接字已交给新进程），
+    // 已建立的连接继续处理
+    virtual void stop_accepting() = 0;
+    // 连接排空后结束accept循环，使监听所在的线程返回
+    virtual void close_listener() = 0;
+    // 登记正在处理的连接，排空超时后用于强制断开
+    virtual void track_connections(active_connections* connections) = 0;
+};
+
+// 供以httplib的accept循环监听的服务器实现stop_accepting与close_listener，sock即其svr_sock_。
+// 停止accept时不能把sock置为无效：httplib会因此中断正在发送的响应体，
+// 所以用dup2把同一描述符原子地换成一个永远不可读的eventfd，accept循环只会等待超时，已有连接照常完成
+void stop_accepting_socket(std::atomic<int>& sock);
+// accept循环每轮都重新读取sock，看到INVALID_SOCKET(-1)后退出
+void close_listening_socket(std::atomic<int>& sock);
+
+// 平滑升级时在新旧进程之间交接监听套接字：
+// 新进程连接旧进程的Unix域套接字，旧进程用SCM_RIGHTS发来全部监听套接字和需要延续的状态，
+// 新进程接管后回复确认，旧进程随即停止accept，处理完已有连接后退出。
+// 新进程在确认之前退出时，旧进程继续正常服务。
+class listener_handover {
+public:
+    explicit listener_handover(const std::string& path);
+    ~listener_handover();
+
+    // 新进程：向旧进程索取监听套接字，没有旧进程在运行时返回false
+    bool acquire(std::vector<int>& sockets, std::string& state);
+    // 新进程：已接管全部套接字，通知旧进程
+    void confirm();
+
+    // 旧进程：在后台线程等待升级请求。export_state在交出时生成要延续的状态，
+    // 对方确认后调用on_handed_over（此后本进程不再接受升级请求）
+    bool serve(const std::vector<int>& sockets, std::function<std::string()> export_state,
+               std::function<void()> on_handed_over);
+    void stop();
+
+private:
+    void serve_loop();
+    bool hand_over(int client);
+
+    std::string path_;
+    // 新进程：acquire与confirm之间保持的连接
+    int client_fd_;
+
+    int listen_fd_;
+    std::vector<int> sockets_;
+    std::function<std::string()> export_state_;
+    std::function<void()> on_handed_over_;
+    std::atomic<bool> running_;
+    bool handed_over_;
+    std::thread thread_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_LISTENER_HANDOVER_H
@@ -0,0 +1,51 @@
+#ifndef TO_HTTPS_SERVER_REQUEST_LANES_H
+#define TO_HTTPS_SERVER_REQUEST_LANES_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace to_https_server {
+
+// 请求的类别：页面与小文件为interactive；大文件上传下载、归档等长时间占用线程的为bulk
+enum class request_class { interactive, bulk };
+
+struct request_lane_stats {
+    size_t bulk_active;
+    size_t bulk_queued;
+    uint64_t bulk_admitted;
+    uint64_t bulk_rejected;
+};
+
+// bulk通道的容量与排队：同时进行的bulk请求不超过bulk_slots个，其余最多bulk_queue个排队等待，
+// 队列已满或等待超时的直接拒绝。执行bulk请求的线程由线程池另行补足(work_stealing_pool::begin_bulk)，
+// interactive请求始终使用线程池的常规容量，不受大文件传输排队的影响
+class request_lanes {
+public:
+    request_lanes();
+
+    void configure(size_t bulk_slots, size_t bulk_queue, size_t queue_timeout_ms);
+    // bulk_slots为0时不区分类别
+    bool enabled() const;
+    // 取得一个bulk名额，必要时排队等待；失败返回false
+    bool enter_bulk();
+    void leave_bulk();
+    request_lane_stats stats() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    size_t bulk_slots_;
+    size_t bulk_queue_;
+    std::chrono::milliseconds queue_timeout_;
+    size_t active_;
+    size_t queued_;
+    uint64_t admitted_;
+    uint64_t rejected_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_REQUEST_LANES_H
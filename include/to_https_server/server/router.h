@@ -0,0 +1,70 @@
+#ifndef TO_HTTPS_SERVER_ROUTER_H
+#define TO_HTTPS_SERVER_ROUTER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <to_https_server/external/httplib.h>
+
+namespace to_https_server {
+
+// 前缀树路由表：按路径分段逐级匹配，启动时构建，运行期只读，无需正则
+class router {
+public:
+    using handler = std::function<void(const httplib::Request&, httplib::Response&)>;
+
+    router();
+
+    // 仅匹配完整路径，如 "/api/visits"
+    router& add(const std::string& method, const std::string& path, handler h);
+    // 匹配该路径及其所有子路径，如 "/cloud-drive"
+    router& add_prefix(const std::string& method, const std::string& path, handler h);
+    // 按查询参数 param 分发的操作，如 POST ?param=upload
+    router& add_action(const std::string& method, const std::string& action, handler h);
+    // 以上均未命中时的处理
+    router& set_fallback(const std::string& method, handler h);
+
+    // 查找处理函数，未命中返回nullptr；HEAD请求使用GET的路由
+    const handler* find(const httplib::Request& req) const;
+    bool dispatch(const httplib::Request& req, httplib::Response& res) const;
+    // 路径有完整匹配的路由(如 /api/stats)，这类请求不对应文件
+    bool has_exact(const httplib::Request& req) const;
+
+private:
+    enum method_id {
+        method_get,
+        method_post,
+        method_put,
+        method_delete,
+        method_options,
+        method_patch,
+        method_count,
+        method_unknown = method_count
+    };
+
+    struct node {
+        // 按分段名排序，查找时二分
+        std::vector<std::pair<std::string, std::unique_ptr<node>>> children;
+        handler exact[method_count];
+        handler prefix[method_count];
+
+        node* child(std::string_view segment) const;
+        node* add_child(std::string_view segment);
+    };
+
+    static method_id to_method_id(const std::string& method);
+    node* insert(const std::string& path);
+
+    std::unique_ptr<node> root_;
+    std::unordered_map<std::string, handler> actions_[method_count];
+    handler fallback_[method_count];
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_ROUTER_H
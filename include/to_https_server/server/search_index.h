@@ -0,0 +1,98 @@
+#ifndef TO_HTTPS_SERVER_SEARCH_INDEX_H
+#define TO_HTTPS_SERVER_SEARCH_INDEX_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace to_https_server {
+
+struct search_result {
+    // 相对www_root的URL路径，以'/'开头
+    std::string path;
+    bool is_directory;
+};
+
+struct search_index_stats {
+    bool ready;
+    size_t files;
+    size_t directories;
+    size_t watches;
+    // inotify监视数达到上限(fs.inotify.max_user_watches)时失败，这些目录下的变化要等下次重建才可见
+    uint64_t watch_failures;
+    uint64_t rebuilds;
+};
+
+// www_root下全部文件名的内存索引：每个名称按小写拆成三元组(trigram)建倒排表，
+// 子串/前缀查询取查询串各三元组中最短的倒排表作为候选，再逐个核对名称；不足三个字符的查询顺序扫描。
+// 后台线程先完整扫描一遍，之后通过inotify监视每个目录增量维护。
+class search_index {
+public:
+    explicit search_index(const std::string& root);
+    ~search_index();
+
+    void start();
+    void stop();
+
+    // scope为空时搜索全部，否则只搜索该目录（URL路径）之下；最多返回limit条，
+    // 还有更多结果时truncated为true
+    std::vector<search_result> search(const std::string& query, bool prefix, const std::string& scope,
+                                      size_t limit, bool& truncated) const;
+    search_index_stats stats() const;
+
+private:
+    struct node {
+        std::string name;
+        uint32_t parent;
+        bool directory;
+        bool alive;
+        int watch;
+        std::vector<uint32_t> children;
+    };
+
+    // 一份完整的索引；重建时在锁外构造新的，再整体替换
+    struct index_data {
+        std::vector<node> nodes;
+        // 三元组 -> 名称含该三元组的节点，节点id只增不减，因此各表天然有序
+        std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+        size_t files = 0;
+        size_t directories = 0;
+        // 已删除但仍留在倒排表中的节点，过多时重建
+        size_t dead = 0;
+    };
+
+    void run();
+    void rebuild();
+    void scan(index_data& data, uint32_t dir, const std::string& path);
+    void watch(index_data& data, uint32_t dir, const std::string& path);
+    void handle_events(index_data& data, const char* buffer, size_t size);
+    void remove_node(index_data& data, uint32_t id, bool unlink);
+
+    static uint32_t add_node(index_data& data, uint32_t parent, const std::string& name, bool directory);
+    static uint32_t find_child(const index_data& data, uint32_t parent, const std::string& name);
+    static std::string path_of(const index_data& data, uint32_t id);
+
+    std::string root_;
+    int inotify_fd_;
+    std::unique_ptr<index_data> data_;
+    // 以下只由后台线程访问：监视描述符 -> 目录节点
+    std::unordered_map<int, uint32_t> watches_;
+    bool need_rebuild_;
+
+    mutable std::shared_mutex mutex_;
+    std::atomic<bool> running_;
+    std::atomic<bool> ready_;
+    std::atomic<size_t> watch_count_;
+    std::atomic<uint64_t> watch_failures_;
+    std::atomic<uint64_t> rebuilds_;
+    std::thread thread_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_SEARCH_INDEX_H
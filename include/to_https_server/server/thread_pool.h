@@ -0,0 +1,142 @@
+#ifndef TO_HTTPS_SERVER_THREAD_POOL_H
+#define TO_HTTPS_SERVER_THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <to_https_server/external/httplib.h>
+
+namespace to_https_server {
+
+struct pool_options {
+    size_t min_threads = 8;
+    // 大于min_threads时启用自动伸缩
+    size_t max_threads = 8;
+    // 为0表示不限制排队任务数
+    size_t max_queued = 0;
+    bool pin_cpu = false;
+    // pin_cpu时：为-1则工作线程轮流绑定各CPU，否则全部绑定到该序号的CPU
+    int cpu = -1;
+
+    // 排队任务数或排队等待时间超过阈值时扩容
+    size_t grow_queue_depth = 4;
+    size_t grow_wait_ms = 50;
+    // 线程空闲超过该时间后缩容
+    size_t idle_timeout_sec = 60;
+};
+
+struct pool_stats {
+    size_t threads;
+    size_t min_threads;
+    size_t max_threads;
+    size_t queued;
+    uint64_t completed;
+    uint64_t rejected;
+    uint64_t grow_events;
+    uint64_t shrink_events;
+    // 最近一个采样周期内任务的最长排队时间
+    uint64_t max_wait_us;
+    // 正在执行大文件传输、不计入常规容量的线程数
+    size_t bulk_threads;
+};
+
+// 替代httplib::ThreadPool的任务队列：每个工作线程有自己的无锁环形队列，
+// 自己的队列为空时从其他线程的队列窃取任务；只有在全部空闲时才休眠，
+// 提交任务时仅在有线程休眠时才唤醒一个。
+// 自动伸缩模式下由后台线程按排队深度与排队时间扩容，空闲线程超时后退出。
+class work_stealing_pool final : public httplib::TaskQueue {
+public:
+    explicit work_stealing_pool(const pool_options& options);
+    ~work_stealing_pool() override;
+
+    bool enqueue(std::function<void()> fn) override;
+    void shutdown() override;
+
+    pool_stats stats() const;
+
+    // 运行中调整线程数范围与排队上限；线程数不足时立即补足，超出的线程在空闲后退出
+    void resize(size_t min_threads, size_t max_threads, size_t max_queued);
+
+    // 把任务交给当前线程所在的线程池；不在线程池的线程中或队列已满时返回false
+    static bool submit(std::function<void()> fn);
+
+    // 将当前线程绑定到进程允许的第index % N个CPU
+    static void pin_to_cpu(size_t index);
+
+    // 当前工作线程开始/结束一次大文件传输。期间该线程不计入常规容量：运行中的线程数减去
+    // 传输中的线程数低于min_threads时立即补一个线程，线程数上限也相应放宽，
+    // 页面请求可用的线程数不受长传输影响。release在end_bulk时调用，任务结束时仍未调用end_bulk的
+    // 由线程池代为调用，名额不会因连接中途断开而泄漏。不在线程池的线程中调用时只登记release
+    static void begin_bulk(std::function<void()> release = nullptr);
+    static void end_bulk();
+
+    // 当前任务在队列中等待的时间，每个任务只返回一次(之后的调用返回false)：
+    // 线程池按连接排队时，只有连接上的第一个请求经历了排队
+    static bool take_queue_delay(std::chrono::microseconds& delay);
+
+private:
+    struct queued_task {
+        std::function<void()> fn;
+        std::chrono::steady_clock::time_point enqueued_at;
+    };
+    struct worker;
+
+    void run(size_t index);
+    bool take(size_t index, queued_task& task);
+    void start_worker(size_t index);
+    void supervise();
+
+    worker* slot(size_t index) const;
+
+    pool_options options_;
+    // 可在运行中修改的部分
+    std::atomic<size_t> min_threads_;
+    std::atomic<size_t> max_threads_;
+    std::atomic<size_t> max_queued_;
+
+    // 工作线程槽位在首次启动时创建，之后不再释放；slots_为已创建的槽位数
+    std::unique_ptr<std::atomic<worker*>[]> workers_;
+    std::atomic<size_t> slots_;
+    size_t ring_capacity_;
+    // 串行化扩容、resize与槽位创建
+    std::mutex resize_mutex_;
+
+    // 下标小于active_的工作线程在运行，只有最后一个可以退出
+    std::atomic<size_t> active_;
+    std::atomic<size_t> bulk_;
+    std::atomic<size_t> queued_;
+    std::atomic<size_t> next_worker_;
+    std::atomic<bool> shutdown_;
+
+    std::atomic<uint64_t> completed_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> grow_events_;
+    std::atomic<uint64_t> shrink_events_;
+    std::atomic<uint64_t> window_max_wait_us_;
+    std::atomic<uint64_t> last_max_wait_us_;
+
+    // 所有环形队列都满时（仅在不限制排队数时可能发生）的后备队列
+    std::mutex overflow_mutex_;
+    std::deque<queued_task> overflow_;
+    std::atomic<size_t> overflow_size_;
+
+    std::mutex park_mutex_;
+    std::condition_variable park_cv_;
+    std::atomic<size_t> sleepers_;
+
+    std::thread supervisor_;
+    std::mutex supervisor_mutex_;
+    std::condition_variable supervisor_cv_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_THREAD_POOL_H
@@ -0,0 +1,68 @@
+#ifndef TO_HTTPS_SERVER_TLS_SERVER_H
+#define TO_HTTPS_SERVER_TLS_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <to_https_server/external/httplib.h>
+#include <to_https_server/server/active_connections.h>
+#include <to_https_server/server/http2_session.h>
+#include <to_https_server/server/listener_handover.h>
+
+namespace to_https_server {
+
+struct ktls_stats {
+    uint64_t ktls_connections;
+    uint64_t userspace_connections;
+    uint64_t sendfile_bytes;
+};
+
+// 在httplib::SSLServer的基础上支持内核TLS(kTLS)：握手后若内核接管了发送方向的加密，
+// 文件下载可以通过SSL_sendfile直接从页缓存发送，不再经过用户态加密和拷贝。
+// 内核或加密套件不支持时自动退回普通的SSL_write。
+class tls_server : public httplib::SSLServer, public handover_listener {
+public:
+    tls_server(const char* cert_path, const char* private_key_path);
+
+    void enable_ktls(bool enabled);
+    // 通过ALPN协商h2，协商成功的连接交给http2_session处理
+    void enable_http2(const http2_options& options, http2_session::handler h);
+
+    void adopt_socket(int sock) override;
+    int listening_socket() const override;
+    void stop_accepting() override;
+    void close_listener() override;
+    void track_connections(active_connections* connections) override;
+
+    // 当前线程正在处理的连接是否已启用kTLS发送
+    static bool can_send_file();
+    // 在content provider中调用：把文件[offset, offset + length)经sink发送出去，
+    // 实际由SSL_sendfile完成。仅在can_send_file()为true时可用
+    static bool send_file(httplib::DataSink& sink, int fd, size_t offset, size_t length);
+
+    static ktls_stats stats();
+
+private:
+    class ktls_stream;
+
+    bool process_and_close_socket(socket_t sock) override;
+
+    static int select_alpn(SSL* ssl, const unsigned char** out, unsigned char* outlen,
+                           const unsigned char* in, unsigned int inlen, void* arg);
+
+    bool ktls_enabled_;
+    bool http2_enabled_;
+    http2_options http2_options_;
+    http2_session::handler http2_handler_;
+    active_connections* connections_;
+    std::mutex ssl_mutex_;
+
+    static std::atomic<uint64_t> ktls_connections_;
+    static std::atomic<uint64_t> userspace_connections_;
+    static std::atomic<uint64_t> sendfile_bytes_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_TLS_SERVER_H
@@ -0,0 +1,94 @@
+#ifndef TO_HTTPS_SERVER_TLS_SESSION_MANAGER_H
+#define TO_HTTPS_SERVER_TLS_SESSION_MANAGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <openssl/ssl.h>
+
+namespace to_https_server {
+
+struct tls_session_options {
+    // 服务端会话缓存(TLS 1.2 会话ID)容量，0为关闭
+    size_t cache_size = 20480;
+    // 会话(含票据)有效期
+    size_t session_timeout_sec = 3600;
+    bool tickets = true;
+    // 票据密钥轮换周期，旧密钥在下一个周期内仍可解密
+    size_t ticket_rotate_sec = 3600;
+};
+
+struct tls_session_stats {
+    uint64_t full_handshakes;
+    uint64_t resumed_handshakes;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    size_t cached_sessions;
+    uint64_t ticket_key_rotations;
+};
+
+// TLS会话复用：进程内共享的会话缓存与内存中定期轮换的票据密钥。
+// 同一个实例可以挂到多个SSL_CTX上(reuseport模式)，各监听之间的会话互相可复用。
+class tls_session_manager {
+public:
+    explicit tls_session_manager(const tls_session_options& options);
+    ~tls_session_manager();
+
+    void attach(SSL_CTX* ctx);
+    // 运行中调整会话缓存容量，超出部分按LRU淘汰；attach时容量为0则缓存未注册，调整无效
+    void set_cache_size(size_t cache_size);
+    // 平滑升级时把票据密钥交给新进程，升级前发放的票据仍可复用
+    std::string export_ticket_keys();
+    bool import_ticket_keys(const std::string& data);
+    tls_session_stats stats() const;
+
+private:
+    struct ticket_key {
+        unsigned char name[16];
+        unsigned char aes_key[32];
+        unsigned char hmac_key[32];
+    };
+
+    struct cache_entry {
+        std::string der;
+        std::list<std::string>::iterator lru;
+    };
+
+    static tls_session_manager* from_ssl(SSL* ssl);
+    static int on_new_session(SSL* ssl, SSL_SESSION* session);
+    static SSL_SESSION* on_get_session(SSL* ssl, const unsigned char* id, int id_len, int* copy);
+    static void on_remove_session(SSL_CTX* ctx, SSL_SESSION* session);
+    static int on_ticket_key(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                             EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx, int enc);
+    static void on_info(const SSL* ssl, int where, int ret);
+
+    bool generate_key(ticket_key& key);
+    void rotate_if_due();
+
+    tls_session_options options_;
+
+    mutable std::mutex cache_mutex_;
+    std::unordered_map<std::string, cache_entry> cache_;
+    // 最近使用的在前，满时淘汰末尾
+    std::list<std::string> lru_;
+
+    std::mutex keys_mutex_;
+    ticket_key current_key_;
+    ticket_key previous_key_;
+    bool has_previous_key_;
+    std::chrono::steady_clock::time_point rotated_at_;
+
+    std::atomic<uint64_t> full_handshakes_;
+    std::atomic<uint64_t> resumed_handshakes_;
+    std::atomic<uint64_t> cache_hits_;
+    std::atomic<uint64_t> cache_misses_;
+    std::atomic<uint64_t> ticket_key_rotations_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_TLS_SESSION_MANAGER_H
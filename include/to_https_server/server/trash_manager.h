@@ -0,0 +1,99 @@
+#ifndef TO_HTTPS_SERVER_TRASH_MANAGER_H
+#define TO_HTTPS_SERVER_TRASH_MANAGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace to_https_server {
+
+struct trash_item {
+    // 回收站中的文件名，同时作为恢复时的标识
+    std::string id;
+    // 删除前相对www_root的URL路径，来历不明的旧文件为空
+    std::string original_path;
+    std::time_t deleted_at;
+    // 目录的大小由后台线程统计，统计完成前为-1
+    int64_t size;
+    // 跨文件系统删除：文件暂时改名留在原目录，后台复制进回收站后清空
+    std::string staging_path;
+    // 复制失败后下次重试的时间，不写入索引
+    std::time_t retry_at = 0;
+};
+
+struct trash_stats {
+    size_t items;
+    uint64_t bytes;
+    size_t pending_moves;
+    uint64_t purged_items;
+    uint64_t purged_bytes;
+};
+
+enum class restore_result { restored, not_found, pending, conflict, unknown_origin, failed };
+
+// 回收站：删除即改名进trash_dir，并在索引中记下原路径与时间，列表与恢复只查索引。
+// 索引以追加日志的形式保存在trash_dir/.index，启动时读回并压缩。
+// 后台线程以最低的CPU与I/O优先级完成跨文件系统的复制、统计目录大小，
+// 并按保留时间与总大小上限清理最早删除的项。
+class trash_manager {
+public:
+    explicit trash_manager(const std::string& trash_dir);
+    ~trash_manager();
+
+    void start();
+    void stop();
+    // max_age_sec为0时不按时间清理，max_bytes为0时不限制总大小
+    void set_limits(uint64_t max_age_sec, uint64_t max_bytes);
+
+    // source为绝对路径，original_path为恢复时使用的URL路径。跨文件系统时立即返回，复制在后台进行
+    bool move_to_trash(const std::string& source, const std::string& original_path);
+    // resolve把URL路径换成绝对路径；原位置已存在同名项时不覆盖
+    restore_result restore(const std::string& id, const std::function<std::string(const std::string&)>& resolve);
+    // 按删除时间从新到旧
+    std::vector<trash_item> list() const;
+    trash_stats stats() const;
+
+    // 跨文件系统删除时留在原目录中的暂存名，不对外提供下载、列出或搜索
+    static bool is_staging_name(const std::string& name);
+    // path(URL路径或绝对路径)中任意一级是暂存名
+    static bool is_staging_path(const std::string& path);
+
+private:
+    void load_index();
+    void rewrite_index();
+    void append_index(const std::string& line);
+    std::string make_id(const std::string& name, std::time_t now) const;
+
+    void run();
+    bool finish_pending_move();
+    bool measure_one();
+    void enforce_limits();
+
+    std::string trash_dir_;
+    std::string index_path_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, trash_item> items_;
+    std::ofstream journal_;
+    size_t journal_lines_;
+    uint64_t max_age_sec_;
+    uint64_t max_bytes_;
+    uint64_t purged_items_;
+    uint64_t purged_bytes_;
+
+    std::condition_variable wake_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+} // namespace to_https_server
+
+#endif // TO_HTTPS_SERVER_TRASH_MANAGER_H
@@ -0,0 +1,41 @@
+#include <to_https_server/server/active_connections.h>
+#include <sys/socket.h>
+
+namespace to_https_server {
+
+static thread_local bool close_after_response_ = false;
+
+void close_after_response() {
+    close_after_response_ = true;
+}
+
+bool take_close_after_response() {
+    bool result = close_after_response_;
+    close_after_response_ = false;
+    return result;
+}
+
+void active_connections::add(int sock) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sockets_.insert(sock);
+}
+
+void active_connections::remove(int sock) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sockets_.erase(sock);
+}
+
+size_t active_connections::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sockets_.size();
+}
+
+void active_connections::shutdown_all() {
+    // 持锁期间连接不会被移除和关闭，套接字号不会被复用
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int sock : sockets_) {
+        shutdown(sock, SHUT_RDWR);
+    }
+}
+
+} // namespace to_https_server
@@ -0,0 +1,67 @@
+#include <to_https_server/server/admission_control.h>
+#include <algorithm>
+
+namespace to_https_server {
+
+admission_control::admission_control()
+    : target_(0), interval_(0), interval_end_(std::chrono::steady_clock::now()), min_delay_(0),
+      last_min_delay_(0), sampled_(false), overloaded_(false), shed_bulk_(0), shed_interactive_(0) {}
+
+void admission_control::configure(uint64_t target_ms, uint64_t interval_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    target_ = std::chrono::milliseconds(target_ms);
+    interval_ = std::chrono::milliseconds(std::max<uint64_t>(interval_ms, 1));
+    if (target_.count() == 0) {
+        overloaded_ = false;
+    }
+}
+
+bool admission_control::admit(request_priority priority, std::chrono::microseconds delay, bool sampled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (target_.count() == 0) {
+        return true;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= interval_end_) {
+        // 间隔结束：最小时延仍高于target才算持续积压；整个间隔没有新排队的请求说明队列已空
+        overloaded_ = sampled_ && min_delay_ > target_;
+        last_min_delay_ = sampled_ ? min_delay_ : std::chrono::microseconds(0);
+        sampled_ = false;
+        interval_end_ = now + interval_;
+    }
+    if (sampled) {
+        min_delay_ = sampled_ ? std::min(min_delay_, delay) : delay;
+        sampled_ = true;
+    }
+
+    if (!overloaded_) {
+        return true;
+    }
+    switch (priority) {
+    case request_priority::admin:
+        return true;
+    case request_priority::bulk:
+        shed_bulk_++;
+        return false;
+    case request_priority::interactive:
+        if (delay > target_) {
+            shed_interactive_++;
+            return false;
+        }
+        return true;
+    }
+    return true;
+}
+
+admission_stats admission_control::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    admission_stats result;
+    result.overloaded = overloaded_;
+    result.min_delay_us = static_cast<uint64_t>(last_min_delay_.count());
+    result.shed_bulk = shed_bulk_;
+    result.shed_interactive = shed_interactive_;
+    return result;
+}
+
+} // namespace to_https_server
@@ -0,0 +1,554 @@
+#include <to_https_server/server/archive_stream.h>
+#include <to_https_server/server/trash_manager.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace to_https_server {
+
+static const uint64_t ZIP32_LIMIT = 0xFFFFFFFF;
+// deflate后可能比原文件略大，留出余量，超过即按ZIP64记录
+static const uint64_t ZIP64_DEFLATE_THRESHOLD = 0xFF000000;
+// ustar的size字段为11位八进制
+static const uint64_t TAR_SIZE_LIMIT = 077777777777ULL;
+static const size_t TAR_BLOCK = 512;
+
+static void put16(std::string& out, uint16_t value) {
+    out += static_cast<char>(value & 0xff);
+    out += static_cast<char>(value >> 8);
+}
+
+static void put32(std::string& out, uint32_t value) {
+    put16(out, static_cast<uint16_t>(value & 0xffff));
+    put16(out, static_cast<uint16_t>(value >> 16));
+}
+
+static void put64(std::string& out, uint64_t value) {
+    put32(out, static_cast<uint32_t>(value));
+    put32(out, static_cast<uint32_t>(value >> 32));
+}
+
+static void dos_time(std::time_t t, uint16_t& time, uint16_t& date) {
+    std::tm tm;
+    localtime_r(&t, &tm);
+    if (tm.tm_year < 80) {
+        // DOS时间从1980年开始
+        time = 0;
+        date = (1 << 5) | 1;
+        return;
+    }
+    time = static_cast<uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+    date = static_cast<uint16_t>(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+static uint64_t round_block(uint64_t size) {
+    return (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+}
+
+// PAX记录"<长度> <键>=<值>\n"，长度包含自身的位数
+static std::string pax_record(const std::string& key, const std::string& value) {
+    size_t body = key.size() + value.size() + 3;
+    size_t length = body + std::to_string(body).size();
+    if (std::to_string(length).size() != std::to_string(body).size()) {
+        ++length;
+    }
+    return std::to_string(length) + " " + key + "=" + value + "\n";
+}
+
+static std::string ustar_block(const std::string& name, const std::string& prefix, uint64_t size, char type,
+                               mode_t mode, std::time_t mtime) {
+    char block[TAR_BLOCK];
+    std::memset(block, 0, sizeof(block));
+    std::memcpy(block, name.data(), std::min<size_t>(name.size(), 100));
+    std::snprintf(block + 100, 8, "%07o", static_cast<unsigned>(mode & 07777));
+    std::snprintf(block + 108, 8, "%07o", 0u);
+    std::snprintf(block + 116, 8, "%07o", 0u);
+    unsigned long long clamped_mtime = static_cast<unsigned long long>(std::max<std::time_t>(mtime, 0));
+    std::snprintf(block + 124, 12, "%011llo", std::min<unsigned long long>(size, TAR_SIZE_LIMIT));
+    std::snprintf(block + 136, 12, "%011llo", std::min<unsigned long long>(clamped_mtime, TAR_SIZE_LIMIT));
+    block[156] = type;
+    std::memcpy(block + 257, "ustar", 6);
+    std::memcpy(block + 263, "00", 2);
+    std::memcpy(block + 345, prefix.data(), std::min<size_t>(prefix.size(), 155));
+    // 校验和按校验和字段全为空格计算
+    std::memset(block + 148, ' ', 8);
+    unsigned sum = 0;
+    for (unsigned char c : block) {
+        sum += c;
+    }
+    std::snprintf(block + 148, 8, "%06o", sum & 0777777);
+    block[155] = ' ';
+    return std::string(block, sizeof(block));
+}
+
+archive_stream::archive_stream(const std::string& root, const std::string& name, archive_format format,
+                               const std::function<bool(const std::string&)>& compressible, size_t chunk_size)
+    : format_(format), compressible_(compressible), sized_(true), size_(0),
+      buffer_(std::max<size_t>(chunk_size, 64 * 1024)), crc_entry_(SIZE_MAX), crc_position_(0), crc_running_(0),
+      current_(0), phase_(0), position_(0), fd_(-1), fd_entry_(SIZE_MAX), file_position_(0), zs_(nullptr) {
+    scan(root, name);
+    layout();
+}
+
+archive_stream::~archive_stream() {
+    close_file();
+    if (zs_) {
+        deflateEnd(zs_);
+        delete zs_;
+    }
+}
+
+void archive_stream::scan(const std::string& path, const std::string& name) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !(S_ISDIR(st.st_mode) || S_ISREG(st.st_mode))) {
+        return;
+    }
+    entry e;
+    e.name = name;
+    e.path = path;
+    e.directory = S_ISDIR(st.st_mode);
+    e.size = e.directory ? 0 : static_cast<uint64_t>(st.st_size);
+    e.mtime = st.st_mtime;
+    e.mode = st.st_mode;
+    e.deflate = format_ == archive_format::zip && !e.directory && e.size > 0 && compressible_ && compressible_(path);
+    e.zip64 = !e.directory && e.size >= (e.deflate ? ZIP64_DEFLATE_THRESHOLD : ZIP32_LIMIT);
+    e.offset = 0;
+    e.compressed = e.size;
+    e.crc = 0;
+    e.crc_known = e.size == 0;
+    sized_ = sized_ && !e.deflate;
+    entries_.push_back(e);
+    if (!e.directory) {
+        return;
+    }
+
+    // 按名称排序，同一目录两次生成的布局相同，续传的区间才对得上
+    std::vector<std::string> names;
+    if (DIR* dir = opendir(path.c_str())) {
+        while (dirent* item = readdir(dir)) {
+            if (std::strcmp(item->d_name, ".") != 0 && std::strcmp(item->d_name, "..") != 0 &&
+                !trash_manager::is_staging_name(item->d_name)) {
+                names.push_back(item->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(names.begin(), names.end());
+    for (const auto& child : names) {
+        scan(path + "/" + child, name + "/" + child);
+    }
+}
+
+void archive_stream::layout() {
+    if (!sized_) {
+        return;
+    }
+    uint64_t position = 0;
+    auto add = [&](part::kind_t kind, size_t index, uint64_t length) {
+        if (length > 0) {
+            parts_.push_back(part{kind, index, position, length});
+            position += length;
+        }
+    };
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        entry& e = entries_[i];
+        if (format_ == archive_format::tar) {
+            add(part::header, i, tar_header(e).size());
+            add(part::data, i, round_block(e.size));
+            continue;
+        }
+        e.offset = position;
+        add(part::header, i, zip_local_header(e).size());
+        if (!e.directory) {
+            add(part::data, i, e.size);
+            add(part::descriptor, i, zip_descriptor(e).size());
+        }
+    }
+    if (format_ == archive_format::tar) {
+        // 归档以两个全零块结束
+        add(part::trailer, 0, 2 * TAR_BLOCK);
+    } else {
+        add(part::central, 0, zip_central(position).size());
+    }
+    size_ = position;
+}
+
+std::string archive_stream::tar_header(const entry& e) const {
+    std::string name = e.directory ? e.name + "/" : e.name;
+    std::string prefix;
+    std::string pax;
+    if (name.size() > 100) {
+        // 优先拆到ustar的prefix字段，放不下时用PAX记录完整路径
+        size_t split = name.find('/', name.size() > 101 ? name.size() - 101 : 0);
+        if (split != std::string::npos && split > 0 && split <= 155 && split + 1 < name.size()) {
+            prefix = name.substr(0, split);
+            name = name.substr(split + 1);
+        } else {
+            pax += pax_record("path", name);
+            name = name.substr(0, 100);
+        }
+    }
+    uint64_t size = e.size;
+    if (size > TAR_SIZE_LIMIT) {
+        pax += pax_record("size", std::to_string(size));
+        size = 0;
+    }
+
+    std::string result;
+    if (!pax.empty()) {
+        result += ustar_block("PaxHeader", "", pax.size(), 'x', 0644, e.mtime);
+        result += pax;
+        result.resize(round_block(result.size()), '\0');
+    }
+    result += ustar_block(name, prefix, size, e.directory ? '5' : '0', e.mode, e.mtime);
+    return result;
+}
+
+std::string archive_stream::zip_local_header(const entry& e) const {
+    std::string name = e.directory ? e.name + "/" : e.name;
+    uint16_t time, date;
+    dos_time(e.mtime, time, date);
+    std::string header;
+    put32(header, 0x04034b50);
+    put16(header, e.zip64 ? 45 : 20);
+    // bit 3：CRC与大小在数据之后的描述符中给出；bit 11：文件名为UTF-8
+    put16(header, e.directory ? 0x0800 : 0x0808);
+    put16(header, e.deflate ? 8 : 0);
+    put16(header, time);
+    put16(header, date);
+    put32(header, 0);
+    put32(header, e.zip64 ? 0xFFFFFFFF : 0);
+    put32(header, e.zip64 ? 0xFFFFFFFF : 0);
+    put16(header, static_cast<uint16_t>(name.size()));
+    put16(header, e.zip64 ? 20 : 0);
+    header += name;
+    if (e.zip64) {
+        put16(header, 0x0001);
+        put16(header, 16);
+        put64(header, 0);
+        put64(header, 0);
+    }
+    return header;
+}
+
+std::string archive_stream::zip_descriptor(const entry& e) const {
+    std::string descriptor;
+    put32(descriptor, 0x08074b50);
+    put32(descriptor, e.crc);
+    if (e.zip64) {
+        put64(descriptor, e.compressed);
+        put64(descriptor, e.size);
+    } else {
+        put32(descriptor, static_cast<uint32_t>(e.compressed));
+        put32(descriptor, static_cast<uint32_t>(e.size));
+    }
+    return descriptor;
+}
+
+std::string archive_stream::zip_central(uint64_t cd_offset) const {
+    std::string cd;
+    for (const auto& e : entries_) {
+        std::string name = e.directory ? e.name + "/" : e.name;
+        bool big_offset = e.offset >= ZIP32_LIMIT;
+        std::string extra;
+        if (e.zip64 || big_offset) {
+            std::string fields;
+            if (e.zip64) {
+                put64(fields, e.size);
+                put64(fields, e.compressed);
+            }
+            if (big_offset) {
+                put64(fields, e.offset);
+            }
+            put16(extra, 0x0001);
+            put16(extra, static_cast<uint16_t>(fields.size()));
+            extra += fields;
+        }
+        uint16_t time, date;
+        dos_time(e.mtime, time, date);
+        put32(cd, 0x02014b50);
+        // 高字节3表示Unix，外部属性的高16位为st_mode
+        put16(cd, (3 << 8) | 45);
+        put16(cd, e.zip64 || big_offset ? 45 : 20);
+        put16(cd, e.directory ? 0x0800 : 0x0808);
+        put16(cd, e.deflate ? 8 : 0);
+        put16(cd, time);
+        put16(cd, date);
+        put32(cd, e.crc);
+        put32(cd, e.zip64 ? 0xFFFFFFFF : static_cast<uint32_t>(e.compressed));
+        put32(cd, e.zip64 ? 0xFFFFFFFF : static_cast<uint32_t>(e.size));
+        put16(cd, static_cast<uint16_t>(name.size()));
+        put16(cd, static_cast<uint16_t>(extra.size()));
+        put16(cd, 0);
+        put16(cd, 0);
+        put16(cd, 0);
+        put32(cd, (static_cast<uint32_t>(e.mode & 0xFFFF) << 16) | (e.directory ? 0x10 : 0));
+        put32(cd, big_offset ? 0xFFFFFFFF : static_cast<uint32_t>(e.offset));
+        cd += name;
+        cd += extra;
+    }
+
+    uint64_t cd_size = cd.size();
+    uint64_t count = entries_.size();
+    if (count >= 0xFFFF || cd_size >= ZIP32_LIMIT || cd_offset >= ZIP32_LIMIT) {
+        uint64_t end64_offset = cd_offset + cd_size;
+        put32(cd, 0x06064b50);
+        put64(cd, 44);
+        put16(cd, (3 << 8) | 45);
+        put16(cd, 45);
+        put32(cd, 0);
+        put32(cd, 0);
+        put64(cd, count);
+        put64(cd, count);
+        put64(cd, cd_size);
+        put64(cd, cd_offset);
+        put32(cd, 0x07064b50);
+        put32(cd, 0);
+        put64(cd, end64_offset);
+        put32(cd, 1);
+    }
+    put32(cd, 0x06054b50);
+    put16(cd, 0);
+    put16(cd, 0);
+    put16(cd, static_cast<uint16_t>(std::min<uint64_t>(count, 0xFFFF)));
+    put16(cd, static_cast<uint16_t>(std::min<uint64_t>(count, 0xFFFF)));
+    put32(cd, static_cast<uint32_t>(std::min(cd_size, ZIP32_LIMIT)));
+    put32(cd, static_cast<uint32_t>(std::min(cd_offset, ZIP32_LIMIT)));
+    put16(cd, 0);
+    return cd;
+}
+
+void archive_stream::close_file() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    fd_ = -1;
+    fd_entry_ = SIZE_MAX;
+}
+
+void archive_stream::read_file(size_t index, uint64_t from, char* data, size_t length) {
+    if (fd_entry_ != index) {
+        close_file();
+        fd_ = open(entries_[index].path.c_str(), O_RDONLY | O_CLOEXEC);
+        fd_entry_ = index;
+    }
+    size_t done = 0;
+    while (fd_ >= 0 && done < length) {
+        ssize_t n = pread(fd_, data + done, length - done, static_cast<off_t>(from + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    std::memset(data + done, 0, length - done);
+}
+
+bool archive_stream::read_data(size_t index, uint64_t from, size_t length, const sink& out) {
+    entry& e = entries_[index];
+    size_t n = std::min(length, buffer_.size());
+    if (from >= e.size) {
+        // TAR数据块末尾的填充
+        std::memset(buffer_.data(), 0, n);
+        return out(buffer_.data(), n);
+    }
+    n = static_cast<size_t>(std::min<uint64_t>(n, e.size - from));
+    read_file(index, from, buffer_.data(), n);
+
+    if (format_ == archive_format::zip && !e.crc_known) {
+        if (from == 0) {
+            crc_entry_ = index;
+            crc_position_ = 0;
+            crc_running_ = static_cast<uint32_t>(crc32(0L, Z_NULL, 0));
+        }
+        if (crc_entry_ == index && crc_position_ == from) {
+            crc_running_ = static_cast<uint32_t>(crc32(crc_running_, reinterpret_cast<const Bytef*>(buffer_.data()),
+                                                       static_cast<uInt>(n)));
+            crc_position_ += n;
+            if (crc_position_ == e.size) {
+                e.crc = crc_running_;
+                e.crc_known = true;
+            }
+        }
+    }
+    return out(buffer_.data(), n);
+}
+
+void archive_stream::compute_crc(entry& e) {
+    // 续传的区间没有覆盖整个文件，只好把文件再读一遍
+    size_t index = static_cast<size_t>(&e - entries_.data());
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (uint64_t from = 0; from < e.size;) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(buffer_.size(), e.size - from));
+        read_file(index, from, buffer_.data(), n);
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(buffer_.data()), static_cast<uInt>(n));
+        from += n;
+    }
+    e.crc = static_cast<uint32_t>(crc);
+    e.crc_known = true;
+}
+
+bool archive_stream::read(uint64_t offset, size_t length, const sink& out) {
+    auto it = std::upper_bound(parts_.begin(), parts_.end(), offset,
+                               [](uint64_t value, const part& p) { return value < p.start; });
+    if (!sized_ || it == parts_.begin() || length == 0) {
+        return false;
+    }
+    const part& p = *--it;
+    uint64_t from = offset - p.start;
+    if (from >= p.length) {
+        return false;
+    }
+    size_t n = static_cast<size_t>(std::min<uint64_t>(length, p.length - from));
+
+    switch (p.kind) {
+    case part::header: {
+        const entry& e = entries_[p.entry];
+        std::string header = format_ == archive_format::tar ? tar_header(e) : zip_local_header(e);
+        return out(header.data() + from, n);
+    }
+    case part::data:
+        return read_data(p.entry, from, n, out);
+    case part::descriptor: {
+        entry& e = entries_[p.entry];
+        if (!e.crc_known) {
+            compute_crc(e);
+        }
+        std::string descriptor = zip_descriptor(e);
+        return out(descriptor.data() + from, n);
+    }
+    case part::central:
+        if (central_.empty()) {
+            for (auto& e : entries_) {
+                if (!e.crc_known) {
+                    compute_crc(e);
+                }
+            }
+            central_ = zip_central(p.start);
+        }
+        return out(central_.data() + from, n);
+    case part::trailer:
+        n = std::min(n, buffer_.size());
+        std::memset(buffer_.data(), 0, n);
+        return out(buffer_.data(), n);
+    }
+    return false;
+}
+
+bool archive_stream::deflate_step(size_t index, const sink& out, bool& finished) {
+    entry& e = entries_[index];
+    if (!zs_) {
+        // 原始deflate流(无zlib头)，ZIP要求的格式
+        zs_ = new z_stream();
+        if (deflateInit2(zs_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            delete zs_;
+            zs_ = nullptr;
+            return false;
+        }
+        deflated_.resize(buffer_.size());
+    }
+    size_t n = static_cast<size_t>(std::min<uint64_t>(buffer_.size(), e.size - file_position_));
+    read_file(index, file_position_, buffer_.data(), n);
+    e.crc = static_cast<uint32_t>(crc32(e.crc, reinterpret_cast<const Bytef*>(buffer_.data()), static_cast<uInt>(n)));
+    file_position_ += n;
+    int flush = file_position_ == e.size ? Z_FINISH : Z_NO_FLUSH;
+
+    zs_->next_in = reinterpret_cast<Bytef*>(buffer_.data());
+    zs_->avail_in = static_cast<uInt>(n);
+    do {
+        zs_->next_out = reinterpret_cast<Bytef*>(deflated_.data());
+        zs_->avail_out = static_cast<uInt>(deflated_.size());
+        deflate(zs_, flush);
+        size_t have = deflated_.size() - zs_->avail_out;
+        if (have > 0) {
+            if (!out(deflated_.data(), have)) {
+                return false;
+            }
+            e.compressed += have;
+            position_ += have;
+        }
+    } while (zs_->avail_out == 0);
+
+    finished = flush == Z_FINISH;
+    if (finished) {
+        deflateEnd(zs_);
+        delete zs_;
+        zs_ = nullptr;
+    }
+    return true;
+}
+
+bool archive_stream::next(const sink& out, bool& done) {
+    done = false;
+    // 顺序生成只用于含deflate条目的ZIP，各段依次为本地头、数据、描述符，最后是中央目录
+    while (true) {
+        if (current_ == entries_.size()) {
+            if (phase_ == 0) {
+                phase_ = 1;
+                std::string tail = zip_central(position_);
+                position_ += tail.size();
+                return out(tail.data(), tail.size());
+            }
+            done = true;
+            return true;
+        }
+
+        entry& e = entries_[current_];
+        switch (phase_) {
+        case 0: {
+            e.offset = position_;
+            e.compressed = 0;
+            e.crc = 0;
+            file_position_ = 0;
+            phase_ = e.directory ? 3 : 1;
+            std::string header = zip_local_header(e);
+            position_ += header.size();
+            return out(header.data(), header.size());
+        }
+        case 1: {
+            if (file_position_ == e.size) {
+                phase_ = 2;
+                continue;
+            }
+            if (e.deflate) {
+                bool finished = false;
+                bool ok = deflate_step(current_, out, finished);
+                if (finished) {
+                    phase_ = 2;
+                }
+                return ok;
+            }
+            size_t n = static_cast<size_t>(std::min<uint64_t>(buffer_.size(), e.size - file_position_));
+            read_file(current_, file_position_, buffer_.data(), n);
+            e.crc = static_cast<uint32_t>(crc32(e.crc, reinterpret_cast<const Bytef*>(buffer_.data()),
+                                                static_cast<uInt>(n)));
+            file_position_ += n;
+            e.compressed += n;
+            position_ += n;
+            return out(buffer_.data(), n);
+        }
+        case 2: {
+            e.crc_known = true;
+            phase_ = 3;
+            std::string descriptor = zip_descriptor(e);
+            position_ += descriptor.size();
+            return out(descriptor.data(), descriptor.size());
+        }
+        default:
+            close_file();
+            ++current_;
+            phase_ = 0;
+            break;
+        }
+    }
+}
+
+} // namespace to_https_server
@@ -0,0 +1,384 @@
+#include <to_https_server/server/async_file_io.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace to_https_server {
+
+static const unsigned RING_DEPTH = 8;
+static const size_t IO_BLOCK_SIZE = 256 * 1024;
+
+// 0: 尚未探测；1: 可用；-1: 内核不支持或已被禁用
+static std::atomic<int> uring_state_{0};
+
+class async_file_io::ring {
+public:
+    ring() = default;
+    ~ring();
+
+    bool init();
+    // 提交一批请求并等待全部完成，results按提交顺序保存每个请求的返回值
+    bool submit_and_wait(io_uring_sqe* requests, unsigned count, int* results);
+
+    char* buffer(unsigned index) { return buffers_ + index * IO_BLOCK_SIZE; }
+    bool fixed_buffers() const { return fixed_buffers_; }
+    bool broken() const { return broken_; }
+
+private:
+    int fd_ = -1;
+    void* sq_ptr_ = MAP_FAILED;
+    size_t sq_size_ = 0;
+    void* cq_ptr_ = MAP_FAILED;
+    size_t cq_size_ = 0;
+    void* sqes_ptr_ = MAP_FAILED;
+    size_t sqes_size_ = 0;
+    char* buffers_ = nullptr;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    bool fixed_buffers_ = false;
+    bool broken_ = false;
+};
+
+async_file_io::ring::~ring() {
+    if (buffers_) {
+        munmap(buffers_, RING_DEPTH * IO_BLOCK_SIZE);
+    }
+    if (sqes_ptr_ != MAP_FAILED) {
+        munmap(sqes_ptr_, sqes_size_);
+    }
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+        munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != MAP_FAILED) {
+        munmap(sq_ptr_, sq_size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool async_file_io::ring::init() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, RING_DEPTH, &params));
+    if (fd_ < 0) {
+        return false;
+    }
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+        return false;
+    }
+    cq_ptr_ = single_mmap ? sq_ptr_ : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED) {
+        return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ptr_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ptr_ == MAP_FAILED) {
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    char* cq = static_cast<char*>(cq_ptr_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    sqes_ = static_cast<io_uring_sqe*>(sqes_ptr_);
+
+    void* buffers = mmap(nullptr, RING_DEPTH * IO_BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) {
+        return false;
+    }
+    buffers_ = static_cast<char*>(buffers);
+
+    // 注册缓冲区失败（如memlock限制）时仍可使用普通读
+    iovec iov[RING_DEPTH];
+    for (unsigned i = 0; i < RING_DEPTH; ++i) {
+        iov[i].iov_base = buffer(i);
+        iov[i].iov_len = IO_BLOCK_SIZE;
+    }
+    fixed_buffers_ = syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iov, RING_DEPTH) == 0;
+    return true;
+}
+
+bool async_file_io::ring::submit_and_wait(io_uring_sqe* requests, unsigned count, int* results) {
+    unsigned tail = *sq_tail_;
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned index = tail & *sq_mask_;
+        sqes_[index] = requests[i];
+        sqes_[index].user_data = i;
+        sq_array_[index] = index;
+        ++tail;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit = count;
+    unsigned completed = 0;
+    while (completed < count) {
+        unsigned head = *cq_head_;
+        unsigned ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != ready) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            results[cqe.user_data] = cqe.res;
+            ++completed;
+            ++head;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        if (completed == count) {
+            break;
+        }
+
+        long ret = syscall(__NR_io_uring_enter, fd_, to_submit, count - completed, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // ring中可能还留有未完成的请求，不再复用
+            broken_ = true;
+            return false;
+        }
+        to_submit -= std::min<unsigned>(to_submit, static_cast<unsigned>(ret));
+    }
+    return true;
+}
+
+async_file_io::ring* async_file_io::thread_ring() {
+    if (uring_state_.load(std::memory_order_relaxed) < 0) {
+        return nullptr;
+    }
+
+    thread_local std::unique_ptr<ring> local;
+    thread_local bool tried = false;
+    if (!tried) {
+        tried = true;
+        auto created = std::make_unique<ring>();
+        int expected = 0;
+        if (created->init()) {
+            uring_state_.compare_exchange_strong(expected, 1);
+            local = std::move(created);
+        } else {
+            uring_state_.compare_exchange_strong(expected, -1);
+        }
+    }
+    if (local && local->broken()) {
+        local.reset();
+    }
+    return local.get();
+}
+
+void async_file_io::disable_uring() {
+    uring_state_ = -1;
+}
+
+bool async_file_io::uring_available() {
+    return thread_ring() != nullptr;
+}
+
+static bool pread_all(int fd, size_t offset, size_t length, char* out) {
+    while (length > 0) {
+        ssize_t n = pread(fd, out, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        out += n;
+        offset += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool async_file_io::read(int fd, size_t offset, size_t length, const consumer& on_data) {
+    ring* r = thread_ring();
+    if (!r) {
+        thread_local std::vector<char> buffer(IO_BLOCK_SIZE);
+        while (length > 0) {
+            size_t size = std::min(length, IO_BLOCK_SIZE);
+            if (!pread_all(fd, offset, size, buffer.data()) || !on_data(buffer.data(), size)) {
+                return false;
+            }
+            offset += size;
+            length -= size;
+        }
+        return true;
+    }
+
+    io_uring_sqe requests[RING_DEPTH];
+    size_t sizes[RING_DEPTH];
+    int results[RING_DEPTH];
+    while (length > 0) {
+        // 一次提交最多RING_DEPTH个块，让磁盘同时处理多个请求
+        unsigned count = 0;
+        size_t pos = offset;
+        size_t end = offset + length;
+        while (count < RING_DEPTH && pos < end) {
+            sizes[count] = std::min(end - pos, IO_BLOCK_SIZE);
+            io_uring_sqe& sqe = requests[count];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = r->fixed_buffers() ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.off = pos;
+            sqe.addr = reinterpret_cast<uint64_t>(r->buffer(count));
+            sqe.len = static_cast<uint32_t>(sizes[count]);
+            sqe.buf_index = static_cast<uint16_t>(count);
+            pos += sizes[count];
+            ++count;
+        }
+
+        if (!r->submit_and_wait(requests, count, results)) {
+            return false;
+        }
+
+        for (unsigned i = 0; i < count; ++i) {
+            if (results[i] <= 0) {
+                return false;
+            }
+            size_t got = static_cast<size_t>(results[i]);
+            if (!on_data(r->buffer(i), got)) {
+                return false;
+            }
+            offset += got;
+            length -= got;
+            // 读取不完整时从断点重新提交，丢弃之后已读出的块
+            if (got < sizes[i]) {
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool async_file_io::read(int fd, size_t offset, size_t length, char* out) {
+    ring* r = thread_ring();
+    if (!r) {
+        return pread_all(fd, offset, length, out);
+    }
+
+    io_uring_sqe requests[RING_DEPTH];
+    size_t sizes[RING_DEPTH];
+    int results[RING_DEPTH];
+    while (length > 0) {
+        unsigned count = 0;
+        size_t pos = 0;
+        while (count < RING_DEPTH && pos < length) {
+            sizes[count] = std::min(length - pos, IO_BLOCK_SIZE);
+            io_uring_sqe& sqe = requests[count];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.off = offset + pos;
+            sqe.addr = reinterpret_cast<uint64_t>(out + pos);
+            sqe.len = static_cast<uint32_t>(sizes[count]);
+            pos += sizes[count];
+            ++count;
+        }
+
+        if (!r->submit_and_wait(requests, count, results)) {
+            return false;
+        }
+
+        for (unsigned i = 0; i < count; ++i) {
+            if (results[i] <= 0) {
+                return false;
+            }
+            size_t got = static_cast<size_t>(results[i]);
+            out += got;
+            offset += got;
+            length -= got;
+            if (got < sizes[i]) {
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool async_file_io::write(int fd, size_t offset, const char* data, size_t length) {
+    ring* r = thread_ring();
+    if (!r) {
+        while (length > 0) {
+            ssize_t n = pwrite(fd, data, length, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            offset += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    io_uring_sqe requests[RING_DEPTH];
+    size_t sizes[RING_DEPTH];
+    int results[RING_DEPTH];
+    while (length > 0) {
+        unsigned count = 0;
+        size_t pos = 0;
+        while (count < RING_DEPTH && pos < length) {
+            sizes[count] = std::min(length - pos, IO_BLOCK_SIZE);
+            io_uring_sqe& sqe = requests[count];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_WRITE;
+            sqe.fd = fd;
+            sqe.off = offset + pos;
+            sqe.addr = reinterpret_cast<uint64_t>(data + pos);
+            sqe.len = static_cast<uint32_t>(sizes[count]);
+            pos += sizes[count];
+            ++count;
+        }
+
+        if (!r->submit_and_wait(requests, count, results)) {
+            return false;
+        }
+
+        for (unsigned i = 0; i < count; ++i) {
+            if (results[i] <= 0) {
+                return false;
+            }
+            size_t done = static_cast<size_t>(results[i]);
+            data += done;
+            offset += done;
+            length -= done;
+            if (done < sizes[i]) {
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace to_https_server
@@ -0,0 +1,176 @@
+#include <to_https_server/server/bandwidth_limiter.h>
+#include <algorithm>
+#include <thread>
+
+namespace to_https_server {
+
+// 每次放行的量：约100ms的发送量，但不少于16KB，避免系统调用过碎
+static const double GRANT_SECONDS = 0.1;
+static const size_t MIN_GRANT = 16 * 1024;
+// 桶容量：允许约250ms的突发
+static const double BURST_SECONDS = 0.25;
+
+static double seconds_between(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+// 当前线程上生效的bandwidth_deferral
+static thread_local bandwidth_deferral* current_deferral_ = nullptr;
+
+bandwidth_deferral::bandwidth_deferral() : previous_(current_deferral_), deferred_(false) {
+    current_deferral_ = this;
+}
+
+bandwidth_deferral::~bandwidth_deferral() {
+    current_deferral_ = previous_;
+}
+
+bandwidth_transfer::bandwidth_transfer(bandwidth_limiter& limiter, const std::string& ip)
+    : limiter_(limiter), ip_(ip), tokens_(0), refilled_(std::chrono::steady_clock::now()) {
+    limiter_.join(ip_);
+}
+
+bandwidth_transfer::~bandwidth_transfer() {
+    limiter_.leave(ip_);
+}
+
+size_t bandwidth_transfer::acquire(size_t wanted) {
+    size_t length = wanted;
+    bandwidth_deferral* deferral = current_deferral_;
+    auto wait = limiter_.reserve(*this, length, deferral == nullptr);
+    if (wait.count() > 0) {
+        if (deferral) {
+            auto retry_at = std::chrono::steady_clock::now() + wait;
+            if (!deferral->deferred_ || retry_at < deferral->retry_at_) {
+                deferral->retry_at_ = retry_at;
+            }
+            deferral->deferred_ = true;
+            return 0;
+        }
+        // 休眠而不是轮询；期间不持有任何数据
+        std::this_thread::sleep_for(wait);
+    }
+    return length;
+}
+
+void bandwidth_transfer::settle(size_t granted, size_t sent) {
+    if (granted != sent) {
+        limiter_.settle(*this, static_cast<double>(sent) - static_cast<double>(granted));
+    }
+}
+
+bandwidth_limiter::bandwidth_limiter()
+    : global_rate_(0), per_ip_rate_(0), per_transfer_rate_(0), global_tokens_(0),
+      global_refilled_(std::chrono::steady_clock::now()), transfers_(0), bytes_(0), throttled_us_(0) {}
+
+void bandwidth_limiter::configure(uint64_t global_rate, uint64_t per_ip_rate, uint64_t per_transfer_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    global_rate_ = global_rate;
+    per_ip_rate_ = per_ip_rate;
+    per_transfer_rate_ = per_transfer_rate;
+    global_tokens_ = std::min(global_tokens_, global_rate * BURST_SECONDS);
+}
+
+bool bandwidth_limiter::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return global_rate_ || per_ip_rate_ || per_transfer_rate_;
+}
+
+std::unique_ptr<bandwidth_transfer> bandwidth_limiter::start(const std::string& ip) {
+    if (!enabled()) {
+        return nullptr;
+    }
+    return std::unique_ptr<bandwidth_transfer>(new bandwidth_transfer(*this, ip));
+}
+
+void bandwidth_limiter::join(const std::string& ip) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    clients_[ip]++;
+    transfers_++;
+}
+
+void bandwidth_limiter::leave(const std::string& ip) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = clients_.find(ip);
+    if (it != clients_.end() && --it->second == 0) {
+        clients_.erase(it);
+    }
+    transfers_--;
+}
+
+std::chrono::microseconds bandwidth_limiter::reserve(bandwidth_transfer& transfer, size_t& length, bool can_wait) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    size_t same_ip = std::max<size_t>(clients_[transfer.ip_], 1);
+    size_t clients = std::max<size_t>(clients_.size(), 1);
+
+    // 本传输当前的公平份额：各项上限中最小的一个，随活跃传输的增减即时变化
+    double rate = 0;
+    auto limit = [&rate](double value) {
+        if (value > 0) {
+            rate = rate > 0 ? std::min(rate, value) : value;
+        }
+    };
+    limit(static_cast<double>(per_transfer_rate_));
+    limit(static_cast<double>(per_ip_rate_) / same_ip);
+    limit(static_cast<double>(global_rate_) / clients / same_ip);
+    if (rate <= 0) {
+        bytes_ += length;
+        return std::chrono::microseconds(0);
+    }
+    length = std::min(length, std::max(MIN_GRANT, static_cast<size_t>(rate * GRANT_SECONDS)));
+
+    // 令牌可以透支：本次先放行，已有的透支折算成发送前的休眠时间。
+    // 新传输的第一块不必等待，之后的平均速率仍准确
+    double wait = 0;
+    transfer.tokens_ = std::min(transfer.tokens_ + rate * seconds_between(transfer.refilled_, now),
+                                rate * BURST_SECONDS);
+    transfer.refilled_ = now;
+    if (transfer.tokens_ < 0) {
+        wait = -transfer.tokens_ / rate;
+    }
+    if (global_rate_ > 0) {
+        double global_rate = static_cast<double>(global_rate_);
+        global_tokens_ = std::min(global_tokens_ + global_rate * seconds_between(global_refilled_, now),
+                                  global_rate * BURST_SECONDS);
+        global_refilled_ = now;
+        if (global_tokens_ < 0) {
+            wait = std::max(wait, -global_tokens_ / global_rate);
+        }
+    }
+
+    auto result = std::chrono::microseconds(static_cast<int64_t>(wait * 1e6));
+    if (result.count() > 0 && !can_wait) {
+        // 透支还清之前不放行，调用方稍后再来
+        length = 0;
+        return result;
+    }
+    transfer.tokens_ -= static_cast<double>(length);
+    if (global_rate_ > 0) {
+        global_tokens_ -= static_cast<double>(length);
+    }
+    bytes_ += length;
+    throttled_us_ += static_cast<uint64_t>(result.count());
+    return result;
+}
+
+void bandwidth_limiter::settle(bandwidth_transfer& transfer, double bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    transfer.tokens_ -= bytes;
+    if (global_rate_ > 0) {
+        global_tokens_ -= bytes;
+    }
+    bytes_ = static_cast<uint64_t>(std::max(0.0, static_cast<double>(bytes_) + bytes));
+}
+
+bandwidth_stats bandwidth_limiter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bandwidth_stats result;
+    result.active_transfers = transfers_;
+    result.active_clients = clients_.size();
+    result.bytes = bytes_;
+    result.throttled_ms = throttled_us_ / 1000;
+    return result;
+}
+
+} // namespace to_https_server
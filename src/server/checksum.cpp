@@ -0,0 +1,190 @@
+#include <to_https_server/server/checksum.h>
+#include <algorithm>
+#include <cstring>
+#include <openssl/evp.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+namespace to_https_server {
+
+// 反射形式的Castagnoli多项式
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+// 三路交错时每路的字节数
+static const size_t CRC_STRIDE = 4096;
+
+struct crc32c_table {
+    uint32_t entries[256];
+    crc32c_table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; ++k) {
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+static uint32_t crc32c_portable(uint32_t crc, const unsigned char* p, size_t size) {
+    static const crc32c_table table;
+    while (size--) {
+        crc = table.entries[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+// x^n mod P(反射形式)
+static uint32_t x_pow_mod(size_t n) {
+    uint32_t r = 0x80000000;
+    while (n--) {
+        r = (r >> 1) ^ ((r & 1) ? CRC32C_POLY : 0);
+    }
+    return r;
+}
+
+// 状态前移len字节(乘以x^(8*len) mod P)：clmul结果为x*A*K，crc32指令再乘x^32并取模，
+// 因此K取x^(8*len-33)
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32c_shift(uint32_t crc, uint32_t k) {
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(crc)),
+                                           _mm_cvtsi32_si128(static_cast<int>(k)), 0);
+    return static_cast<uint32_t>(_mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(product))));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32c_hardware(uint32_t crc, const unsigned char* p, size_t size) {
+    static const uint32_t k1 = x_pow_mod(8 * CRC_STRIDE - 33);
+    static const uint32_t k2 = x_pow_mod(16 * CRC_STRIDE - 33);
+
+    uint64_t c0 = crc;
+    // crc32指令延迟3个周期、每周期可发射1条，三路互不依赖才能占满
+    while (size >= 3 * CRC_STRIDE) {
+        uint64_t c1 = 0;
+        uint64_t c2 = 0;
+        for (size_t i = 0; i < CRC_STRIDE; i += 8) {
+            uint64_t v0, v1, v2;
+            std::memcpy(&v0, p + i, 8);
+            std::memcpy(&v1, p + CRC_STRIDE + i, 8);
+            std::memcpy(&v2, p + 2 * CRC_STRIDE + i, 8);
+            c0 = _mm_crc32_u64(c0, v0);
+            c1 = _mm_crc32_u64(c1, v1);
+            c2 = _mm_crc32_u64(c2, v2);
+        }
+        c0 = crc32c_shift(static_cast<uint32_t>(c0), k2) ^ crc32c_shift(static_cast<uint32_t>(c1), k1) ^ c2;
+        p += 3 * CRC_STRIDE;
+        size -= 3 * CRC_STRIDE;
+    }
+    while (size >= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        c0 = _mm_crc32_u64(c0, v);
+        p += 8;
+        size -= 8;
+    }
+    uint32_t result = static_cast<uint32_t>(c0);
+    while (size--) {
+        result = _mm_crc32_u8(result, *p++);
+    }
+    return result;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#if defined(__x86_64__)
+    static const bool hardware = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+    if (hardware) {
+        return ~crc32c_hardware(crc, p, size);
+    }
+#endif
+    return ~crc32c_portable(crc, p, size);
+}
+
+std::string base64_encode(const unsigned char* data, size_t size) {
+    std::string result(4 * ((size + 2) / 3), '\0');
+    int length = EVP_EncodeBlock(reinterpret_cast<unsigned char*>(&result[0]), data, static_cast<int>(size));
+    result.resize(length > 0 ? static_cast<size_t>(length) : 0);
+    return result;
+}
+
+static std::string crc32c_to_base64(uint32_t crc) {
+    // 按网络字节序编码，与RFC 3230/9530中crc32c的写法一致
+    unsigned char bytes[4] = {static_cast<unsigned char>(crc >> 24), static_cast<unsigned char>(crc >> 16),
+                              static_cast<unsigned char>(crc >> 8), static_cast<unsigned char>(crc)};
+    return base64_encode(bytes, sizeof(bytes));
+}
+
+std::string digest_header_value(const file_digests& digests) {
+    unsigned char bytes[32];
+    size_t length = std::min(digests.sha256.size() / 2, sizeof(bytes));
+    for (size_t i = 0; i < length; ++i) {
+        bytes[i] = static_cast<unsigned char>(std::stoul(digests.sha256.substr(2 * i, 2), nullptr, 16));
+    }
+    return "sha-256=" + base64_encode(bytes, length) + ",crc32c=" + crc32c_to_base64(digests.crc32c);
+}
+
+checksum_stream::checksum_stream(bool with_md5)
+    : crc_(0), sha256_(EVP_MD_CTX_new()), md5_(with_md5 ? EVP_MD_CTX_new() : nullptr) {
+    EVP_DigestInit_ex(sha256_, EVP_sha256(), nullptr);
+    if (md5_) {
+        EVP_DigestInit_ex(md5_, EVP_md5(), nullptr);
+    }
+    std::memset(sha256_digest_, 0, sizeof(sha256_digest_));
+    std::memset(md5_digest_, 0, sizeof(md5_digest_));
+}
+
+checksum_stream::~checksum_stream() {
+    EVP_MD_CTX_free(sha256_);
+    if (md5_) {
+        EVP_MD_CTX_free(md5_);
+    }
+}
+
+void checksum_stream::update(const char* data, size_t size) {
+    // 逐块依次交给各算法，每块在缓存中时就处理完，不必为每种摘要各读一遍内存
+    const size_t block = 256 * 1024;
+    for (size_t offset = 0; offset < size; offset += block) {
+        size_t length = std::min(block, size - offset);
+        crc_ = crc32c(crc_, data + offset, length);
+        EVP_DigestUpdate(sha256_, data + offset, length);
+        if (md5_) {
+            EVP_DigestUpdate(md5_, data + offset, length);
+        }
+    }
+}
+
+void checksum_stream::finish() {
+    EVP_DigestFinal_ex(sha256_, sha256_digest_, nullptr);
+    if (md5_) {
+        EVP_DigestFinal_ex(md5_, md5_digest_, nullptr);
+    }
+}
+
+file_digests checksum_stream::digests() const {
+    static const char* hex = "0123456789abcdef";
+    file_digests result;
+    result.crc32c = crc_;
+    for (unsigned char c : sha256_digest_) {
+        result.sha256 += hex[c >> 4];
+        result.sha256 += hex[c & 0xf];
+    }
+    return result;
+}
+
+std::string checksum_stream::sha256_base64() const {
+    return base64_encode(sha256_digest_, sizeof(sha256_digest_));
+}
+
+std::string checksum_stream::crc32c_base64() const {
+    return crc32c_to_base64(crc_);
+}
+
+std::string checksum_stream::md5_base64() const {
+    return base64_encode(md5_digest_, sizeof(md5_digest_));
+}
+
+} // namespace to_https_server
@@ -0,0 +1,95 @@
+#include <to_https_server/server/cleartext_server.h>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace to_https_server {
+
+cleartext_server::cleartext_server() : http2_enabled_(false), connections_(nullptr) {}
+
+void cleartext_server::enable_http2(const http2_options& options, http2_session::handler h) {
+    http2_enabled_ = true;
+    http2_options_ = options;
+    http2_handler_ = std::move(h);
+}
+
+void cleartext_server::adopt_socket(int sock) {
+    svr_sock_ = sock;
+}
+
+int cleartext_server::listening_socket() const {
+    return svr_sock_;
+}
+
+void cleartext_server::stop_accepting() {
+    stop_accepting_socket(svr_sock_);
+}
+
+void cleartext_server::close_listener() {
+    close_listening_socket(svr_sock_);
+}
+
+void cleartext_server::track_connections(active_connections* connections) {
+    connections_ = connections;
+}
+
+bool cleartext_server::peek_preface(socket_t sock) {
+    // 只窥探不消费，不是HTTP/2时数据原样留给httplib读取
+    char buf[http2_session::PREFACE_SIZE];
+    while (httplib::detail::select_read(sock, read_timeout_sec_, read_timeout_usec_) > 0) {
+        ssize_t n = recv(sock, buf, sizeof(buf), MSG_PEEK);
+        if (n <= 0 || std::memcmp(buf, http2_session::PREFACE, static_cast<size_t>(n)) != 0) {
+            return false;
+        }
+        if (static_cast<size_t>(n) == sizeof(buf)) {
+            return true;
+        }
+        // 序言还没收全，稍等后再看
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+bool cleartext_server::process_and_close_socket(socket_t sock) {
+    if (connections_) {
+        connections_->add(sock);
+    }
+
+    std::string remote_addr;
+    int remote_port = 0;
+    httplib::detail::get_remote_ip_and_port(sock, remote_addr, remote_port);
+
+    std::string local_addr;
+    int local_port = 0;
+    httplib::detail::get_local_ip_and_port(sock, local_addr, local_port);
+
+    bool ret;
+    if (http2_enabled_ && peek_preface(sock)) {
+        httplib::detail::SocketStream strm(sock, read_timeout_sec_, read_timeout_usec_,
+                                           write_timeout_sec_, write_timeout_usec_);
+        http2_session session(strm, http2_handler_, http2_options_);
+        session.set_remote(remote_addr, remote_port);
+        session.set_local(local_addr, local_port);
+        ret = session.run();
+    } else {
+        // 与httplib::Server的实现相同
+        ret = httplib::detail::process_server_socket(
+            svr_sock_, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
+            read_timeout_sec_, read_timeout_usec_, write_timeout_sec_, write_timeout_usec_,
+            [&](httplib::Stream& strm, bool close_connection, bool& connection_closed) {
+                bool ok = process_request(strm, remote_addr, remote_port, local_addr, local_port,
+                                          close_connection, connection_closed, nullptr);
+                connection_closed = take_close_after_response() || connection_closed;
+                return ok;
+            });
+    }
+
+    if (connections_) {
+        connections_->remove(sock);
+    }
+    httplib::detail::shutdown_socket(sock);
+    httplib::detail::close_socket(sock);
+    return ret;
+}
+
+} // namespace to_https_server
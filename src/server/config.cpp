@@ -9,14 +9,21 @@ config_manager& config_manager::instance() {
     return instance;
 }
 
-void config_manager::load_config(const std::string& config_path) {
+config_manager::config_manager() : current_(std::make_shared<server_config>()), generation_(0) {
+}
+
+bool config_manager::load_config(const std::string& config_path) {
     std::lock_guard<std::mutex> lock(config_mutex_);
+    config_path_ = config_path;
     
     std::ifstream file(config_path);
     if (!file.is_open()) {
         std::cerr << "Warning: Cannot open config file " << config_path << ", using defaults\n";
-        return;
+        return false;
     }
+
+    // 每次都从默认值开始解析，配置文件中删掉的项恢复默认
+    auto config = std::make_shared<server_config>();
     
     std::string line;
     while (std::getline(file, line)) {
@@ -37,26 +44,87 @@ void config_manager::load_config(const std::string& config_path) {
 			value = value.substr(0, value.size() - 1);
 		}
         
-        if (key == "port") config_.port = std::stoi(value);
-        else if (key == "ssl_cert_path") config_.ssl_cert_path = value;
-        else if (key == "ssl_key_path") config_.ssl_key_path = value;
-        else if (key == "thread_pool_size") config_.thread_pool_size = std::stoi(value);
-        else if (key == "task_queue_size") config_.task_queue_size = std::stoi(value);
-        // else if (key == "max_requests_per_second") config_.max_requests_per_second = std::stoi(value);
-        // else if (key == "attack_threshold") config_.attack_threshold = std::stoi(value);
-        else if (key == "www_root") config_.www_root = value;
-        else if (key == "log_dir") config_.log_dir = value;
-        else if (key == "trash_dir") config_.trash_dir = value;
-        else if (key == "buffer_chunk_size") config_.buffer_chunk_size = std::stoull(value);
-        else if (key == "max_file_size") config_.max_file_size = std::stoull(value);
-		else if (key == "cache_max_age") config_.cache_max_age = std::stoull(value);
-		else if (key == "admin_password") config_.admin_password = value;
+        // 无法解析的值忽略该项，避免重新加载时因笔误中断
+        try {
+            if (key == "port") config->port = std::stoi(value);
+            else if (key == "ssl_cert_path") config->ssl_cert_path = value;
+            else if (key == "ssl_key_path") config->ssl_key_path = value;
+            else if (key == "tls_session_cache_size") config->tls_session_cache_size = std::stoull(value);
+            else if (key == "tls_session_timeout") config->tls_session_timeout = std::stoull(value);
+            else if (key == "tls_session_tickets") config->tls_session_tickets = (value == "true" || value == "1");
+            else if (key == "tls_ticket_rotate_interval") config->tls_ticket_rotate_interval = std::stoull(value);
+            else if (key == "ktls") config->ktls = (value == "true" || value == "1");
+            else if (key == "http2") config->http2 = (value == "true" || value == "1");
+            else if (key == "http2_max_concurrent_streams") config->http2_max_concurrent_streams = std::stoull(value);
+            else if (key == "thread_pool_size") config->thread_pool_size = std::stoi(value);
+            else if (key == "task_queue_size") config->task_queue_size = std::stoi(value);
+            else if (key == "thread_pool_pin_cpu") config->thread_pool_pin_cpu = (value == "true" || value == "1");
+            else if (key == "thread_pool_max_size") config->thread_pool_max_size = std::stoull(value);
+            else if (key == "thread_pool_grow_queue_depth") config->thread_pool_grow_queue_depth = std::stoull(value);
+            else if (key == "thread_pool_grow_wait_ms") config->thread_pool_grow_wait_ms = std::stoull(value);
+            else if (key == "thread_pool_idle_timeout") config->thread_pool_idle_timeout = std::stoull(value);
+            else if (key == "io_model") config->io_model = value;
+            else if (key == "io_threads") config->io_threads = std::stoull(value);
+            else if (key == "acceptor_count") config->acceptor_count = std::stoull(value);
+            else if (key == "upgrade_socket") config->upgrade_socket = value;
+            else if (key == "drain_timeout") config->drain_timeout = std::stoull(value);
+            // else if (key == "max_requests_per_second") config->max_requests_per_second = std::stoi(value);
+            // else if (key == "attack_threshold") config->attack_threshold = std::stoi(value);
+            else if (key == "www_root") config->www_root = value;
+            else if (key == "log_dir") config->log_dir = value;
+            else if (key == "trash_dir") config->trash_dir = value;
+            else if (key == "trash_max_age") config->trash_max_age = std::stoull(value);
+            else if (key == "trash_max_size") config->trash_max_size = std::stoull(value);
+            else if (key == "content_store_dir") config->content_store_dir = value;
+            else if (key == "content_store_min_size") config->content_store_min_size = std::stoull(value);
+            else if (key == "buffer_chunk_size") config->buffer_chunk_size = std::stoull(value);
+            else if (key == "max_file_size") config->max_file_size = std::stoull(value);
+		    else if (key == "cache_max_age") config->cache_max_age = std::stoull(value);
+            else if (key == "bandwidth_limit") config->bandwidth_limit = std::stoull(value);
+            else if (key == "bandwidth_per_ip_limit") config->bandwidth_per_ip_limit = std::stoull(value);
+            else if (key == "bandwidth_per_transfer_limit") config->bandwidth_per_transfer_limit = std::stoull(value);
+            else if (key == "bulk_min_size") config->bulk_min_size = std::stoull(value);
+            else if (key == "bulk_threads") config->bulk_threads = std::stoull(value);
+            else if (key == "bulk_queue_size") config->bulk_queue_size = std::stoull(value);
+            else if (key == "bulk_queue_timeout_ms") config->bulk_queue_timeout_ms = std::stoull(value);
+            else if (key == "admission_target_ms") config->admission_target_ms = std::stoull(value);
+            else if (key == "admission_interval_ms") config->admission_interval_ms = std::stoull(value);
+            else if (key == "admission_retry_after") config->admission_retry_after = std::stoull(value);
+            else if (key == "listing_cache_size") config->listing_cache_size = std::stoull(value);
+            else if (key == "listing_page_limit") config->listing_page_limit = std::stoull(value);
+            else if (key == "batch_max_operations") config->batch_max_operations = std::stoull(value);
+            else if (key == "batch_concurrency") config->batch_concurrency = std::stoull(value);
+            else if (key == "compress_threads") config->compress_threads = std::stoull(value);
+            else if (key == "compress_parallel_min_size") config->compress_parallel_min_size = std::stoull(value);
+            else if (key == "gzip_adaptive") config->gzip_adaptive = (value == "true" || value == "1");
+            else if (key == "search_index") config->search_index = (value == "true" || value == "1");
+		    else if (key == "use_io_uring") config->use_io_uring = (value == "true" || value == "1");
+		    else if (key == "admin_password") config->admin_password = value;
+        } catch (const std::exception&) {
+            std::cerr << "Warning: Invalid value for " << key << ", ignored\n";
+        }
     }
+
+    std::atomic_store(&current_, std::shared_ptr<const server_config>(std::move(config)));
+    generation_++;
+    return true;
 }
 
-const server_config& config_manager::get_config() const {
-    std::lock_guard<std::mutex> lock(config_mutex_);
-    return config_;
+bool config_manager::reload() {
+    std::string config_path;
+    {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        config_path = config_path_;
+    }
+    return !config_path.empty() && load_config(config_path);
+}
+
+std::shared_ptr<const server_config> config_manager::get_config() const {
+    return std::atomic_load(&current_);
+}
+
+uint64_t config_manager::generation() const {
+    return generation_.load();
 }
 
 } // namespace to_https_server
@@ -0,0 +1,349 @@
+#include <to_https_server/server/content_store.h>
+#include <to_https_server/server/async_file_io.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <set>
+#include <vector>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <openssl/evp.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace to_https_server {
+
+static const char* INDEX_FILE = ".index";
+static const std::chrono::hours COLLECT_INTERVAL(1);
+// 刚写入、尚未链接出去的对象不回收
+static const std::time_t COLLECT_GRACE_SEC = 600;
+
+static std::atomic<uint64_t> temp_counter(0);
+
+// 路径是记录的最后一个字段，只需转义换行与反斜杠
+static std::string escape_path(const std::string& value) {
+    std::string result;
+    for (char c : value) {
+        if (c == '\\') {
+            result += "\\\\";
+        } else if (c == '\n') {
+            result += "\\n";
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+static std::string unescape_path(const std::string& value) {
+    std::string result;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            result += value[++i] == 'n' ? '\n' : value[i];
+        } else {
+            result += value[i];
+        }
+    }
+    return result;
+}
+
+static int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+content_store::content_store(const std::string& store_dir)
+    : store_dir_(store_dir), index_path_(store_dir + "/" + INDEX_FILE), journal_lines_(0),
+      dedup_hits_(0), saved_bytes_(0), collected_objects_(0), running_(false) {
+    std::error_code ec;
+    fs::create_directories(store_dir_ + "/objects", ec);
+    fs::create_directories(store_dir_ + "/tmp", ec);
+    load_index();
+}
+
+content_store::~content_store() {
+    stop();
+}
+
+void content_store::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void content_store::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_.exchange(false)) {
+            return;
+        }
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+std::string content_store::sha256_hex(const char* data, size_t size) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_Digest(data, size, digest, &length, EVP_sha256(), nullptr);
+    static const char* hex = "0123456789abcdef";
+    std::string result;
+    for (unsigned int i = 0; i < length; ++i) {
+        result += hex[digest[i] >> 4];
+        result += hex[digest[i] & 0xf];
+    }
+    return result;
+}
+
+bool content_store::valid_digest(const std::string& digest) {
+    if (digest.size() != 64) {
+        return false;
+    }
+    for (char c : digest) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string content_store::object_path(const std::string& digest) const {
+    return store_dir_ + "/objects/" + digest.substr(0, 2) + "/" + digest.substr(2);
+}
+
+bool content_store::store(const std::string& target, const std::string& content, const std::string& digest) {
+    // 上传内容已整体在内存中，先算摘要，已有的对象就不必再写一遍
+    std::string hex = digest.empty() ? sha256_hex(content.data(), content.size()) : digest;
+    bool exists;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        exists = objects_.count(hex) > 0;
+    }
+
+    if (!exists) {
+        std::string object = object_path(hex);
+        std::string temp = store_dir_ + "/tmp/" + hex + "." + std::to_string(getpid()) + "." +
+                           std::to_string(temp_counter++);
+        std::error_code ec;
+        fs::create_directories(fs::path(object).parent_path(), ec);
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = async_file_io::write(fd, 0, content.data(), content.size());
+        ok = close(fd) == 0 && ok;
+        // 用link放到对象名下：同时上传相同内容时先到者生效，后到者的EEXIST同样可用
+        ok = ok && (link(temp.c_str(), object.c_str()) == 0 || errno == EEXIST);
+        unlink(temp.c_str());
+        if (!ok) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        objects_[hex] = content.size();
+    } else {
+        std::lock_guard<std::mutex> lock(mutex_);
+        saved_bytes_ += content.size();
+    }
+    return link_object(hex, target);
+}
+
+bool content_store::link_existing(const std::string& target, const std::string& digest) {
+    uint64_t size;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = objects_.find(digest);
+        if (it == objects_.end()) {
+            return false;
+        }
+        size = it->second;
+    }
+    if (!link_object(digest, target)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    dedup_hits_++;
+    saved_bytes_ += size;
+    return true;
+}
+
+bool content_store::link_object(const std::string& digest, const std::string& target) {
+    std::string object = object_path(digest);
+    fs::path target_path(target);
+    std::string temp = (target_path.parent_path() / (".dedup-" + std::to_string(temp_counter++) + "-" +
+                                                      target_path.filename().string())).string();
+
+    int in = open(object.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        if (errno == ENOENT) {
+            // 对象被手动删除
+            std::lock_guard<std::mutex> lock(mutex_);
+            objects_.erase(digest);
+        }
+        return false;
+    }
+    // 优先reflink：各路径的inode互相独立；文件系统不支持时退回硬链接
+    int out = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    bool linked = out >= 0 && ioctl(out, FICLONE, in) == 0;
+    if (out >= 0) {
+        close(out);
+    }
+    close(in);
+    if (!linked) {
+        unlink(temp.c_str());
+        linked = link(object.c_str(), temp.c_str()) == 0;
+    }
+    // 原子地替换目标，与原先直接覆盖写入的语义一致
+    if (!linked || rename(temp.c_str(), target.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (lstat(target.c_str(), &st) != 0) {
+        return true;
+    }
+    reference ref{digest, st.st_ino, mtime_ns(st)};
+    std::lock_guard<std::mutex> lock(mutex_);
+    references_[target] = ref;
+    journal_ << "l\t" << digest << "\t" << ref.ino << "\t" << ref.mtime_ns << "\t" << escape_path(target) << "\n";
+    journal_.flush();
+    if (++journal_lines_ > references_.size() * 2 + 1024) {
+        rewrite_index();
+    }
+    return true;
+}
+
+content_store_stats content_store::stats() const {
+    content_store_stats result{};
+    std::lock_guard<std::mutex> lock(mutex_);
+    result.objects = objects_.size();
+    for (const auto& object : objects_) {
+        result.bytes += object.second;
+    }
+    result.references = references_.size();
+    result.dedup_hits = dedup_hits_;
+    result.saved_bytes = saved_bytes_;
+    result.collected_objects = collected_objects_;
+    return result;
+}
+
+void content_store::load_index() {
+    std::ifstream in(index_path_);
+    std::string line;
+    while (std::getline(in, line)) {
+        // l <摘要> <inode> <mtime_ns> <路径>
+        size_t p1 = line.find('\t');
+        size_t p2 = p1 == std::string::npos ? p1 : line.find('\t', p1 + 1);
+        size_t p3 = p2 == std::string::npos ? p2 : line.find('\t', p2 + 1);
+        size_t p4 = p3 == std::string::npos ? p3 : line.find('\t', p3 + 1);
+        if (p4 == std::string::npos || line.compare(0, p1, "l") != 0) {
+            // 写到一半的最后一行
+            continue;
+        }
+        try {
+            reference ref{line.substr(p1 + 1, p2 - p1 - 1),
+                          static_cast<ino_t>(std::stoull(line.substr(p2 + 1, p3 - p2 - 1))),
+                          std::stoll(line.substr(p3 + 1, p4 - p3 - 1))};
+            references_[unescape_path(line.substr(p4 + 1))] = ref;
+        } catch (const std::exception&) {
+        }
+    }
+
+    // 对象以目录为准，索引只记录引用
+    std::error_code ec;
+    for (const auto& prefix : fs::directory_iterator(store_dir_ + "/objects", ec)) {
+        for (const auto& entry : fs::directory_iterator(prefix.path(), ec)) {
+            std::string digest = prefix.path().filename().string() + entry.path().filename().string();
+            struct stat st;
+            if (valid_digest(digest) && lstat(entry.path().c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                objects_[digest] = static_cast<uint64_t>(st.st_size);
+            }
+        }
+    }
+    // 上次退出时未写完的临时文件
+    for (const auto& entry : fs::directory_iterator(store_dir_ + "/tmp", ec)) {
+        fs::remove(entry.path(), ec);
+    }
+
+    rewrite_index();
+}
+
+void content_store::rewrite_index() {
+    // 写入临时文件后改名替换，中途崩溃也不会留下半个索引
+    journal_.close();
+    std::string temp = index_path_ + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        for (const auto& item : references_) {
+            out << "l\t" << item.second.digest << "\t" << item.second.ino << "\t" << item.second.mtime_ns << "\t"
+                << escape_path(item.first) << "\n";
+        }
+    }
+    std::rename(temp.c_str(), index_path_.c_str());
+    journal_.open(index_path_, std::ios::app);
+    journal_lines_ = references_.size();
+}
+
+void content_store::collect() {
+    std::map<std::string, reference> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshot = references_;
+    }
+    // 不持锁逐个stat：路径被删除、移动或覆盖后inode或mtime不再匹配
+    std::vector<std::string> stale;
+    for (const auto& item : snapshot) {
+        struct stat st;
+        if (lstat(item.first.c_str(), &st) != 0 || st.st_ino != item.second.ino || mtime_ns(st) != item.second.mtime_ns) {
+            stale.push_back(item.first);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& path : stale) {
+        auto it = references_.find(path);
+        // 核对期间同一路径可能又被链接了新内容
+        if (it != references_.end() && it->second.ino == snapshot[path].ino &&
+            it->second.mtime_ns == snapshot[path].mtime_ns) {
+            references_.erase(it);
+        }
+    }
+    std::set<std::string> used;
+    for (const auto& item : references_) {
+        used.insert(item.second.digest);
+    }
+    std::time_t now = std::time(nullptr);
+    for (auto it = objects_.begin(); it != objects_.end();) {
+        std::string object = object_path(it->first);
+        struct stat st;
+        if (used.count(it->first) || (lstat(object.c_str(), &st) == 0 && now - st.st_ctime < COLLECT_GRACE_SEC)) {
+            ++it;
+            continue;
+        }
+        unlink(object.c_str());
+        collected_objects_++;
+        it = objects_.erase(it);
+    }
+    rewrite_index();
+}
+
+void content_store::run() {
+    while (running_) {
+        collect();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!running_) {
+            break;
+        }
+        wake_.wait_for(lock, COLLECT_INTERVAL);
+    }
+}
+
+} // namespace to_https_server
@@ -0,0 +1,182 @@
+#include <to_https_server/server/directory_cache.h>
+#include <algorithm>
+#include <numeric>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace to_https_server {
+
+// 目录项的增删、重命名以及其中文件内容和属性的变化
+static const uint32_t WATCH_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |
+                                     IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+
+directory_listing::directory_listing(std::vector<file_info> entries) : entries_(std::move(entries)) {}
+
+bool directory_listing::before(const file_info& a, const file_info& b, listing_sort sort, bool descending) {
+    if (a.is_directory != b.is_directory) {
+        return a.is_directory;
+    }
+    int c = 0;
+    if (sort == listing_sort::size && a.size != b.size) {
+        c = a.size < b.size ? -1 : 1;
+    } else if (sort == listing_sort::mtime && a.last_modified != b.last_modified) {
+        c = a.last_modified < b.last_modified ? -1 : 1;
+    }
+    if (c == 0) {
+        c = a.name.compare(b.name);
+    }
+    return descending ? c > 0 : c < 0;
+}
+
+const std::vector<uint32_t>& directory_listing::order(listing_sort sort, bool descending) const {
+    size_t index = static_cast<size_t>(sort) * 2 + (descending ? 1 : 0);
+    std::call_once(sorted_[index], [&] {
+        std::vector<uint32_t>& order = orders_[index];
+        order.resize(entries_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return before(entries_[a], entries_[b], sort, descending);
+        });
+    });
+    return orders_[index];
+}
+
+directory_cache::directory_cache(size_t capacity)
+    : capacity_(capacity), inotify_fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+      hits_(0), misses_(0), invalidations_(0) {}
+
+directory_cache::~directory_cache() {
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+}
+
+std::shared_ptr<const directory_listing> directory_cache::get(const std::string& path, const file_manager& files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return nullptr;
+    }
+
+    uint64_t version = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity_ > 0) {
+            drain_events();
+            auto it = nodes_.find(path);
+            if (it == nodes_.end()) {
+                node n{};
+                n.watch = -1;
+                if (inotify_fd_ >= 0) {
+#ifdef IN_MASK_CREATE
+                    // 同一目录经不同路径（符号链接）访问时共用一个监视，淘汰其中一个会误删另一个的监视，
+                    // 因此已被监视的目录不再重复添加，只靠mtime检查
+                    n.watch = inotify_add_watch(inotify_fd_, path.c_str(), WATCH_EVENTS | IN_ONLYDIR | IN_MASK_CREATE);
+#else
+                    n.watch = inotify_add_watch(inotify_fd_, path.c_str(), WATCH_EVENTS | IN_ONLYDIR);
+#endif
+                }
+                if (n.watch >= 0) {
+                    watches_[n.watch] = path;
+                }
+                lru_.push_front(path);
+                n.lru = lru_.begin();
+                it = nodes_.emplace(path, std::move(n)).first;
+                evict(capacity_);
+            } else {
+                lru_.splice(lru_.begin(), lru_, it->second.lru);
+                const node& n = it->second;
+                if (n.listing && n.built_version == n.version && n.inode == st.st_ino &&
+                    n.mtime.tv_sec == st.st_mtim.tv_sec && n.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+                    hits_++;
+                    return n.listing;
+                }
+            }
+            version = it->second.version;
+        }
+    }
+
+    // 读取目录不持锁，大目录不会挡住其他目录的请求
+    misses_++;
+    auto listing = std::make_shared<const directory_listing>(files.list_directory(path));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = nodes_.find(path);
+    if (it != nodes_.end() && it->second.version == version) {
+        node& n = it->second;
+        n.listing = listing;
+        n.built_version = version;
+        n.mtime = st.st_mtim;
+        n.inode = st.st_ino;
+    }
+    return listing;
+}
+
+void directory_cache::set_capacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    evict(capacity_);
+}
+
+directory_cache_stats directory_cache::stats() const {
+    directory_cache_stats result;
+    result.hits = hits_.load();
+    result.misses = misses_.load();
+    result.invalidations = invalidations_.load();
+    std::lock_guard<std::mutex> lock(mutex_);
+    result.cached_directories = nodes_.size();
+    return result;
+}
+
+void directory_cache::drain_events() {
+    if (inotify_fd_ < 0) {
+        return;
+    }
+    alignas(inotify_event) char buffer[16 * 1024];
+    ssize_t n;
+    while ((n = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + n;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // 丢失了事件，无法判断哪些目录变了
+                for (auto& item : nodes_) {
+                    item.second.version++;
+                }
+                invalidations_ += nodes_.size();
+                continue;
+            }
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end()) {
+                continue;
+            }
+            auto it = nodes_.find(watch->second);
+            if (it != nodes_.end()) {
+                it->second.version++;
+                invalidations_++;
+                if (event->mask & IN_IGNORED) {
+                    // 目录被删除或所在文件系统卸载，监视已被内核移除
+                    it->second.watch = -1;
+                }
+            }
+            if (event->mask & IN_IGNORED) {
+                watches_.erase(watch);
+            }
+        }
+    }
+}
+
+void directory_cache::evict(size_t limit) {
+    while (nodes_.size() > limit) {
+        auto it = nodes_.find(lru_.back());
+        if (it->second.watch >= 0) {
+            inotify_rm_watch(inotify_fd_, it->second.watch);
+            watches_.erase(it->second.watch);
+        }
+        nodes_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+} // namespace to_https_server
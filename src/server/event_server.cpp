@@ -0,0 +1,396 @@
+#include <to_https_server/server/event_server.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace to_https_server {
+
+static const uint32_t CONNECTION_EVENTS = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+static const int MAX_EVENTS = 256;
+static const int SWEEP_INTERVAL_MS = 1000;
+// I/O线程缓冲请求头的上限，与httplib对请求行和头部字段的限制一致
+static const size_t MAX_HEADER_SIZE = CPPHTTPLIB_REQUEST_URI_MAX_LENGTH +
+                                      CPPHTTPLIB_HEADER_MAX_LENGTH * CPPHTTPLIB_HEADER_MAX_COUNT;
+static const size_t READ_CHUNK_SIZE = 4096;
+
+// 连接的流：I/O线程非阻塞读入的数据先放在缓冲中，工作线程读取时先取缓冲。
+// 读取全部经过这个缓冲(不用SocketStream自带的预读)，才能判断其中是否已有完整的请求头；
+// 写入与地址查询交给SocketStream
+class event_server::connection_stream final : public httplib::Stream {
+public:
+    connection_stream(int fd, time_t read_timeout_sec, time_t read_timeout_usec,
+                      time_t write_timeout_sec, time_t write_timeout_usec)
+        : inner_(fd, read_timeout_sec, read_timeout_usec, write_timeout_sec, write_timeout_usec),
+          fd_(fd), read_timeout_sec_(read_timeout_sec), read_timeout_usec_(read_timeout_usec), pos_(0),
+          scanned_(0) {}
+
+    bool is_readable() const override { return pos_ < input_.size(); }
+    bool wait_readable() const override {
+        return is_readable() || httplib::detail::select_read(fd_, read_timeout_sec_, read_timeout_usec_) > 0;
+    }
+    bool wait_writable() const override { return inner_.wait_writable(); }
+    void get_remote_ip_and_port(std::string& ip, int& port) const override { inner_.get_remote_ip_and_port(ip, port); }
+    void get_local_ip_and_port(std::string& ip, int& port) const override { inner_.get_local_ip_and_port(ip, port); }
+    socket_t socket() const override { return fd_; }
+    time_t duration() const override { return inner_.duration(); }
+    ssize_t write(const char* ptr, size_t size) override { return inner_.write(ptr, size); }
+
+    ssize_t read(char* ptr, size_t size) override {
+        if (pos_ >= input_.size()) {
+            if (!wait_readable()) {
+                return -1;
+            }
+            // 大块读取(请求体)直接读到调用方；逐字节读取的请求头先读入缓冲
+            if (size >= READ_CHUNK_SIZE) {
+                return httplib::detail::read_socket(fd_, ptr, size, CPPHTTPLIB_RECV_FLAGS);
+            }
+            compact();
+            input_.resize(READ_CHUNK_SIZE);
+            ssize_t n = httplib::detail::read_socket(fd_, &input_[0], READ_CHUNK_SIZE, CPPHTTPLIB_RECV_FLAGS);
+            input_.resize(n > 0 ? static_cast<size_t>(n) : 0);
+            if (n <= 0) {
+                return n;
+            }
+        }
+        size = std::min(size, input_.size() - pos_);
+        std::memcpy(ptr, input_.data() + pos_, size);
+        pos_ += size;
+        return static_cast<ssize_t>(size);
+    }
+
+    // I/O线程调用：非阻塞地读到没有数据或缓冲中已有完整的请求头为止。
+    // 连接已关闭、出错或请求头超长时返回false；已有完整请求头时即使对端已关闭写方向也返回true
+    bool fill() {
+        compact();
+        while (!has_request()) {
+            if (input_.size() - pos_ >= MAX_HEADER_SIZE) {
+                return false;
+            }
+            size_t size = input_.size();
+            input_.resize(size + READ_CHUNK_SIZE);
+            ssize_t n = recv(fd_, &input_[size], READ_CHUNK_SIZE, MSG_DONTWAIT);
+            input_.resize(size + (n > 0 ? static_cast<size_t>(n) : 0));
+            if (n == 0) {
+                return false;
+            }
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+        }
+        return true;
+    }
+
+    // 缓冲中已有一个完整的请求头
+    bool has_request() {
+        // 只扫描新增的部分，结束标记可能跨两次读入
+        size_t from = std::max(pos_, scanned_ >= 3 ? scanned_ - 3 : 0);
+        if (input_.find("\r\n\r\n", from) != std::string::npos) {
+            return true;
+        }
+        scanned_ = input_.size();
+        return false;
+    }
+
+private:
+    void compact() {
+        if (pos_ > 0) {
+            input_.erase(0, pos_);
+            scanned_ -= std::min(scanned_, pos_);
+            pos_ = 0;
+        }
+    }
+
+    httplib::detail::SocketStream inner_;
+    int fd_;
+    time_t read_timeout_sec_;
+    time_t read_timeout_usec_;
+    std::string input_;
+    size_t pos_;
+    size_t scanned_;
+};
+
+event_server::connection::~connection() {
+    // 先注销再关闭，shutdown_all不会作用到被复用的描述符上
+    if (tracker) {
+        tracker->remove(fd);
+    }
+    httplib::detail::shutdown_socket(fd);
+    httplib::detail::close_socket(fd);
+}
+
+event_server::event_server(size_t io_threads)
+    : io_thread_count_(io_threads == 0 ? 1 : io_threads), running_(false), draining_(false), connections_(nullptr) {}
+
+event_server::~event_server() {
+    stop();
+}
+
+bool event_server::run(const std::string& host, int port) {
+    if (running_ || (svr_sock_ == INVALID_SOCKET && !bind_to_port(host, port))) {
+        return false;
+    }
+
+    int flags = fcntl(svr_sock_, F_GETFL, 0);
+    fcntl(svr_sock_, F_SETFL, flags | O_NONBLOCK);
+
+    task_queue_.reset(new_task_queue());
+
+    for (size_t i = 0; i < io_thread_count_; ++i) {
+        auto loop = std::make_unique<io_loop>();
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->epoll_fd < 0 || loop->wake_fd < 0) {
+            return false;
+        }
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = loop->wake_fd;
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &ev);
+
+        // 每个I/O线程都监听同一个端口，EPOLLEXCLUSIVE避免惊群
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.fd = svr_sock_;
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, svr_sock_, &ev);
+
+        loops_.push_back(std::move(loop));
+    }
+
+    running_ = true;
+    for (size_t i = 1; i < loops_.size(); ++i) {
+        loops_[i]->thread = std::thread([this, i] { io_thread(*loops_[i]); });
+    }
+    io_thread(*loops_[0]);
+
+    for (size_t i = 1; i < loops_.size(); ++i) {
+        if (loops_[i]->thread.joinable()) {
+            loops_[i]->thread.join();
+        }
+    }
+
+    // 等待工作线程处理完手头的请求
+    task_queue_->shutdown();
+    task_queue_.reset();
+
+    for (auto& loop : loops_) {
+        loop->connections.clear();
+        close(loop->wake_fd);
+        close(loop->epoll_fd);
+    }
+    loops_.clear();
+
+    socket_t sock = svr_sock_.exchange(INVALID_SOCKET);
+    if (sock != INVALID_SOCKET) {
+        httplib::detail::close_socket(sock);
+    }
+    return true;
+}
+
+void event_server::adopt_socket(int sock) {
+    svr_sock_ = sock;
+}
+
+int event_server::listening_socket() const {
+    return svr_sock_;
+}
+
+void event_server::stop_accepting() {
+    // 已交给新进程的监听套接字不再参与epoll，描述符留到close_listener时随事件循环退出再关闭
+    draining_ = true;
+    socket_t sock = svr_sock_;
+    for (auto& loop : loops_) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, sock, nullptr);
+    }
+    wake_loops();
+}
+
+void event_server::close_listener() {
+    stop();
+}
+
+void event_server::track_connections(active_connections* connections) {
+    connections_ = connections;
+}
+
+void event_server::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake_loops();
+}
+
+void event_server::wake_loops() {
+    for (auto& loop : loops_) {
+        uint64_t one = 1;
+        ssize_t ret = write(loop->wake_fd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+void event_server::io_thread(io_loop& loop) {
+    epoll_event events[MAX_EVENTS];
+    auto last_sweep = std::chrono::steady_clock::now();
+
+    while (running_) {
+        int n = epoll_wait(loop.epoll_fd, events, MAX_EVENTS, SWEEP_INTERVAL_MS);
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            uint32_t flags = events[i].events;
+
+            if (fd == loop.wake_fd) {
+                uint64_t value;
+                ssize_t ret = read(loop.wake_fd, &value, sizeof(value));
+                (void)ret;
+                continue;
+            }
+            if (fd == svr_sock_) {
+                accept_connections(loop);
+                continue;
+            }
+
+            std::shared_ptr<connection> conn;
+            {
+                std::lock_guard<std::mutex> lock(loop.mutex);
+                auto it = loop.connections.find(fd);
+                if (it == loop.connections.end()) {
+                    continue;
+                }
+                conn = it->second;
+                conn->busy = true;
+            }
+
+            bool hang_up = (flags & (EPOLLERR | EPOLLHUP)) || ((flags & EPOLLRDHUP) && !(flags & EPOLLIN));
+            if (hang_up || !conn->stream->fill()) {
+                close_connection(loop, fd);
+                continue;
+            }
+            if (!conn->stream->has_request()) {
+                // 请求头还没收完，继续等待；期间不刷新last_active，超过keep-alive超时仍未收完的连接被清理
+                rearm_connection(loop, conn, false);
+                continue;
+            }
+
+            // 请求头已完整，交给工作线程；EPOLLONESHOT保证处理期间不会重复触发
+            if (!task_queue_->enqueue([this, &loop, conn] { process_connection(loop, conn); })) {
+                close_connection(loop, fd);
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (draining_ || now - last_sweep >= std::chrono::milliseconds(SWEEP_INTERVAL_MS)) {
+            close_idle_connections(loop);
+            last_sweep = now;
+        }
+    }
+}
+
+void event_server::accept_connections(io_loop& loop) {
+    // 停止accept前已取出的就绪事件也不再处理，留给接管的新进程
+    while (running_ && !draining_) {
+        int fd = accept4(svr_sock_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // EAGAIN: 已取完；EMFILE等错误留到下次就绪再试
+            return;
+        }
+
+        httplib::detail::set_socket_opt_time(fd, SOL_SOCKET, SO_RCVTIMEO, read_timeout_sec_, read_timeout_usec_);
+        httplib::detail::set_socket_opt_time(fd, SOL_SOCKET, SO_SNDTIMEO, write_timeout_sec_, write_timeout_usec_);
+
+        auto conn = std::make_shared<connection>();
+        conn->fd = fd;
+        conn->remote_port = 0;
+        conn->local_port = 0;
+        httplib::detail::get_remote_ip_and_port(fd, conn->remote_addr, conn->remote_port);
+        httplib::detail::get_local_ip_and_port(fd, conn->local_addr, conn->local_port);
+        conn->requests_left = keep_alive_max_count_;
+        conn->busy = false;
+        conn->last_active = std::chrono::steady_clock::now();
+        conn->stream = std::make_unique<connection_stream>(fd, read_timeout_sec_, read_timeout_usec_,
+                                                           write_timeout_sec_, write_timeout_usec_);
+        conn->tracker = connections_;
+        if (connections_) {
+            connections_->add(fd);
+        }
+
+        std::lock_guard<std::mutex> lock(loop.mutex);
+        loop.connections[fd] = conn;
+
+        epoll_event ev{};
+        ev.events = CONNECTION_EVENTS;
+        ev.data.fd = fd;
+        if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            loop.connections.erase(fd);
+        }
+    }
+}
+
+void event_server::process_connection(io_loop& loop, std::shared_ptr<connection> conn) {
+    bool close_after;
+    bool connection_closed = false;
+    bool ok;
+    // 已读入缓冲的完整流水线请求不会再触发边沿事件，必须在挂回epoll之前处理完；
+    // 只收到一部分的留给I/O线程继续读入
+    do {
+        // 排空时在当前响应中告知客户端关闭连接
+        close_after = conn->requests_left <= 1 || draining_;
+        ok = process_request(*conn->stream, conn->remote_addr, conn->remote_port,
+                             conn->local_addr, conn->local_port,
+                             close_after, connection_closed, nullptr);
+        connection_closed = take_close_after_response() || connection_closed;
+        conn->requests_left--;
+    } while (ok && !connection_closed && !close_after && running_ && conn->stream->has_request());
+
+    if (!ok || connection_closed || close_after || !running_ || draining_) {
+        close_connection(loop, conn->fd);
+        return;
+    }
+
+    // 重新挂回epoll，等待该连接的下一个请求
+    rearm_connection(loop, conn, true);
+}
+
+void event_server::rearm_connection(io_loop& loop, const std::shared_ptr<connection>& conn, bool served) {
+    std::lock_guard<std::mutex> lock(loop.mutex);
+    conn->busy = false;
+    if (served) {
+        conn->last_active = std::chrono::steady_clock::now();
+    }
+    // EPOLL_CTL_MOD会重新检查就绪状态，挂回之前已到达的数据同样触发事件
+    epoll_event ev{};
+    ev.events = CONNECTION_EVENTS;
+    ev.data.fd = conn->fd;
+    if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) {
+        loop.connections.erase(conn->fd);
+    }
+}
+
+void event_server::close_connection(io_loop& loop, int fd) {
+    std::lock_guard<std::mutex> lock(loop.mutex);
+    loop.connections.erase(fd);
+}
+
+void event_server::close_idle_connections(io_loop& loop) {
+    auto deadline = std::chrono::steady_clock::now() - std::chrono::seconds(keep_alive_timeout_sec_);
+    std::lock_guard<std::mutex> lock(loop.mutex);
+    for (auto it = loop.connections.begin(); it != loop.connections.end();) {
+        // 排空时空闲的keep-alive连接不必等超时
+        if (!it->second->busy && (draining_ || it->second->last_active < deadline)) {
+            it = loop.connections.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace to_https_server
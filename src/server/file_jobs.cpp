@@ -0,0 +1,325 @@
+#include <to_https_server/server/file_jobs.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace to_https_server {
+
+static const size_t MAX_FINISHED_JOBS = 100;
+// 每次copy_file_range最多复制的字节数，之间更新进度
+static const size_t COPY_CHUNK = 64 * 1024 * 1024;
+static const size_t FALLBACK_BUFFER = 1024 * 1024;
+
+const char* file_job_state_name(file_job_state state) {
+    switch (state) {
+        case file_job_state::queued: return "queued";
+        case file_job_state::running: return "running";
+        case file_job_state::done: return "done";
+        default: return "failed";
+    }
+}
+
+// 统计要复制的总字节数，只用于显示进度
+static uint64_t measure(const std::string& path) {
+    std::error_code ec;
+    auto status = fs::symlink_status(path, ec);
+    if (ec) {
+        return 0;
+    }
+    if (!fs::is_directory(status)) {
+        return fs::is_regular_file(status) ? fs::file_size(path, ec) : 0;
+    }
+    uint64_t total = 0;
+    for (auto it = fs::recursive_directory_iterator(path, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (!it->is_symlink(ec) && it->is_regular_file(ec)) {
+            total += it->file_size(ec);
+        }
+    }
+    return total;
+}
+
+file_jobs::file_jobs() : next_id_(1), running_(false) {}
+
+file_jobs::~file_jobs() {
+    stop();
+}
+
+void file_jobs::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void file_jobs::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_.exchange(false)) {
+            return;
+        }
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+uint64_t file_jobs::submit(const std::string& operation, const std::string& source, const std::string& destination,
+                           const std::string& source_url, const std::string& destination_url) {
+    auto j = std::make_shared<job>();
+    j->status = file_job_status{0, operation, source_url, destination_url, file_job_state::queued, 0, 0, 0, 0, ""};
+    j->source = source;
+    j->destination = destination;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    j->status.id = next_id_++;
+    jobs_[j->status.id] = j;
+    queue_.push_back(j);
+    wake_.notify_all();
+    return j->status.id;
+}
+
+bool file_jobs::status(uint64_t id, file_job_status& result) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) {
+        return false;
+    }
+    result = it->second->status;
+    return true;
+}
+
+std::vector<file_job_status> file_jobs::list() const {
+    std::vector<file_job_status> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : jobs_) {
+        result.push_back(item.second->status);
+    }
+    return result;
+}
+
+void file_jobs::run() {
+    while (true) {
+        std::shared_ptr<job> j;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+            if (!running_) {
+                return;
+            }
+            j = queue_.front();
+            queue_.pop_front();
+            j->status.state = file_job_state::running;
+        }
+
+        execute(*j);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_.push_back(j->status.id);
+        while (finished_.size() > MAX_FINISHED_JOBS) {
+            jobs_.erase(finished_.front());
+            finished_.pop_front();
+        }
+    }
+}
+
+void file_jobs::execute(job& j) {
+    std::string error;
+    struct stat st;
+    if (lstat(j.source.c_str(), &st) != 0) {
+        error = "Source not found";
+    } else if (access(j.destination.c_str(), F_OK) == 0) {
+        error = "Destination exists";
+    }
+
+    if (error.empty() && j.status.operation == "move" && rename(j.source.c_str(), j.destination.c_str()) == 0) {
+        // 提交后源或目标的位置可能已变为同一文件系统
+        std::lock_guard<std::mutex> lock(mutex_);
+        j.status.state = file_job_state::done;
+        return;
+    }
+
+    if (error.empty()) {
+        uint64_t total = measure(j.source);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            j.status.total_bytes = total;
+        }
+
+        // 临时名与目标在同一目录，最后的改名不会跨文件系统
+        fs::path target(j.destination);
+        std::string temp = (target.parent_path() / (".copy-" + std::to_string(j.status.id) + "-" +
+                                                     target.filename().string())).string();
+        std::error_code ec;
+        fs::create_directories(target.parent_path(), ec);
+        if (!copy_tree(j, j.source, temp)) {
+            error = "Copy failed: " + std::string(std::strerror(errno));
+            fs::remove_all(temp, ec);
+        } else if (renameat2(AT_FDCWD, temp.c_str(), AT_FDCWD, j.destination.c_str(), RENAME_NOREPLACE) != 0) {
+            // 复制期间目标被别人创建
+            error = errno == EEXIST ? "Destination exists" : "Rename failed: " + std::string(std::strerror(errno));
+            fs::remove_all(temp, ec);
+        } else if (j.status.operation == "move") {
+            fs::remove_all(j.source, ec);
+            if (ec) {
+                error = "Copied but failed to remove source: " + ec.message();
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    j.status.state = error.empty() ? file_job_state::done : file_job_state::failed;
+    j.status.error = error;
+}
+
+bool file_jobs::copy_tree(job& j, const std::string& source, const std::string& destination) {
+    struct stat st;
+    if (lstat(source.c_str(), &st) != 0) {
+        return false;
+    }
+    if (S_ISLNK(st.st_mode)) {
+        // 符号链接原样复制，不跟随
+        std::vector<char> link(static_cast<size_t>(st.st_size) + 1);
+        ssize_t n = readlink(source.c_str(), link.data(), link.size());
+        return n >= 0 && symlink(std::string(link.data(), static_cast<size_t>(n)).c_str(), destination.c_str()) == 0;
+    }
+    if (S_ISREG(st.st_mode)) {
+        return copy_file(j, source, destination, st.st_mode & 07777);
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        // 设备、管道等不复制
+        return true;
+    }
+
+    if (mkdir(destination.c_str(), 0700) != 0) {
+        return false;
+    }
+    DIR* dir = opendir(source.c_str());
+    if (!dir) {
+        return false;
+    }
+    std::vector<std::string> names;
+    while (dirent* entry = readdir(dir)) {
+        if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0) {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    for (const auto& name : names) {
+        if (!running_ || !copy_tree(j, source + "/" + name, destination + "/" + name)) {
+            return false;
+        }
+    }
+    // 目录内容复制完再设置权限与时间，避免只读目录无法写入、写入又改掉mtime
+    chmod(destination.c_str(), st.st_mode & 07777);
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    utimensat(AT_FDCWD, destination.c_str(), times, 0);
+    return true;
+}
+
+bool file_jobs::copy_file(job& j, const std::string& source, const std::string& destination, mode_t mode) {
+    int in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    int out = open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (out < 0) {
+        int saved = errno;
+        close(in);
+        errno = saved;
+        return false;
+    }
+
+    struct stat st;
+    bool ok = fstat(in, &st) == 0;
+    uint64_t size = ok ? static_cast<uint64_t>(st.st_size) : 0;
+    if (ok && ioctl(out, FICLONE, in) == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        j.status.cloned_files++;
+        j.status.done_bytes += size;
+    } else if (ok) {
+        // 不支持reflink：在内核中复制，跨文件系统或内核不支持时退回读写
+        loff_t in_offset = 0;
+        loff_t out_offset = 0;
+        bool fallback = false;
+        while (running_ && static_cast<uint64_t>(in_offset) < size) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(size - in_offset, COPY_CHUNK));
+            ssize_t n = copy_file_range(in, &in_offset, out, &out_offset, chunk, 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && in_offset == 0 &&
+                (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+                fallback = true;
+                break;
+            }
+            if (n <= 0) {
+                // 文件在复制中被截短时为0
+                ok = n == 0;
+                break;
+            }
+            update(j, static_cast<uint64_t>(n));
+        }
+        if (fallback) {
+            std::vector<char> buffer(FALLBACK_BUFFER);
+            off_t offset = 0;
+            while (running_ && ok) {
+                ssize_t n = pread(in, buffer.data(), buffer.size(), offset);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    ok = n == 0;
+                    break;
+                }
+                for (ssize_t written = 0; ok && written < n;) {
+                    ssize_t w = pwrite(out, buffer.data() + written, static_cast<size_t>(n - written), offset + written);
+                    if (w < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    ok = w > 0;
+                    written += w > 0 ? w : 0;
+                }
+                offset += n;
+                update(j, static_cast<uint64_t>(n));
+            }
+        }
+        ok = ok && running_;
+    }
+
+    if (ok) {
+        fchmod(out, mode);
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        futimens(out, times);
+        std::lock_guard<std::mutex> lock(mutex_);
+        j.status.files++;
+    }
+    int saved = errno;
+    close(in);
+    if (close(out) != 0) {
+        // 延迟分配的文件系统可能到close才报告空间不足
+        ok = false;
+        saved = errno;
+    }
+    errno = saved;
+    return ok;
+}
+
+void file_jobs::update(job& j, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    j.status.done_bytes += bytes;
+}
+
+} // namespace to_https_server
@@ -1,16 +1,25 @@
 #include <to_https_server/server/file_manager.h>
+#include <to_https_server/server/async_file_io.h>
 #include <to_https_server/utils/logger.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
 #include <fstream>
 #include <sstream>
 #include <chrono>
 #include <iomanip>
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <unordered_map>
 
 namespace to_https_server {
 
 file_manager::file_manager(const std::string& root_path, const std::string& trash_path)
-	: root_path_(root_path), trash_path_(trash_path) {
+	: root_path_(root_path), trash_path_(trash_path), store_min_size_(0) {
 	if(root_path_.find_last_of('/') == root_path_.size() - 1) {
 		root_path_ = root_path_.substr(0, root_path_.size() - 1);
 	}
@@ -22,6 +31,22 @@ file_manager::file_manager(const std::string& root_path, const std::string& tras
 	if (!fs::exists(trash_path_)) {
 		fs::create_directories(trash_path_);
 	}
+	
+	trash_ = std::make_unique<trash_manager>(trash_path_);
+}
+
+void file_manager::enable_content_store(const std::string& store_dir, size_t min_size) {
+	store_ = std::make_unique<content_store>(store_dir);
+	store_min_size_ = min_size;
+}
+
+bool file_manager::link_content(const std::string& path, const std::string& sha256) {
+	if (!store_) {
+		return false;
+	}
+	std::string target = get_safe_path(path);
+	fs::create_directories(fs::path(target).parent_path());
+	return store_->link_existing(target, sha256);
 }
 
 bool file_manager::file_exists(const std::string& path) const {
@@ -37,27 +62,37 @@ size_t file_manager::get_file_size(const std::string& path) const {
 }
 
 bool file_manager::read_file(const std::string& path, std::string& content) const {
-	std::ifstream file(get_safe_path(path), std::ios::binary);
-	if (!file) {
+	int fd = open_file(path);
+	if (fd < 0) {
 		return false;
 	}
 	
-	content.assign((std::istreambuf_iterator<char>(file)),
-				   std::istreambuf_iterator<char>());
-	return true;
+	struct stat st;
+	bool ok = fstat(fd, &st) == 0;
+	if (ok) {
+		content.resize(st.st_size);
+		ok = st.st_size == 0 || async_file_io::read(fd, 0, st.st_size, &content[0]);
+	}
+	close(fd);
+	return ok;
 }
 
 bool file_manager::read_file_range(const std::string& path, size_t start, size_t end,
 								 std::string& content) const {
-	std::ifstream file(get_safe_path(path), std::ios::binary);
-	if (!file) {
+	int fd = open_file(path);
+	if (fd < 0) {
 		return false;
 	}
 	
-	file.seekg(0, std::ios::end);
-	size_t file_size = file.tellg();
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	size_t file_size = st.st_size;
 	
 	if (start >= file_size) {
+		close(fd);
 		return false;
 	}
 	
@@ -66,75 +101,146 @@ bool file_manager::read_file_range(const std::string& path, size_t start, size_t
 	}
 	
 	if (start > end) {
+		close(fd);
 		return false;
 	}
 	
 	size_t range_size = end - start + 1;
 	content.resize(range_size);
 	
-	file.seekg(start);
-	file.read(&content[0], range_size);
-	
-	return true;
+	bool ok = async_file_io::read(fd, start, range_size, &content[0]);
+	close(fd);
+	return ok;
+}
+
+int file_manager::open_file(const std::string& path) const {
+	return open(get_safe_path(path).c_str(), O_RDONLY | O_CLOEXEC);
 }
 
-bool file_manager::write_file(const std::string& path, const std::string& content) {
-	fs::create_directories(fs::path(get_safe_path(path)).parent_path());
+bool file_manager::read_range(int fd, size_t offset, size_t length,
+							  const std::function<bool(const char*, size_t)>& consumer) const {
+	return async_file_io::read(fd, offset, length, consumer);
+}
+
+bool file_manager::write_file(const std::string& path, const std::string& content, const std::string& sha256) {
+	std::string target = get_safe_path(path);
+	fs::create_directories(fs::path(target).parent_path());
+	
+	if (store_ && content.size() >= store_min_size_ && store_->store(target, content, sha256)) {
+		return true;
+	}
+	
+	// 目标可能与存储中的对象共享inode(硬链接)，不能原地截断
+	struct stat st;
+	if (lstat(target.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1) {
+		unlink(target.c_str());
+	}
 	
-	std::ofstream file(get_safe_path(path), std::ios::binary);
-	if (!file) {
+	int fd = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
 		return false;
 	}
 	
-	file.write(content.data(), content.size());
-	return true;
+	bool ok = async_file_io::write(fd, 0, content.data(), content.size());
+	close(fd);
+	return ok;
 }
 
 bool file_manager::append_file(const std::string& path, const std::string& content) {
-	fs::create_directories(fs::path(get_safe_path(path)).parent_path());
+	std::string target = get_safe_path(path);
+	fs::create_directories(fs::path(target).parent_path());
+	
+	// 与存储中的对象共享inode时先复制出独立的文件再追加
+	struct stat st;
+	if (lstat(target.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1) {
+		std::string temp = target + ".append";
+		std::error_code ec;
+		if (!fs::copy_file(target, temp, fs::copy_options::overwrite_existing, ec) ||
+			rename(temp.c_str(), target.c_str()) != 0) {
+			fs::remove(temp, ec);
+			return false;
+		}
+	}
 	
-	std::ofstream file(get_safe_path(path), std::ios::binary | std::ios::app);
-	if (!file) {
+	int fd = open(target.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
 		return false;
 	}
 	
-	file.write(content.data(), content.size());
+	bool ok = fstat(fd, &st) == 0 && async_file_io::write(fd, st.st_size, content.data(), content.size());
+	close(fd);
+	return ok;
+}
+
+static const char* DIGEST_XATTR = "user.to_https_server.digest";
+
+bool file_manager::set_digests(const std::string& path, const file_digests& digests) {
+	std::string target = get_safe_path(path);
+	struct stat st;
+	if (stat(target.c_str(), &st) != 0) {
+		return false;
+	}
+	// <mtime_ns> <大小> <crc32c> <sha256>
+	char crc[9];
+	snprintf(crc, sizeof(crc), "%08x", digests.crc32c);
+	std::string value = std::to_string(static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec) +
+		" " + std::to_string(st.st_size) + " " + crc + " " + digests.sha256;
+	// 文件系统不支持用户扩展属性时只是不提供摘要
+	return setxattr(target.c_str(), DIGEST_XATTR, value.data(), value.size(), 0) == 0;
+}
+
+bool file_manager::get_digests(const std::string& path, file_digests& digests) const {
+	std::string target = get_safe_path(path);
+	char value[160];
+	ssize_t length = getxattr(target.c_str(), DIGEST_XATTR, value, sizeof(value) - 1);
+	struct stat st;
+	if (length <= 0 || stat(target.c_str(), &st) != 0) {
+		return false;
+	}
+	value[length] = '\0';
+	long long mtime_ns = 0;
+	long long size = 0;
+	unsigned int crc = 0;
+	char sha256[65];
+	if (sscanf(value, "%lld %lld %8x %64s", &mtime_ns, &size, &crc, sha256) != 4 || strlen(sha256) != 64 ||
+		mtime_ns != static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec || size != st.st_size) {
+		return false;
+	}
+	digests.crc32c = crc;
+	digests.sha256 = sha256;
 	return true;
 }
 
 bool file_manager::delete_file(const std::string& path) {
 	std::string safe_path = get_safe_path(path);
-	if (!fs::exists(safe_path)) {
+	// 不允许删除根目录本身
+	if (safe_path == root_path_ || !fs::exists(fs::symlink_status(safe_path))) {
 		return false;
 	}
 	
-	std::string trash_filename = generate_trash_filename(fs::path(safe_path).filename().string());
-	std::string trash_path = trash_path_ + "/" + trash_filename;
-	
-	try {
-		fs::rename(safe_path, trash_path);
-		return true;
-	} catch (const fs::filesystem_error& e) {
-		return false;
-	}
+	return trash_->move_to_trash(safe_path, safe_path.substr(root_path_.size()));
+}
+
+restore_result file_manager::restore_file(const std::string& trash_id) {
+	return trash_->restore(trash_id, [this](const std::string& original_path) {
+		return get_safe_path(original_path);
+	});
 }
 
 bool file_manager::move_file(const std::string& src, const std::string& dest) {
 	std::string safe_src = get_safe_path(src);
 	std::string safe_dest = get_safe_path(dest);
 	
-	if (!fs::exists(safe_src)) {
+	if (safe_src == root_path_ || safe_dest == root_path_ || !fs::exists(fs::symlink_status(safe_src))) {
+		errno = ENOENT;
 		return false;
 	}
 	
-	fs::create_directories(fs::path(safe_dest).parent_path());
+	std::error_code ec;
+	fs::create_directories(fs::path(safe_dest).parent_path(), ec);
 	
-	try {
-		fs::rename(safe_src, safe_dest);
-		return true;
-	} catch (const fs::filesystem_error& e) {
-		return false;
-	}
+	// 不覆盖已存在的目标；跨文件系统时失败且errno为EXDEV，由调用方改为复制后删除
+	return renameat2(AT_FDCWD, safe_src.c_str(), AT_FDCWD, safe_dest.c_str(), RENAME_NOREPLACE) == 0;
 }
 
 bool file_manager::create_directory(const std::string& path) {
@@ -149,28 +255,33 @@ std::vector<file_info> file_manager::list_directory(const std::string& path) con
 		return files;
 	}
 	
-	for (const auto& entry : fs::directory_iterator(safe_path)) {
-		file_info info;
-		info.name = entry.path().filename().string();
-		info.is_directory = entry.is_directory();
-		
-		if (entry.is_regular_file()) {
-			info.size = entry.file_size();
-		} else {
-			info.size = 0;
+	DIR* dir = opendir(safe_path.c_str());
+	if (!dir) {
+		return files;
+	}
+	
+	// 相对目录fd做fstatat，每项只需一次系统调用，不再逐项拼接完整路径
+	int dir_fd = dirfd(dir);
+	while (dirent* entry = readdir(dir)) {
+		if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0 ||
+			trash_manager::is_staging_name(entry->d_name)) {
+			continue;
 		}
 		
-		auto last_write = entry.last_write_time();
-		auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-			last_write - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
-		
-		std::time_t time = std::chrono::system_clock::to_time_t(sctp);
-		std::stringstream ss;
-		ss << std::put_time(std::localtime(&time), "%Y-%m-%d %H:%M:%S");
-		info.last_modified = ss.str();
+		struct stat st;
+		if (fstatat(dir_fd, entry->d_name, &st, 0) != 0) {
+			// 悬空的符号链接或刚被删除的项
+			continue;
+		}
 		
-		files.push_back(info);
+		file_info info;
+		info.name = entry->d_name;
+		info.is_directory = S_ISDIR(st.st_mode);
+		info.size = S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) : 0;
+		info.last_modified = st.st_mtime;
+		files.push_back(std::move(info));
 	}
+	closedir(dir);
 	
 	return files;
 }
@@ -378,15 +489,4 @@ std::string file_manager::get_safe_path(const std::string& path) const {
     return result;
 }
 
-std::string file_manager::generate_trash_filename(const std::string& original_name) const {
-	auto now = std::chrono::system_clock::now();
-	auto time_t = std::chrono::system_clock::to_time_t(now);
-	
-	std::stringstream ss;
-	ss << std::put_time(std::localtime(&time_t), "%Y%m%d_%H%M%S_");
-	ss << original_name;
-	
-	return ss.str();
-}
-
 } // namespace to_https_server
@@ -1,43 +1,211 @@
 #include <to_https_server/server/gzip_compressor.h>
 #include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
 
 namespace to_https_server {
 
-gzip_compressor::gzip_compressor() = default;
-gzip_compressor::~gzip_compressor() = default;
+gzip_compressor::gzip_compressor(size_t threads, size_t parallel_min_size)
+    : threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      parallel_min_size_(parallel_min_size), stopping_(false), cpu_percent_(0), cpu_sampled_ms_(0),
+      last_cpu_total_(0), last_cpu_idle_(0) {}
 
-bool gzip_compressor::compress(const std::string& input, std::string& output) {
+gzip_compressor::~gzip_compressor() {
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        stopping_ = true;
+    }
+    jobs_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void gzip_compressor::start_workers() {
+    for (size_t i = 1; i < threads_; ++i) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+void gzip_compressor::worker_loop() {
+    std::unique_lock<std::mutex> lock(jobs_mutex_);
+    while (true) {
+        jobs_cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return;
+        }
+        std::shared_ptr<parallel_job> job = std::move(jobs_.front());
+        jobs_.pop_front();
+        // 在锁内登记，调用方撤回未开始的协助后只需等待已登记的
+        job->running++;
+        lock.unlock();
+        job->work();
+        lock.lock();
+        if (--job->running == 0) {
+            job_done_cv_.notify_all();
+        }
+    }
+}
+
+namespace {
+
+// 每个线程缓存一份z_stream，用deflateReset复用，省去每次deflateInit2分配、deflateEnd释放约256KB的状态
+struct deflate_context {
     z_stream zs;
-    memset(&zs, 0, sizeof(zs));
-    
-    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 
-                     GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
-        return false;
+    bool ready = false;
+    int level = 0;
+
+    ~deflate_context() {
+        if (ready) {
+            deflateEnd(&zs);
+        }
     }
-    
-    zs.next_in = (Bytef*)input.data();
-    zs.avail_in = input.size();
-    
-    int ret;
-    char outbuffer[32768];
-    
-    do {
-        zs.next_out = reinterpret_cast<Bytef*>(outbuffer);
-        zs.avail_out = sizeof(outbuffer);
-        
-        ret = deflate(&zs, Z_FINISH);
-        
-        if (zs.total_out > output.size()) {
-            output.append(outbuffer, zs.total_out - output.size());
+};
+
+} // namespace
+
+// window_bits为负时是原始deflate流(并行压缩的各块)，否则带gzip头尾，两者各用一份
+static z_stream* thread_stream(int window_bits, int level) {
+    thread_local deflate_context gzip_context;
+    thread_local deflate_context raw_context;
+    deflate_context& ctx = window_bits < 0 ? raw_context : gzip_context;
+    if (ctx.ready) {
+        deflateReset(&ctx.zs);
+        if (ctx.level != level && deflateParams(&ctx.zs, level, Z_DEFAULT_STRATEGY) == Z_OK) {
+            ctx.level = level;
         }
-    } while (ret == Z_OK);
-    
-    deflateEnd(&zs);
-    
+        return &ctx.zs;
+    }
+    memset(&ctx.zs, 0, sizeof(ctx.zs));
+    if (deflateInit2(&ctx.zs, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nullptr;
+    }
+    ctx.ready = true;
+    ctx.level = level;
+    return &ctx.zs;
+}
+
+bool gzip_compressor::compress(const std::string& input, std::string& output, int level) {
+    if (threads_ > 1 && input.size() >= std::max(parallel_min_size_, 2 * PARALLEL_BLOCK_SIZE)) {
+        return compress_parallel(input, output, level);
+    }
+
+    z_stream* zs = thread_stream(GZIP_WINDOW_BITS, level);
+    if (!zs) {
+        return false;
+    }
+    // deflateBound是一次Z_FINISH能产生的最大长度(含gzip头尾)，一次分配后直接压缩到输出中
+    output.resize(deflateBound(zs, static_cast<uLong>(input.size())));
+    zs->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zs->avail_in = static_cast<uInt>(input.size());
+    zs->next_out = reinterpret_cast<Bytef*>(&output[0]);
+    zs->avail_out = static_cast<uInt>(output.size());
+
+    int ret = deflate(zs, Z_FINISH);
+    output.resize(output.size() - zs->avail_out);
     return ret == Z_STREAM_END;
 }
 
+static void put_le32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+bool gzip_compressor::compress_parallel(const std::string& input, std::string& output, int level) {
+    const Bytef* base = reinterpret_cast<const Bytef*>(input.data());
+    size_t blocks = (input.size() + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;
+    std::vector<std::string> parts(blocks);
+    std::vector<uLong> crcs(blocks);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+
+    auto worker = [&] {
+        // 原始deflate流，gzip头尾在合并时统一写
+        z_stream* stream = thread_stream(-MAX_WBITS, level);
+        if (!stream) {
+            failed = true;
+            return;
+        }
+        z_stream& zs = *stream;
+        for (size_t i = next++; i < blocks && !failed; i = next++) {
+            size_t start = i * PARALLEL_BLOCK_SIZE;
+            size_t length = std::min(PARALLEL_BLOCK_SIZE, input.size() - start);
+            bool last = i + 1 == blocks;
+            deflateReset(&zs);
+            if (start > 0) {
+                size_t dictionary = std::min(DICTIONARY_SIZE, start);
+                deflateSetDictionary(&zs, base + start - dictionary, static_cast<uInt>(dictionary));
+            }
+
+            // 同步刷新额外产生一个空的stored块，在deflateBound之外留出余量
+            std::string& part = parts[i];
+            part.resize(deflateBound(&zs, static_cast<uLong>(length)) + 16);
+            zs.next_in = const_cast<Bytef*>(base + start);
+            zs.avail_in = static_cast<uInt>(length);
+            zs.next_out = reinterpret_cast<Bytef*>(&part[0]);
+            zs.avail_out = static_cast<uInt>(part.size());
+            int ret = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+            if ((last ? ret != Z_STREAM_END : ret != Z_OK) || zs.avail_in != 0 || zs.avail_out == 0) {
+                failed = true;
+            }
+            part.resize(part.size() - zs.avail_out);
+            crcs[i] = crc32(0L, base + start, static_cast<uInt>(length));
+        }
+    };
+
+    // 常驻线程忙于其他响应时，调用线程独自处理全部块，不会等待
+    std::call_once(workers_started_, [this] { start_workers(); });
+    auto job = std::make_shared<parallel_job>();
+    job->work = worker;
+    size_t helpers = std::min(threads_, blocks) - 1;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        jobs_.insert(jobs_.end(), helpers, job);
+    }
+    for (size_t i = 0; i < helpers; ++i) {
+        jobs_cv_.notify_one();
+    }
+    worker();
+    {
+        // 块已全部分完：撤回还没被取走的协助，再等已开始的线程写完手上的块
+        std::unique_lock<std::mutex> lock(jobs_mutex_);
+        jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), job), jobs_.end());
+        job_done_cv_.wait(lock, [&job] { return job->running == 0; });
+    }
+    if (failed) {
+        return false;
+    }
+
+    size_t total = 18;
+    for (const auto& part : parts) {
+        total += part.size();
+    }
+    output.clear();
+    output.reserve(total);
+    // gzip头：无文件名与时间戳，XFL按级别标注，OS字段为Unix
+    char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3};
+    header[8] = level == BEST_LEVEL ? 2 : (level == 1 ? 4 : 0);
+    output.append(header, sizeof(header));
+    uLong crc = crcs[0];
+    for (size_t i = 0; i < blocks; ++i) {
+        output += parts[i];
+        if (i > 0) {
+            size_t length = std::min(PARALLEL_BLOCK_SIZE, input.size() - i * PARALLEL_BLOCK_SIZE);
+            crc = crc32_combine(crc, crcs[i], static_cast<z_off_t>(length));
+        }
+    }
+    put_le32(output, static_cast<uint32_t>(crc));
+    put_le32(output, static_cast<uint32_t>(input.size()));
+    return true;
+}
+
 bool gzip_compressor::decompress(const std::string& input, std::string& output) {
     z_stream zs;
     memset(&zs, 0, sizeof(zs));
@@ -69,6 +237,66 @@ bool gzip_compressor::decompress(const std::string& input, std::string& output)
     return ret == Z_STREAM_END;
 }
 
+void gzip_compressor::sample_cpu() {
+    // 两次采样间隔太短时差值没有意义，最多每250ms读一次
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (now - cpu_sampled_ms_.load() < 250) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(cpu_mutex_, std::try_to_lock);
+    if (!lock.owns_lock() || now - cpu_sampled_ms_.load() < 250) {
+        return;
+    }
+    cpu_sampled_ms_ = now;
+
+    // cpu  user nice system idle iowait irq softirq steal
+    std::ifstream in("/proc/stat");
+    std::string line;
+    if (!std::getline(in, line) || line.compare(0, 4, "cpu ") != 0) {
+        return;
+    }
+    std::istringstream fields(line.substr(4));
+    uint64_t value, total = 0, idle = 0;
+    for (int i = 0; i < 8 && fields >> value; ++i) {
+        total += value;
+        if (i == 3 || i == 4) {
+            idle += value;
+        }
+    }
+    if (last_cpu_total_ != 0 && total > last_cpu_total_) {
+        uint64_t busy = (total - last_cpu_total_) - std::min(total - last_cpu_total_, idle - last_cpu_idle_);
+        cpu_percent_ = static_cast<int>(busy * 100 / (total - last_cpu_total_));
+    }
+    last_cpu_total_ = total;
+    last_cpu_idle_ = idle;
+}
+
+int gzip_compressor::choose_level(size_t size, size_t queued_tasks, size_t pool_threads) {
+    // 太小的响应压缩后省不了几个字节，gzip头尾反而占比可观
+    if (size < 256) {
+        return 0;
+    }
+    sample_cpu();
+    int cpu = cpu_percent_.load();
+    double backlog = static_cast<double>(queued_tasks) / std::max<size_t>(pool_threads, 1);
+
+    if (cpu >= 95 || backlog >= 2) {
+        return 0;
+    }
+    if (cpu >= 80 || backlog >= 1) {
+        return 1;
+    }
+    if (cpu >= 50 || queued_tasks > 0) {
+        return 4;
+    }
+    // 空闲时压得更狠；大响应的9级耗时增长远快于收益，仍用默认级别
+    if (cpu < 25 && size <= 256 * 1024) {
+        return BEST_LEVEL;
+    }
+    return DEFAULT_LEVEL;
+}
+
 bool gzip_compressor::is_gzip_supported(const std::string& accept_encoding) const {
     return accept_encoding.find("gzip") != std::string::npos ||
            accept_encoding.find("deflate") != std::string::npos;
@@ -0,0 +1,439 @@
+#include <to_https_server/server/hpack.h>
+
+namespace to_https_server {
+
+struct static_entry {
+    const char* name;
+    const char* value;
+};
+
+// RFC 7541 附录A
+static const static_entry STATIC_TABLE[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+static const size_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+struct huffman_code {
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541 附录B，下标为符号，256为EOS
+static const huffman_code HUFFMAN_CODES[] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+static const size_t ENTRY_OVERHEAD = 32;
+
+// Huffman解码树，叶子节点保存符号
+struct huffman_tree {
+    struct node {
+        int16_t children[2] = {-1, -1};
+        int16_t symbol = -1;
+    };
+    std::vector<node> nodes;
+
+    huffman_tree() : nodes(1) {
+        for (int symbol = 0; symbol < 257; ++symbol) {
+            const auto& code = HUFFMAN_CODES[symbol];
+            size_t current = 0;
+            for (int bit = code.bits - 1; bit >= 0; --bit) {
+                int b = (code.code >> bit) & 1;
+                if (nodes[current].children[b] < 0) {
+                    nodes[current].children[b] = static_cast<int16_t>(nodes.size());
+                    nodes.emplace_back();
+                }
+                current = nodes[current].children[b];
+            }
+            nodes[current].symbol = static_cast<int16_t>(symbol);
+        }
+    }
+};
+
+static const huffman_tree& decode_tree() {
+    static const huffman_tree tree;
+    return tree;
+}
+
+static bool huffman_decode(const uint8_t* data, size_t size, std::string& out) {
+    const auto& nodes = decode_tree().nodes;
+    size_t current = 0;
+    // 自上一个完整符号以来读取的位数及是否全为1，用于校验末尾填充
+    int pending_bits = 0;
+    bool pending_ones = true;
+    for (size_t i = 0; i < size; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            int b = (data[i] >> bit) & 1;
+            int16_t next = nodes[current].children[b];
+            if (next < 0) {
+                return false;
+            }
+            current = static_cast<size_t>(next);
+            pending_bits++;
+            pending_ones = pending_ones && b == 1;
+            if (nodes[current].symbol >= 0) {
+                if (nodes[current].symbol == 256) {
+                    return false;
+                }
+                out.push_back(static_cast<char>(nodes[current].symbol));
+                current = 0;
+                pending_bits = 0;
+                pending_ones = true;
+            }
+        }
+    }
+    // 填充最多7位且必须是EOS的前缀（全1）
+    return pending_bits <= 7 && pending_ones;
+}
+
+static size_t huffman_length(const std::string& s) {
+    size_t bits = 0;
+    for (unsigned char c : s) {
+        bits += HUFFMAN_CODES[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+static void huffman_encode(const std::string& s, std::string& out) {
+    uint64_t buffer = 0;
+    int buffered = 0;
+    for (unsigned char c : s) {
+        const auto& code = HUFFMAN_CODES[c];
+        buffer = (buffer << code.bits) | code.code;
+        buffered += code.bits;
+        while (buffered >= 8) {
+            buffered -= 8;
+            out.push_back(static_cast<char>(buffer >> buffered));
+        }
+    }
+    if (buffered > 0) {
+        out.push_back(static_cast<char>((buffer << (8 - buffered)) | (0xff >> buffered)));
+    }
+}
+
+static bool decode_integer(const uint8_t*& p, const uint8_t* end, int prefix_bits, uint64_t& value) {
+    if (p >= end) {
+        return false;
+    }
+    uint64_t max_prefix = (1u << prefix_bits) - 1;
+    value = *p++ & max_prefix;
+    if (value < max_prefix) {
+        return true;
+    }
+    for (int shift = 0; p < end && shift <= 28; shift += 7) {
+        uint8_t b = *p++;
+        value += static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void encode_integer(uint64_t value, int prefix_bits, uint8_t flags, std::string& out) {
+    uint64_t max_prefix = (1u << prefix_bits) - 1;
+    if (value < max_prefix) {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out.push_back(static_cast<char>(flags | max_prefix));
+    value -= max_prefix;
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool decode_string(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    if (p >= end) {
+        return false;
+    }
+    bool huffman = (*p & 0x80) != 0;
+    uint64_t length;
+    if (!decode_integer(p, end, 7, length) || length > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    out.clear();
+    if (huffman) {
+        if (!huffman_decode(p, length, out)) {
+            return false;
+        }
+    } else {
+        out.assign(reinterpret_cast<const char*>(p), length);
+    }
+    p += length;
+    return true;
+}
+
+static void encode_string(const std::string& s, std::string& out) {
+    size_t compressed = huffman_length(s);
+    if (compressed < s.size()) {
+        encode_integer(compressed, 7, 0x80, out);
+        huffman_encode(s, out);
+    } else {
+        encode_integer(s.size(), 7, 0, out);
+        out.append(s);
+    }
+}
+
+hpack_decoder::hpack_decoder(size_t max_table_size)
+    : table_size_(0), max_table_size_(max_table_size), table_size_limit_(max_table_size) {}
+
+bool hpack_decoder::lookup(size_t index, std::string& name, std::string& value) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= STATIC_TABLE_SIZE) {
+        name = STATIC_TABLE[index - 1].name;
+        value = STATIC_TABLE[index - 1].value;
+        return true;
+    }
+    index -= STATIC_TABLE_SIZE + 1;
+    if (index >= dynamic_table_.size()) {
+        return false;
+    }
+    name = dynamic_table_[index].first;
+    value = dynamic_table_[index].second;
+    return true;
+}
+
+void hpack_decoder::evict(size_t limit) {
+    while (table_size_ > limit && !dynamic_table_.empty()) {
+        const auto& entry = dynamic_table_.back();
+        table_size_ -= entry.first.size() + entry.second.size() + ENTRY_OVERHEAD;
+        dynamic_table_.pop_back();
+    }
+}
+
+void hpack_decoder::insert(const std::string& name, const std::string& value) {
+    size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+    // 比整张表还大的条目会清空动态表且自身不被加入
+    evict(size > max_table_size_ ? 0 : max_table_size_ - size);
+    if (size <= max_table_size_) {
+        dynamic_table_.emplace_front(name, value);
+        table_size_ += size;
+    }
+}
+
+hpack_result hpack_decoder::decode(const uint8_t* data, size_t size, header_list& headers, size_t max_list_size) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    bool header_seen = false;
+    std::string name;
+    std::string value;
+    // 防止少量索引引用展开成巨大的头部列表
+    size_t list_size = 0;
+    auto emit = [&] {
+        list_size += name.size() + value.size() + 32;
+        if (list_size > max_list_size) {
+            return false;
+        }
+        headers.emplace_back(name, value);
+        header_seen = true;
+        return true;
+    };
+
+    while (p < end) {
+        uint8_t b = *p;
+        uint64_t index;
+
+        if (b & 0x80) {
+            // 索引头部字段
+            if (!decode_integer(p, end, 7, index) || !lookup(index, name, value)) {
+                return hpack_result::malformed;
+            }
+            if (!emit()) {
+                return hpack_result::too_large;
+            }
+        } else if ((b & 0xe0) == 0x20) {
+            // 动态表大小更新，只能出现在头部块开头
+            if (header_seen || !decode_integer(p, end, 5, index) || index > table_size_limit_) {
+                return hpack_result::malformed;
+            }
+            max_table_size_ = index;
+            evict(max_table_size_);
+        } else {
+            // 字面量：01为加入动态表，0000为不索引，0001为永不索引
+            bool indexing = (b & 0xc0) == 0x40;
+            if (!decode_integer(p, end, indexing ? 6 : 4, index)) {
+                return hpack_result::malformed;
+            }
+            if (index == 0) {
+                if (!decode_string(p, end, name)) {
+                    return hpack_result::malformed;
+                }
+            } else if (!lookup(index, name, value)) {
+                return hpack_result::malformed;
+            }
+            if (!decode_string(p, end, value)) {
+                return hpack_result::malformed;
+            }
+            if (indexing) {
+                insert(name, value);
+            }
+            if (!emit()) {
+                return hpack_result::too_large;
+            }
+        }
+    }
+    return hpack_result::ok;
+}
+
+void hpack_encoder::encode_status(int status, std::string& out) {
+    switch (status) {
+    case 200: out.push_back(static_cast<char>(0x80 | 8)); return;
+    case 204: out.push_back(static_cast<char>(0x80 | 9)); return;
+    case 206: out.push_back(static_cast<char>(0x80 | 10)); return;
+    case 304: out.push_back(static_cast<char>(0x80 | 11)); return;
+    case 400: out.push_back(static_cast<char>(0x80 | 12)); return;
+    case 404: out.push_back(static_cast<char>(0x80 | 13)); return;
+    case 500: out.push_back(static_cast<char>(0x80 | 14)); return;
+    default:
+        // 不索引的字面量，名字取静态表中的 :status
+        encode_integer(8, 4, 0, out);
+        encode_string(std::to_string(status), out);
+        return;
+    }
+}
+
+void hpack_encoder::encode(const std::string& name, const std::string& value, std::string& out) {
+    size_t name_index = 0;
+    for (size_t i = 0; i < STATIC_TABLE_SIZE; ++i) {
+        if (name == STATIC_TABLE[i].name) {
+            name_index = i + 1;
+            break;
+        }
+    }
+    encode_integer(name_index, 4, 0, out);
+    if (name_index == 0) {
+        encode_string(name, out);
+    }
+    encode_string(value, out);
+}
+
+} // namespace to_https_server
@@ -0,0 +1,1039 @@
+#include <to_https_server/server/http2_session.h>
+#include <to_https_server/server/bandwidth_limiter.h>
+#include <to_https_server/server/thread_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace to_https_server {
+
+const char http2_session::PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+enum frame_type : uint8_t {
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9
+};
+
+enum frame_flag : uint8_t {
+    FLAG_END_STREAM = 0x1,
+    FLAG_ACK = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20
+};
+
+enum settings_id : uint16_t {
+    SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    SETTINGS_ENABLE_PUSH = 0x2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    SETTINGS_MAX_FRAME_SIZE = 0x5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+enum error_code : uint32_t {
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    INTERNAL_ERROR = 0x2,
+    FLOW_CONTROL_ERROR = 0x3,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    CANCEL = 0x8,
+    COMPRESSION_ERROR = 0x9,
+    ENHANCE_YOUR_CALM = 0xb
+};
+
+static const size_t FRAME_HEADER_SIZE = 9;
+static const size_t DEFAULT_MAX_FRAME_SIZE = 16384;
+static const int64_t DEFAULT_WINDOW_SIZE = 65535;
+static const int64_t MAX_WINDOW_SIZE = 0x7fffffff;
+static const uint32_t CONNECTION_WINDOW_SIZE = 16 * 1024 * 1024;
+// 每次向content provider索取的上限，流窗口更小时按窗口(至少一帧)
+static const int64_t FILL_BUDGET = 256 * 1024;
+// 交给线程池的请求超过该时间仍未开始执行时，由连接线程自己执行
+static const auto HANDLER_CLAIM_DELAY = std::chrono::milliseconds(50);
+
+struct http2_session::stream_state {
+    uint32_t id;
+    std::string header_block;
+    bool end_stream_on_headers = false;
+    bool request_complete = false;
+
+    httplib::Request req;
+    httplib::Response res;
+
+    // 响应体：buffer中为待发送数据；content provider按[offset, end)分块填充
+    int64_t send_window = 0;
+    bool responding = false;
+    std::string buffer;
+    size_t buffer_pos = 0;
+    bool provider = false;
+    bool chunked = false;
+    bool provider_done = false;
+    size_t offset = 0;
+    size_t end = 0;
+    // content provider因限速推迟时，到此时间之前不再调用
+    std::chrono::steady_clock::time_point retry_at;
+
+    // 请求处理由工作线程或连接线程中先取到者执行
+    std::atomic<bool> handler_claimed{false};
+    std::chrono::steady_clock::time_point dispatched_at;
+
+    // 缓冲已发完、content provider还在限速等待中
+    bool deferred(std::chrono::steady_clock::time_point now) const {
+        return buffer_pos >= buffer.size() && provider && !provider_done && retry_at > now;
+    }
+};
+
+// 处理线程把完成的流放入队列，并通过eventfd唤醒等待中的连接线程
+struct http2_session::completion_queue {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<stream_state>> done;
+    int wake_fd;
+
+    completion_queue() : wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    ~completion_queue() {
+        if (wake_fd >= 0) {
+            close(wake_fd);
+        }
+    }
+
+    void push(std::shared_ptr<stream_state> s) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.push_back(std::move(s));
+        }
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+};
+
+static uint32_t read_u32(const char* p) {
+    auto* u = reinterpret_cast<const unsigned char*>(p);
+    return (static_cast<uint32_t>(u[0]) << 24) | (static_cast<uint32_t>(u[1]) << 16) |
+           (static_cast<uint32_t>(u[2]) << 8) | static_cast<uint32_t>(u[3]);
+}
+
+static void append_u32(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+// 去掉PADDED标志带来的填充，格式错误返回false
+static bool strip_padding(uint8_t flags, std::string& payload) {
+    if (!(flags & FLAG_PADDED)) {
+        return true;
+    }
+    if (payload.empty()) {
+        return false;
+    }
+    size_t pad = static_cast<unsigned char>(payload[0]);
+    if (pad >= payload.size()) {
+        return false;
+    }
+    payload = payload.substr(1, payload.size() - 1 - pad);
+    return true;
+}
+
+http2_session::http2_session(httplib::Stream& strm, handler h, const http2_options& options)
+    : strm_(strm), handler_(std::move(h)), options_(options), remote_port_(0), local_port_(0), ssl_(nullptr),
+      completions_(std::make_shared<completion_queue>()), last_stream_id_(0), continuation_stream_(0), next_send_stream_(0),
+      connection_send_window_(DEFAULT_WINDOW_SIZE), peer_initial_window_(DEFAULT_WINDOW_SIZE),
+      peer_max_frame_size_(DEFAULT_MAX_FRAME_SIZE), goaway_received_(false), closed_(false) {}
+
+http2_session::~http2_session() = default;
+
+void http2_session::set_remote(const std::string& addr, int port) {
+    remote_addr_ = addr;
+    remote_port_ = port;
+}
+
+void http2_session::set_local(const std::string& addr, int port) {
+    local_addr_ = addr;
+    local_port_ = port;
+}
+
+void http2_session::set_ssl(const SSL* ssl) {
+    ssl_ = ssl;
+}
+
+bool http2_session::read_exact(char* data, size_t size) {
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = strm_.read(data + got, size - got);
+        if (n <= 0) {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool http2_session::input_ready() {
+    return strm_.is_readable() || httplib::detail::select_read(strm_.socket(), 0, 0) > 0;
+}
+
+bool http2_session::wait_input(time_t timeout_sec, time_t timeout_usec) {
+    // 有帧到达或有请求处理完成时返回true
+    if (strm_.is_readable()) {
+        return true;
+    }
+    pollfd fds[2] = {{strm_.socket(), POLLIN, 0}, {completions_->wake_fd, POLLIN, 0}};
+    int timeout_ms = static_cast<int>(timeout_sec * 1000 + (timeout_usec + 999) / 1000);
+    int ready;
+    do {
+        ready = poll(fds, 2, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    return ready > 0;
+}
+
+bool http2_session::flush() {
+    size_t written = 0;
+    while (written < out_.size()) {
+        ssize_t n = strm_.write(out_.data() + written, out_.size() - written);
+        if (n <= 0) {
+            out_.clear();
+            closed_ = true;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    out_.clear();
+    return true;
+}
+
+void http2_session::write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const char* payload, size_t size) {
+    out_.push_back(static_cast<char>(size >> 16));
+    out_.push_back(static_cast<char>(size >> 8));
+    out_.push_back(static_cast<char>(size));
+    out_.push_back(static_cast<char>(type));
+    out_.push_back(static_cast<char>(flags));
+    append_u32(out_, stream_id & 0x7fffffff);
+    out_.append(payload, size);
+}
+
+void http2_session::write_settings() {
+    std::string payload;
+    auto add = [&payload](uint16_t id, uint32_t value) {
+        payload.push_back(static_cast<char>(id >> 8));
+        payload.push_back(static_cast<char>(id));
+        append_u32(payload, value);
+    };
+    add(SETTINGS_MAX_CONCURRENT_STREAMS, static_cast<uint32_t>(options_.max_concurrent_streams));
+    add(SETTINGS_INITIAL_WINDOW_SIZE, static_cast<uint32_t>(options_.initial_window_size));
+    add(SETTINGS_MAX_HEADER_LIST_SIZE, static_cast<uint32_t>(options_.max_header_list_size));
+    write_frame(FRAME_SETTINGS, 0, 0, payload.data(), payload.size());
+}
+
+void http2_session::write_window_update(uint32_t stream_id, uint32_t increment) {
+    std::string payload;
+    append_u32(payload, increment & 0x7fffffff);
+    write_frame(FRAME_WINDOW_UPDATE, 0, stream_id, payload.data(), payload.size());
+}
+
+void http2_session::reset_stream(uint32_t stream_id, uint32_t error_code) {
+    std::string payload;
+    append_u32(payload, error_code);
+    write_frame(FRAME_RST_STREAM, 0, stream_id, payload.data(), payload.size());
+    close_stream(stream_id);
+}
+
+bool http2_session::connection_error(uint32_t error_code) {
+    std::string payload;
+    append_u32(payload, last_stream_id_);
+    append_u32(payload, error_code);
+    write_frame(FRAME_GOAWAY, 0, 0, payload.data(), payload.size());
+    flush();
+    closed_ = true;
+    return false;
+}
+
+void http2_session::close_stream(uint32_t stream_id) {
+    streams_.erase(stream_id);
+}
+
+bool http2_session::run() {
+    char preface[PREFACE_SIZE];
+    if (!read_exact(preface, PREFACE_SIZE) || std::string(preface, PREFACE_SIZE) != std::string(PREFACE, PREFACE_SIZE)) {
+        return false;
+    }
+
+    write_settings();
+    write_window_update(0, CONNECTION_WINDOW_SIZE - DEFAULT_WINDOW_SIZE);
+    if (!flush()) {
+        return false;
+    }
+
+    while (!closed_) {
+        collect_responses();
+        if (has_sendable_data()) {
+            // 有数据可发时优先处理已到达的帧（如WINDOW_UPDATE、新请求），然后发送一轮
+            if (input_ready()) {
+                if (!read_frame()) {
+                    break;
+                }
+            } else {
+                send_round();
+            }
+        } else {
+            if (goaway_received_ && streams_.empty()) {
+                break;
+            }
+            std::chrono::microseconds delay;
+            if (pending_delay(delay)) {
+                // 有限速中的流或等待执行的请求：最多等到最早的一个需要处理，期间照常处理到达的帧
+                if (wait_input(static_cast<time_t>(delay.count() / 1000000), static_cast<time_t>(delay.count() % 1000000)) &&
+                    input_ready() && !read_frame()) {
+                    break;
+                }
+                run_stalled_handler();
+            } else if (!handling_.empty()) {
+                // 请求正在处理，等待完成或新的帧，处理时间不受读取超时限制
+                if (wait_input(options_.read_timeout_sec) && input_ready() && !read_frame()) {
+                    break;
+                }
+            } else {
+                time_t timeout = streams_.empty() ? options_.idle_timeout_sec : options_.read_timeout_sec;
+                if (!wait_input(timeout)) {
+                    if (streams_.empty()) {
+                        connection_error(NO_ERROR);
+                    }
+                    break;
+                }
+                if (input_ready() && !read_frame()) {
+                    break;
+                }
+            }
+        }
+        if (!flush()) {
+            break;
+        }
+    }
+
+    flush();
+    // 尚未开始的处理不再执行；正在执行的由处理线程持有流，完成后随完成队列释放
+    for (const auto& state : handling_) {
+        state->handler_claimed = true;
+    }
+    handling_.clear();
+    streams_.clear();
+    return true;
+}
+
+bool http2_session::read_frame() {
+    char header[FRAME_HEADER_SIZE];
+    if (!read_exact(header, FRAME_HEADER_SIZE)) {
+        closed_ = true;
+        return false;
+    }
+    auto* h = reinterpret_cast<const unsigned char*>(header);
+    size_t length = (static_cast<size_t>(h[0]) << 16) | (static_cast<size_t>(h[1]) << 8) | h[2];
+    uint8_t type = h[3];
+    uint8_t flags = h[4];
+    uint32_t stream_id = read_u32(header + 5) & 0x7fffffff;
+
+    // 我方未修改SETTINGS_MAX_FRAME_SIZE，对端帧不能超过默认值
+    if (length > DEFAULT_MAX_FRAME_SIZE) {
+        return connection_error(FRAME_SIZE_ERROR);
+    }
+    std::string payload(length, '\0');
+    if (length > 0 && !read_exact(&payload[0], length)) {
+        closed_ = true;
+        return false;
+    }
+
+    // 头部块未结束时只能收到同一个流的CONTINUATION
+    if (continuation_stream_ != 0 && (type != FRAME_CONTINUATION || stream_id != continuation_stream_)) {
+        return connection_error(PROTOCOL_ERROR);
+    }
+
+    switch (type) {
+    case FRAME_DATA:
+        return on_data(stream_id, flags, payload);
+    case FRAME_HEADERS:
+        return on_headers(stream_id, flags, payload);
+    case FRAME_CONTINUATION:
+        return on_continuation(stream_id, flags, payload);
+    case FRAME_PRIORITY:
+        if (stream_id == 0 || length != 5) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+        return true;
+    case FRAME_RST_STREAM:
+        if (stream_id == 0 || length != 4) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+        close_stream(stream_id);
+        return true;
+    case FRAME_SETTINGS:
+        if (stream_id != 0) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+        return on_settings(flags, payload);
+    case FRAME_PUSH_PROMISE:
+        // 客户端不能推送
+        return connection_error(PROTOCOL_ERROR);
+    case FRAME_PING:
+        if (stream_id != 0 || length != 8) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+        if (!(flags & FLAG_ACK)) {
+            write_frame(FRAME_PING, FLAG_ACK, 0, payload.data(), payload.size());
+        }
+        return true;
+    case FRAME_GOAWAY:
+        goaway_received_ = true;
+        return true;
+    case FRAME_WINDOW_UPDATE:
+        return on_window_update(stream_id, payload);
+    default:
+        // 未知类型的帧直接忽略
+        return true;
+    }
+}
+
+bool http2_session::on_settings(uint8_t flags, const std::string& payload) {
+    if (flags & FLAG_ACK) {
+        return payload.empty() ? true : connection_error(FRAME_SIZE_ERROR);
+    }
+    if (payload.size() % 6 != 0) {
+        return connection_error(FRAME_SIZE_ERROR);
+    }
+
+    for (size_t i = 0; i < payload.size(); i += 6) {
+        uint16_t id = static_cast<uint16_t>((static_cast<unsigned char>(payload[i]) << 8) |
+                                            static_cast<unsigned char>(payload[i + 1]));
+        uint32_t value = read_u32(payload.data() + i + 2);
+        if (id == SETTINGS_INITIAL_WINDOW_SIZE) {
+            if (value > MAX_WINDOW_SIZE) {
+                return connection_error(FLOW_CONTROL_ERROR);
+            }
+            // 初始窗口的变化量作用到所有已打开的流上
+            int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+            for (auto& entry : streams_) {
+                entry.second->send_window += delta;
+            }
+            peer_initial_window_ = value;
+        } else if (id == SETTINGS_MAX_FRAME_SIZE) {
+            if (value < DEFAULT_MAX_FRAME_SIZE || value > 0xffffff) {
+                return connection_error(PROTOCOL_ERROR);
+            }
+            peer_max_frame_size_ = value;
+        } else if (id == SETTINGS_ENABLE_PUSH && value > 1) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+        // 其余设置（头部表大小等）对我方的编码方式没有影响
+    }
+    write_frame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+    return true;
+}
+
+bool http2_session::on_window_update(uint32_t stream_id, const std::string& payload) {
+    if (payload.size() != 4) {
+        return connection_error(FRAME_SIZE_ERROR);
+    }
+    uint32_t increment = read_u32(payload.data()) & 0x7fffffff;
+    if (stream_id == 0) {
+        if (increment == 0) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+        connection_send_window_ += increment;
+        if (connection_send_window_ > MAX_WINDOW_SIZE) {
+            return connection_error(FLOW_CONTROL_ERROR);
+        }
+        return true;
+    }
+
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+        return true;
+    }
+    if (increment == 0) {
+        reset_stream(stream_id, PROTOCOL_ERROR);
+        return true;
+    }
+    it->second->send_window += increment;
+    if (it->second->send_window > MAX_WINDOW_SIZE) {
+        reset_stream(stream_id, FLOW_CONTROL_ERROR);
+    }
+    return true;
+}
+
+bool http2_session::on_headers(uint32_t stream_id, uint8_t flags, const std::string& frame_payload) {
+    if (stream_id == 0) {
+        return connection_error(PROTOCOL_ERROR);
+    }
+    std::string payload = frame_payload;
+    if (!strip_padding(flags, payload)) {
+        return connection_error(PROTOCOL_ERROR);
+    }
+    if (flags & FLAG_PRIORITY) {
+        if (payload.size() < 5) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+        payload.erase(0, 5);
+    }
+
+    stream_state* s;
+    auto it = streams_.find(stream_id);
+    if (it != streams_.end()) {
+        // 已有的流上再次收到HEADERS只能是请求尾部(trailers)
+        s = it->second.get();
+        if (s->request_complete || !(flags & FLAG_END_STREAM)) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+    } else {
+        if (stream_id % 2 == 0 || stream_id <= last_stream_id_) {
+            return connection_error(PROTOCOL_ERROR);
+        }
+        last_stream_id_ = stream_id;
+        auto created = std::make_shared<stream_state>();
+        created->id = stream_id;
+        created->send_window = peer_initial_window_;
+        s = created.get();
+        streams_[stream_id] = std::move(created);
+    }
+
+    s->header_block = payload;
+    s->end_stream_on_headers = (flags & FLAG_END_STREAM) != 0;
+    if (!(flags & FLAG_END_HEADERS)) {
+        continuation_stream_ = stream_id;
+        return true;
+    }
+    return end_headers(*s, s->end_stream_on_headers);
+}
+
+bool http2_session::on_continuation(uint32_t stream_id, uint8_t flags, const std::string& payload) {
+    if (continuation_stream_ == 0 || stream_id != continuation_stream_) {
+        return connection_error(PROTOCOL_ERROR);
+    }
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+        return connection_error(PROTOCOL_ERROR);
+    }
+    stream_state& s = *it->second;
+    s.header_block += payload;
+    if (s.header_block.size() > options_.max_header_list_size) {
+        return connection_error(ENHANCE_YOUR_CALM);
+    }
+    if (!(flags & FLAG_END_HEADERS)) {
+        return true;
+    }
+    continuation_stream_ = 0;
+    return end_headers(s, s.end_stream_on_headers);
+}
+
+bool http2_session::end_headers(stream_state& s, bool end_stream) {
+    // 即使要拒绝该流也必须先解码，以保持HPACK动态表与对端一致
+    header_list headers;
+    hpack_result decoded = decoder_.decode(reinterpret_cast<const uint8_t*>(s.header_block.data()), s.header_block.size(),
+                                           headers, options_.max_header_list_size);
+    s.header_block.clear();
+    if (decoded == hpack_result::too_large) {
+        return connection_error(ENHANCE_YOUR_CALM);
+    }
+    if (decoded != hpack_result::ok) {
+        return connection_error(COMPRESSION_ERROR);
+    }
+
+    uint32_t id = s.id;
+    if (s.req.method.empty()) {
+        size_t active = 0;
+        for (const auto& entry : streams_) {
+            active += entry.second->request_complete || !entry.second->req.method.empty() ? 1 : 0;
+        }
+        if (active >= options_.max_concurrent_streams) {
+            reset_stream(id, REFUSED_STREAM);
+            return true;
+        }
+        if (!build_request(s, headers)) {
+            reset_stream(id, PROTOCOL_ERROR);
+            return true;
+        }
+    }
+
+    if (end_stream) {
+        s.request_complete = true;
+        dispatch(s);
+    }
+    return true;
+}
+
+bool http2_session::build_request(stream_state& s, const header_list& headers) {
+    httplib::Request& req = s.req;
+    std::string path;
+    std::string authority;
+    std::string cookie;
+    bool regular_seen = false;
+
+    for (const auto& header : headers) {
+        const std::string& name = header.first;
+        for (char c : name) {
+            if (std::isupper(static_cast<unsigned char>(c))) {
+                return false;
+            }
+        }
+        if (!name.empty() && name[0] == ':') {
+            if (regular_seen) {
+                return false;
+            }
+            if (name == ":method") {
+                req.method = header.second;
+            } else if (name == ":path") {
+                path = header.second;
+            } else if (name == ":authority") {
+                authority = header.second;
+            } else if (name != ":scheme") {
+                return false;
+            }
+            continue;
+        }
+        regular_seen = true;
+        if (name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+            name == "transfer-encoding" || name == "upgrade") {
+            return false;
+        }
+        if (name == "cookie") {
+            // 多个cookie字段合并为一个
+            cookie += (cookie.empty() ? "" : "; ") + header.second;
+            continue;
+        }
+        req.headers.emplace(name, header.second);
+    }
+
+    if (req.method.empty() || path.empty() || req.method == "CONNECT") {
+        return false;
+    }
+    if (!cookie.empty()) {
+        req.headers.emplace("cookie", cookie);
+    }
+    if (!authority.empty() && !req.has_header("Host")) {
+        req.headers.emplace("host", authority);
+    }
+
+    req.version = "HTTP/2";
+    req.target = path;
+    auto query = path.find('?');
+    req.path = httplib::decode_path_component(path.substr(0, query));
+    if (query != std::string::npos) {
+        httplib::detail::parse_query_text(path.substr(query + 1), req.params);
+    }
+
+    req.remote_addr = remote_addr_;
+    req.remote_port = remote_port_;
+    req.local_addr = local_addr_;
+    req.local_port = local_port_;
+    req.set_header("REMOTE_ADDR", req.remote_addr);
+    req.set_header("REMOTE_PORT", std::to_string(req.remote_port));
+    req.set_header("LOCAL_ADDR", req.local_addr);
+    req.set_header("LOCAL_PORT", std::to_string(req.local_port));
+    req.is_connection_closed = [] { return false; };
+    req.ssl = ssl_;
+    return true;
+}
+
+bool http2_session::on_data(uint32_t stream_id, uint8_t flags, const std::string& frame_payload) {
+    if (stream_id == 0) {
+        return connection_error(PROTOCOL_ERROR);
+    }
+    if (stream_id > last_stream_id_) {
+        return connection_error(PROTOCOL_ERROR);
+    }
+
+    // 不论流是否仍存在，DATA都占用了连接窗口，需要归还
+    if (!frame_payload.empty()) {
+        write_window_update(0, static_cast<uint32_t>(frame_payload.size()));
+    }
+
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || it->second->request_complete) {
+        return true;
+    }
+    stream_state& s = *it->second;
+
+    std::string payload = frame_payload;
+    if (!strip_padding(flags, payload)) {
+        return connection_error(PROTOCOL_ERROR);
+    }
+    if (s.req.body.size() + payload.size() > options_.max_body_size) {
+        s.request_complete = true;
+        s.res.status = 413;
+        s.res.set_content("File too large", "text/plain");
+        send_response_headers(s);
+        return true;
+    }
+    s.req.body.append(payload);
+
+    if (flags & FLAG_END_STREAM) {
+        s.request_complete = true;
+        dispatch(s);
+    } else if (!frame_payload.empty()) {
+        write_window_update(stream_id, static_cast<uint32_t>(frame_payload.size()));
+    }
+    return true;
+}
+
+void http2_session::dispatch(stream_state& s) {
+    std::shared_ptr<stream_state> state = streams_[s.id];
+    state->dispatched_at = std::chrono::steady_clock::now();
+    handling_.push_back(state);
+    auto completions = completions_;
+    handler h = handler_;
+    auto job = [state, h, completions] { execute(state, h, completions); };
+    // 不在线程池的线程中或队列已满时在连接线程执行
+    if (completions_->wake_fd < 0 || !work_stealing_pool::submit(job)) {
+        job();
+    }
+}
+
+bool http2_session::execute(const std::shared_ptr<stream_state>& s, const handler& h,
+                            const std::shared_ptr<completion_queue>& completions) {
+    if (s->handler_claimed.exchange(true)) {
+        return false;
+    }
+    handle_request(*s, h);
+    completions->push(s);
+    return true;
+}
+
+void http2_session::handle_request(stream_state& s, const handler& h) {
+    httplib::Request& req = s.req;
+    httplib::Response& res = s.res;
+
+    // 与httplib读取请求体后的处理一致：解析表单与Range
+    bool ok = true;
+    if (req.is_multipart_form_data()) {
+        std::string boundary;
+        httplib::detail::FormDataParser parser;
+        if (!httplib::detail::parse_multipart_boundary(req.get_header_value("Content-Type"), boundary)) {
+            ok = false;
+        } else {
+            parser.set_boundary(std::move(boundary));
+            httplib::FormFields::iterator cur_field;
+            httplib::FormFiles::iterator cur_file;
+            bool is_text_field = false;
+            ok = parser.parse(
+                     req.body.data(), req.body.size(),
+                     [&](const httplib::FormData& file) {
+                         if (file.filename.empty()) {
+                             cur_field = req.form.fields.emplace(file.name, httplib::FormField{file.name, file.content, file.headers});
+                             is_text_field = true;
+                         } else {
+                             cur_file = req.form.files.emplace(file.name, file);
+                             is_text_field = false;
+                         }
+                         return true;
+                     },
+                     [&](const char* data, size_t size) {
+                         (is_text_field ? cur_field->second.content : cur_file->second.content).append(data, size);
+                         return true;
+                     }) &&
+                 parser.is_valid();
+            req.body.clear();
+        }
+        if (!ok) {
+            res.status = 400;
+        }
+    } else if (req.get_header_value("Content-Type").find("application/x-www-form-urlencoded") == 0) {
+        httplib::detail::parse_query_text(req.body, req.params);
+    }
+
+    if (ok && req.has_header("Range") && !httplib::detail::parse_range_header(req.get_header_value("Range"), req.ranges)) {
+        res.status = 416;
+        ok = false;
+    }
+
+    if (ok) {
+        try {
+            h(req, res);
+        } catch (const std::exception&) {
+            res = httplib::Response();
+            res.status = 500;
+        }
+        if (res.status == -1) {
+            res.status = req.ranges.empty() ? 200 : 206;
+        }
+        // 多段Range不做multipart/byteranges，直接返回完整内容
+        if (req.ranges.size() > 1 && res.status == 206) {
+            req.ranges.clear();
+            res.status = 200;
+        }
+        if (httplib::detail::range_error(req, res)) {
+            res.body.clear();
+            res.content_length_ = 0;
+            res.content_provider_ = nullptr;
+            res.status = 416;
+        }
+    }
+}
+
+void http2_session::collect_responses() {
+    if (handling_.empty()) {
+        return;
+    }
+    // 先清零eventfd再取队列：之后完成的请求会再次唤醒
+    uint64_t count;
+    ssize_t got = read(completions_->wake_fd, &count, sizeof(count));
+    (void)got;
+    std::vector<std::shared_ptr<stream_state>> done;
+    {
+        std::lock_guard<std::mutex> lock(completions_->mutex);
+        done.swap(completions_->done);
+    }
+    for (const auto& state : done) {
+        handling_.erase(std::remove(handling_.begin(), handling_.end(), state), handling_.end());
+        // 处理期间被对端重置的流不再响应
+        auto it = streams_.find(state->id);
+        if (it != streams_.end() && it->second == state) {
+            send_response_headers(*state);
+        }
+    }
+}
+
+void http2_session::run_stalled_handler() {
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < handling_.size(); ++i) {
+        std::shared_ptr<stream_state> state = handling_[i];
+        if (now - state->dispatched_at >= HANDLER_CLAIM_DELAY && execute(state, handler_, completions_)) {
+            return;
+        }
+    }
+}
+
+void http2_session::send_response_headers(stream_state& s) {
+    httplib::Request& req = s.req;
+    httplib::Response& res = s.res;
+    bool head = req.method == "HEAD";
+
+    // 确定响应体：普通body、按长度的content provider或不定长的content provider
+    bool has_length = true;
+    size_t length = 0;
+    bool partial = res.status == 206 && req.ranges.size() == 1;
+    if (res.content_provider_) {
+        s.provider = true;
+        s.chunked = res.is_chunked_content_provider_;
+        has_length = !s.chunked;
+        if (has_length) {
+            s.offset = 0;
+            s.end = res.content_length_;
+            if (partial) {
+                auto range = httplib::detail::get_range_offset_and_length(req.ranges[0], res.content_length_);
+                res.set_header("Content-Range", httplib::detail::make_content_range_header_field(range, res.content_length_));
+                s.offset = range.first;
+                s.end = range.first + range.second;
+            }
+            length = s.end - s.offset;
+        }
+    } else {
+        if (partial) {
+            auto range = httplib::detail::get_range_offset_and_length(req.ranges[0], res.body.size());
+            res.set_header("Content-Range", httplib::detail::make_content_range_header_field(range, res.body.size()));
+            res.body = res.body.substr(range.first, range.second);
+        }
+        s.buffer.swap(res.body);
+        length = s.buffer.size();
+    }
+
+    std::string block;
+    hpack_encoder::encode_status(res.status, block);
+    for (const auto& header : res.headers) {
+        std::string name = header.first;
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+            name == "transfer-encoding" || name == "upgrade" || name == "content-length") {
+            continue;
+        }
+        hpack_encoder::encode(name, header.second, block);
+    }
+    if (has_length) {
+        hpack_encoder::encode("content-length", std::to_string(length), block);
+    }
+
+    bool no_body = head || (has_length && length == 0) || res.status == 204 || res.status == 304;
+    uint8_t flags = no_body ? FLAG_END_STREAM : 0;
+
+    // 头部块超过对端帧大小时拆成HEADERS + CONTINUATION
+    size_t pos = 0;
+    uint8_t type = FRAME_HEADERS;
+    do {
+        size_t size = std::min(block.size() - pos, peer_max_frame_size_);
+        bool last = pos + size == block.size();
+        write_frame(type, static_cast<uint8_t>((type == FRAME_HEADERS ? flags : 0) | (last ? FLAG_END_HEADERS : 0)),
+                    s.id, block.data() + pos, size);
+        pos += size;
+        type = FRAME_CONTINUATION;
+    } while (pos < block.size());
+
+    if (no_body) {
+        res.content_provider_success_ = true;
+        // 请求体还没收完时（如提前返回413）告诉对端不必再发
+        if (!s.request_complete) {
+            reset_stream(s.id, NO_ERROR);
+        } else {
+            close_stream(s.id);
+        }
+        return;
+    }
+    s.responding = true;
+}
+
+bool http2_session::fill_buffer(stream_state& s) {
+    if (s.buffer_pos < s.buffer.size()) {
+        return true;
+    }
+    s.buffer.clear();
+    s.buffer_pos = 0;
+    if (!s.provider || s.provider_done) {
+        return false;
+    }
+    if (!s.chunked && s.offset >= s.end) {
+        s.provider_done = true;
+        return false;
+    }
+    if (s.deferred(std::chrono::steady_clock::now())) {
+        return false;
+    }
+
+    // 不按整个剩余长度索取：不按length分段的provider(如归档)会一次把整个响应体读进内存
+    size_t budget = static_cast<size_t>(
+        std::clamp<int64_t>(s.send_window, static_cast<int64_t>(peer_max_frame_size_), FILL_BUDGET));
+    size_t limit = s.chunked ? 0 : std::min(s.end, s.offset + budget);
+    httplib::DataSink sink;
+    sink.write = [&s, limit](const char* data, size_t size) {
+        if (!s.chunked) {
+            // 超出本次预算的部分丢弃，下次从offset重新生成
+            size = std::min(size, limit - std::min(limit, s.offset));
+        }
+        s.buffer.append(data, size);
+        s.offset += size;
+        return true;
+    };
+    sink.is_writable = [&s, budget] { return s.buffer.size() < budget; };
+    sink.done = [&s] { s.provider_done = true; };
+
+    // 限速时provider不休眠(否则整条连接都停下)，只记下何时再来
+    bandwidth_deferral deferral;
+    bool ok = s.chunked ? s.res.content_provider_(s.offset, 0, sink)
+                        : s.res.content_provider_(s.offset, limit - s.offset, sink);
+    if (deferral.deferred()) {
+        s.retry_at = deferral.retry_at();
+    }
+    if (!ok) {
+        reset_stream(s.id, INTERNAL_ERROR);
+        return false;
+    }
+    if (!s.chunked && s.offset >= s.end) {
+        s.provider_done = true;
+    }
+    return s.buffer_pos < s.buffer.size();
+}
+
+bool http2_session::has_sendable_data() {
+    if (connection_send_window_ <= 0) {
+        // 连接窗口耗尽时只能发送结束流的空DATA帧
+        for (const auto& entry : streams_) {
+            const stream_state& s = *entry.second;
+            if (s.responding && s.buffer_pos >= s.buffer.size() && (!s.provider || s.provider_done)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& entry : streams_) {
+        const stream_state& s = *entry.second;
+        if (s.responding && !s.deferred(now) &&
+            (s.send_window > 0 || (s.buffer_pos >= s.buffer.size() && (!s.provider || s.provider_done)))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool http2_session::pending_delay(std::chrono::microseconds& delay) {
+    auto now = std::chrono::steady_clock::now();
+    bool found = false;
+    auto consider = [&](std::chrono::steady_clock::time_point at) {
+        auto remaining = std::max(std::chrono::duration_cast<std::chrono::microseconds>(at - now),
+                                  std::chrono::microseconds(0));
+        delay = found ? std::min(delay, remaining) : remaining;
+        found = true;
+    };
+    for (const auto& entry : streams_) {
+        const stream_state& s = *entry.second;
+        if (s.responding && s.deferred(now)) {
+            consider(s.retry_at);
+        }
+    }
+    for (const auto& state : handling_) {
+        if (!state->handler_claimed) {
+            consider(state->dispatched_at + HANDLER_CLAIM_DELAY);
+        }
+    }
+    return found;
+}
+
+void http2_session::send_round() {
+    // 从上一轮之后的流开始，每个流最多发送一帧，轮流推进
+    std::vector<uint32_t> ids;
+    for (auto it = streams_.upper_bound(next_send_stream_); it != streams_.end(); ++it) {
+        ids.push_back(it->first);
+    }
+    for (auto it = streams_.begin(); it != streams_.end() && it->first <= next_send_stream_; ++it) {
+        ids.push_back(it->first);
+    }
+
+    for (uint32_t id : ids) {
+        auto it = streams_.find(id);
+        if (it == streams_.end() || !it->second->responding) {
+            continue;
+        }
+        stream_state& s = *it->second;
+        next_send_stream_ = id;
+
+        bool has_data = fill_buffer(s);
+        if (streams_.find(id) == streams_.end()) {
+            continue;
+        }
+        if (!has_data) {
+            if (!s.provider || s.provider_done) {
+                write_frame(FRAME_DATA, FLAG_END_STREAM, id, nullptr, 0);
+                s.res.content_provider_success_ = true;
+                close_stream(id);
+            }
+            continue;
+        }
+
+        int64_t window = std::min(connection_send_window_, s.send_window);
+        if (window <= 0) {
+            continue;
+        }
+        size_t size = std::min<size_t>({s.buffer.size() - s.buffer_pos, peer_max_frame_size_, static_cast<size_t>(window)});
+        bool last = s.buffer_pos + size == s.buffer.size() && (!s.provider || s.provider_done);
+        write_frame(FRAME_DATA, last ? FLAG_END_STREAM : 0, id, s.buffer.data() + s.buffer_pos, size);
+        s.buffer_pos += size;
+        s.send_window -= static_cast<int64_t>(size);
+        connection_send_window_ -= static_cast<int64_t>(size);
+        if (last) {
+            s.res.content_provider_success_ = true;
+            close_stream(id);
+        }
+    }
+}
+
+} // namespace to_https_server
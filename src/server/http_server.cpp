@@ -1,14 +1,122 @@
 #include <to_https_server/server/config.h>
 #include <to_https_server/server/http_server.h>
+#include <to_https_server/server/async_file_io.h>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
 #include <filesystem>
 #include <sstream>
 #include <string>
 #include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
 namespace to_https_server {
 
+static std::atomic<bool> reload_signalled(false);
+
+// 客户端声明的上传内容摘要，取自X-Content-SHA256头或sha256参数
+static std::string upload_digest(const httplib::Request& req) {
+    std::string digest = req.has_header("X-Content-SHA256") ? req.get_header_value("X-Content-SHA256")
+                                                            : req.get_param_value("sha256");
+    std::transform(digest.begin(), digest.end(), digest.begin(), ::tolower);
+    return digest;
+}
+
+// 请求头Digest(RFC 3230，"sha-256=<base64>")与Content-Digest(RFC 9530，"sha-256=:<base64>:")中
+// 声明的摘要，算法名转为小写
+static std::map<std::string, std::string> claimed_digests(const httplib::Request& req) {
+    std::map<std::string, std::string> result;
+    for (const char* header : {"Digest", "Content-Digest"}) {
+        std::stringstream ss(req.get_header_value(header));
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            size_t eq = item.find('=');
+            if (eq == std::string::npos) {
+                continue;
+            }
+            std::string name = item.substr(0, eq);
+            std::string value = item.substr(eq + 1);
+            name.erase(0, name.find_first_not_of(" \t"));
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            value.erase(value.find_last_not_of(" \t") + 1);
+            if (value.size() >= 2 && value.front() == ':' && value.back() == ':') {
+                value = value.substr(1, value.size() - 2);
+            }
+            result[name] = value;
+        }
+    }
+    return result;
+}
+
+// 上传时记下的摘要：Digest给出整个文件的SHA-256与CRC32C，ETag取SHA-256。
+// 客户端的If-None-Match与之相同时返回true
+static bool apply_digests(const httplib::Request& req, httplib::Response& res, const file_digests& digests) {
+    std::string etag = "\"" + digests.sha256 + "\"";
+    res.set_header("Digest", digest_header_value(digests));
+    res.set_header("ETag", etag);
+    std::stringstream ss(req.get_header_value("If-None-Match"));
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (item.compare(0, 2, "W/") == 0) {
+            item = item.substr(2);
+        }
+        if (item == etag || item == "*") {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string json_escape(const std::string& value) {
+    std::string result;
+    result.reserve(value.size() + 2);
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\r': result += "\\r"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    result += buf;
+                } else {
+                    result += static_cast<char>(c);
+                }
+        }
+    }
+    return result;
+}
+
+static void on_reload_signal(int) {
+    reload_signalled = true;
+}
+
+// 处理批量请求的线程自己也执行操作，辅助线程比batch_concurrency少一个
+static size_t batch_helpers(size_t concurrency) {
+    return concurrency > 1 ? concurrency - 1 : 1;
+}
+
+// 批量操作的一行按制表符拆成字段：操作名与一或两个路径
+static std::vector<std::string> split_batch_line(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, '\t')) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
 http_server::http_server() : running_(false) {}
 
 http_server::~http_server() {
@@ -26,7 +134,9 @@ void http_server::initialize(const std::string& runtime_dir) {
     std::string config_path = runtime_dir + "/config/server.conf";
     config.load_config(config_path);
 
-    const auto& server_config = config.get_config();
+    const auto snapshot = config.get_config();
+    const auto& server_config = *snapshot;
+    startup_config_ = server_config;
 
     // 创建必要的目录
     std::string www_path = server_config.www_root;
@@ -34,74 +144,415 @@ void http_server::initialize(const std::string& runtime_dir) {
     std::string trash_path = server_config.trash_dir;
 
     file_manager_ = std::make_unique<file_manager>(www_path, trash_path);
-    compressor_ = std::make_unique<gzip_compressor>();
+    file_manager_->trash().set_limits(server_config.trash_max_age, server_config.trash_max_size);
+    if (!server_config.content_store_dir.empty()) {
+        file_manager_->enable_content_store(server_config.content_store_dir, server_config.content_store_min_size);
+    }
+    listing_cache_ = std::make_unique<directory_cache>(server_config.listing_cache_size);
+    if (server_config.search_index) {
+        search_index_ = std::make_unique<search_index>(file_manager_->sanitize_path("/"));
+    }
+    file_jobs_ = std::make_unique<file_jobs>();
+    bandwidth_ = std::make_unique<bandwidth_limiter>();
+    bandwidth_->configure(server_config.bandwidth_limit, server_config.bandwidth_per_ip_limit,
+                          server_config.bandwidth_per_transfer_limit);
+    lanes_ = std::make_unique<request_lanes>();
+    lanes_->configure(server_config.bulk_threads, server_config.bulk_queue_size, server_config.bulk_queue_timeout_ms);
+    admission_ = std::make_unique<admission_control>();
+    admission_->configure(server_config.admission_target_ms, server_config.admission_interval_ms);
+    compressor_ = std::make_unique<gzip_compressor>(server_config.compress_threads,
+                                                    server_config.compress_parallel_min_size);
     security_ = std::make_unique<security_manager>();
     logger_ = std::make_unique<logger>(log_path);
+    pool_options batch_options;
+    batch_options.min_threads = batch_options.max_threads = batch_helpers(server_config.batch_concurrency);
+    batch_pool_ = std::make_unique<work_stealing_pool>(batch_options);
 
-	thread_count_ = server_config.thread_pool_size;
-	task_queue_size_ = server_config.task_queue_size;
-    buffer_chunk_size_ = server_config.buffer_chunk_size;
-    max_file_size_ = server_config.max_file_size;
-	cache_max_age_ = server_config.cache_max_age;
+	pool_options_.min_threads = server_config.thread_pool_size;
+	pool_options_.max_threads = std::max(server_config.thread_pool_size, server_config.thread_pool_max_size);
+	pool_options_.max_queued = server_config.task_queue_size;
+	pool_options_.pin_cpu = server_config.thread_pool_pin_cpu;
+	pool_options_.grow_queue_depth = server_config.thread_pool_grow_queue_depth;
+	pool_options_.grow_wait_ms = server_config.thread_pool_grow_wait_ms;
+	pool_options_.idle_timeout_sec = server_config.thread_pool_idle_timeout;
+	io_model_ = server_config.io_model;
+	io_threads_ = server_config.io_threads;
+	acceptor_count_ = server_config.acceptor_count;
 
 	cert_path_ = server_config.ssl_cert_path;
 	privkey_path_ = server_config.ssl_key_path;
+	tls_session_options_.cache_size = server_config.tls_session_cache_size;
+	tls_session_options_.session_timeout_sec = server_config.tls_session_timeout;
+	tls_session_options_.tickets = server_config.tls_session_tickets;
+	tls_session_options_.ticket_rotate_sec = server_config.tls_ticket_rotate_interval;
+	ktls_ = server_config.ktls;
+	upgrade_socket_ = server_config.upgrade_socket;
+	drain_timeout_ = server_config.drain_timeout;
+	http2_ = server_config.http2;
+	http2_options_.max_concurrent_streams = server_config.http2_max_concurrent_streams;
+	http2_options_.max_body_size = server_config.max_file_size;
 
 	port_ = server_config.port;
 
-	admin_password_ = server_config.admin_password;
+	if (!server_config.use_io_uring) {
+		async_file_io::disable_uring();
+	}
 
 	// 创建需要用的数据库
 	visitors_cnt_ = reinterpret_cast<uint64_t*>(visitors_db_.open((runtime_dir_ + "/.visitors.db").c_str(), 8));
 }
 
+std::unique_ptr<httplib::Server> http_server::create_server() {
+	if (!cert_path_.empty() && !privkey_path_.empty()) {
+		auto server = std::make_unique<tls_server>(cert_path_.c_str(), privkey_path_.c_str());
+		server->enable_ktls(ktls_);
+		if (!tls_sessions_) {
+			tls_sessions_ = std::make_unique<tls_session_manager>(tls_session_options_);
+		}
+		tls_sessions_->attach(server->ssl_context());
+		if (http2_) {
+			server->enable_http2(http2_options_, [this](const auto& req, auto& res) { handle_http2_request(req, res); });
+		}
+		return server;
+	}
+	auto server = std::make_unique<cleartext_server>();
+	if (http2_) {
+		server->enable_http2(http2_options_, [this](const auto& req, auto& res) { handle_http2_request(req, res); });
+	}
+	return server;
+}
+
 void http_server::start() {
     if (running_) {
         return;
     }
     
-	if (!cert_path_.empty() && !privkey_path_.empty())
-		server_ = std::make_unique<httplib::SSLServer>(cert_path_.c_str(), privkey_path_.c_str());
-	else
-		server_ = std::make_unique<httplib::Server>();
+	// 平滑升级：若旧进程仍在运行，从它那里接管监听套接字
+	std::vector<int> inherited;
+	std::string handover_state;
+	handover_.reset();
+	draining_ = false;
+	if (!upgrade_socket_.empty()) {
+		handover_ = std::make_unique<listener_handover>(upgrade_socket_);
+		if (handover_->acquire(inherited, handover_state)) {
+			logger_->log(logger::level::info, "Taking over " + std::to_string(inherited.size()) + " listening socket(s) from the running process");
+		}
+	}
 
-    if (!server_->is_valid()) {
-        logger_->log(logger::level::error, "Failed to create server");
-        return;
-    }
+	event_server_ = nullptr;
+	servers_.clear();
+	bool ssl = !cert_path_.empty() && !privkey_path_.empty();
+	if (io_model_ == "epoll" && !ssl && !http2_) {
+		auto server = std::make_unique<event_server>(io_threads_);
+		event_server_ = server.get();
+		servers_.push_back(std::move(server));
+	} else if (io_model_ == "reuseport") {
+		size_t count = acceptor_count_ > 0 ? acceptor_count_ : std::max(1u, std::thread::hardware_concurrency());
+		// 接管时沿用旧进程的监听数，这些套接字已经在内核的同一个SO_REUSEPORT组中
+		if (!inherited.empty()) {
+			count = inherited.size();
+		}
+		for (size_t i = 0; i < count; ++i) {
+			auto server = create_server();
+			// 每个监听套接字都设置SO_REUSEPORT，由内核在它们之间分配新连接
+			server->set_socket_options([](socket_t sock) {
+				httplib::detail::set_socket_opt(sock, SOL_SOCKET, SO_REUSEADDR, 1);
+				httplib::detail::set_socket_opt(sock, SOL_SOCKET, SO_REUSEPORT, 1);
+			});
+			servers_.push_back(std::move(server));
+		}
+	} else {
+		if (io_model_ == "epoll") {
+			logger_->log(logger::level::warning, "epoll I/O model does not support SSL or HTTP/2, falling back to threaded");
+		}
+		servers_.push_back(create_server());
+	}
 
-	// 服务器线程池设置
-	server_->new_task_queue = [this] {
-		return new httplib::ThreadPool(/*线程数*/thread_count_, /*任务队列大小*/task_queue_size_);
-	};
+	// 旧进程的监听比本进程多（如从reuseport切换到threaded）时，多出的只能关闭
+	if (inherited.size() > servers_.size()) {
+		logger_->log(logger::level::warning, "Closing " + std::to_string(inherited.size() - servers_.size()) + " inherited listening socket(s), connections queued on them are lost");
+		for (size_t i = servers_.size(); i < inherited.size(); ++i) {
+			close(inherited[i]);
+		}
+		inherited.resize(servers_.size());
+	}
+
+	listeners_.clear();
+	for (const auto& server : servers_) {
+		if (!server->is_valid()) {
+			logger_->log(logger::level::error, "Failed to create server");
+			servers_.clear();
+			return;
+		}
+		listeners_.push_back(dynamic_cast<handover_listener*>(server.get()));
+	}
+	if (tls_sessions_ && !handover_state.empty()) {
+		tls_sessions_->import_ticket_keys(handover_state);
+	}
+
+	// 服务器线程池设置：多个监听时线程数与排队上限平分到各组
+	size_t groups = servers_.size();
+	pool_options options = pool_options_;
+	options.min_threads = (pool_options_.min_threads + groups - 1) / groups;
+	options.max_threads = (pool_options_.max_threads + groups - 1) / groups;
+	options.max_queued = (pool_options_.max_queued + groups - 1) / groups;
+	pools_.reset(new std::atomic<work_stealing_pool*>[groups]);
+	for (size_t i = 0; i < groups; ++i) {
+		pools_[i] = nullptr;
+		auto group_options = options;
+		if (groups > 1) {
+			// 每组的工作线程与其accept线程绑定在同一个CPU上
+			group_options.cpu = static_cast<int>(i);
+		}
+		servers_[i]->new_task_queue = [this, i, group_options] {
+			auto pool = new work_stealing_pool(group_options);
+			pools_[i] = pool;
+			return pool;
+		};
+	}
     
     setup_routes();
+    for (const auto& server : servers_) {
+        install_handlers(*server);
+    }
+
+	for (size_t i = 0; i < groups; ++i) {
+		if (!open_listener(i, i < inherited.size() ? inherited[i] : -1)) {
+			logger_->log(logger::level::error, "Failed to bind port " + std::to_string(port_));
+			servers_.clear();
+			listeners_.clear();
+			return;
+		}
+	}
+	if (handover_) {
+		// 已接管全部套接字，旧进程此时停止accept
+		handover_->confirm();
+		std::vector<int> sockets;
+		for (auto* listener : listeners_) {
+			sockets.push_back(listener->listening_socket());
+		}
+		bool served = handover_->serve(sockets, [this] {
+			return tls_sessions_ ? tls_sessions_->export_ticket_keys() : std::string();
+		}, [this] { on_handed_over(); });
+		if (!served) {
+			logger_->log(logger::level::warning, "Cannot listen on upgrade socket " + upgrade_socket_);
+		}
+	}
     
     running_ = true;
-    logger_->log(logger::level::info, "Server starting on port " + std::to_string(port_));
+    reload_thread_ = std::thread([this] { watch_reload_signal(); });
+    if (search_index_) {
+        search_index_->start();
+    }
+    file_manager_->trash().start();
+    if (file_manager_->store()) {
+        file_manager_->store()->start();
+    }
+    file_jobs_->start();
+    logger_->log(logger::level::info, "Server starting on port " + std::to_string(port_) +
+                 " with " + std::to_string(groups) + " listener(s)");
     
-    // 阻塞监听
-    if (!server_->listen("0.0.0.0", port_)) {
+    // 阻塞监听：第一个监听在当前线程运行，其余各开一个accept线程
+    std::vector<std::thread> acceptors;
+    for (size_t i = 1; i < groups; ++i) {
+        acceptors.emplace_back([this, i] {
+            if (pool_options_.pin_cpu) {
+                work_stealing_pool::pin_to_cpu(i);
+            }
+            if (!servers_[i]->listen_after_bind()) {
+                logger_->log(logger::level::error, "Listener " + std::to_string(i) + " failed on port " + std::to_string(port_));
+            }
+        });
+    }
+    if (groups > 1 && pool_options_.pin_cpu) {
+        work_stealing_pool::pin_to_cpu(0);
+    }
+    bool listened = event_server_ ? event_server_->run("0.0.0.0", port_) : servers_[0]->listen_after_bind();
+    if (!listened) {
         logger_->log(logger::level::error, "Failed to start server on port " + std::to_string(port_));
+        for (size_t i = 1; i < groups; ++i) {
+            servers_[i]->stop();
+        }
+    }
+    for (auto& acceptor : acceptors) {
+        acceptor.join();
     }
     
-    running_ = false;
+    {
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+        running_ = false;
+    }
+    reload_cv_.notify_all();
+    reload_thread_.join();
+    if (search_index_) {
+        search_index_->stop();
+    }
+    file_manager_->trash().stop();
+    if (file_manager_->store()) {
+        file_manager_->store()->stop();
+    }
+    file_jobs_->stop();
+    if (handover_) {
+        handover_->stop();
+    }
     logger_->log(logger::level::info, "Server stopped");
 }
 
+bool http_server::open_listener(size_t index, int inherited) {
+	httplib::Server& server = *servers_[index];
+	handover_listener* listener = listeners_[index];
+	if (inherited >= 0) {
+		listener->adopt_socket(inherited);
+	} else if (!server.bind_to_port("0.0.0.0", port_)) {
+		return false;
+	}
+
+	if (handover_) {
+		// 交接前后新旧进程会同时等待同一个监听套接字：accept必须非阻塞，
+		// 并定期醒来，以便旧进程停止accept后及时退出循环
+		int sock = listener->listening_socket();
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+		server.set_idle_interval(0, 100000);
+		listener->track_connections(&connections_);
+	}
+	return true;
+}
+
+void http_server::on_handed_over() {
+	logger_->log(logger::level::info, "Listening sockets handed over to the new process, draining connections");
+	{
+		std::lock_guard<std::mutex> lock(reload_mutex_);
+		drain_deadline_ = std::chrono::steady_clock::now() + std::chrono::seconds(drain_timeout_);
+	}
+	draining_ = true;
+	// 已有连接全部结束（或排空超时）后由watch_reload_signal()关闭监听，start()随即返回
+	for (auto* listener : listeners_) {
+		listener->stop_accepting();
+	}
+}
+
 void http_server::stop() {
+    std::unique_lock<std::mutex> lock(reload_mutex_);
     if (!running_) {
         return;
     }
     
     running_ = false;
-    if (server_) {
-        server_->stop();
+    lock.unlock();
+    reload_cv_.notify_all();
+    if (draining_) {
+        // 已停止accept，直接断开剩余的连接
+        connections_.shutdown_all();
+        for (auto* listener : listeners_) {
+            listener->close_listener();
+        }
+    } else if (event_server_) {
+        event_server_->stop();
+    } else {
+        for (auto& server : servers_) {
+            server->stop();
+        }
     }
     
     logger_->log(logger::level::info, "Server stopped");
 }
 
+std::shared_ptr<const server_config> http_server::current_config() const {
+    return config_manager::instance().get_config();
+}
+
+bool http_server::reload_config() {
+    auto& manager = config_manager::instance();
+    if (!manager.reload()) {
+        logger_->log(logger::level::error, "Failed to reload configuration");
+        return false;
+    }
+    apply_config(*manager.get_config());
+    logger_->log(logger::level::info, "Configuration reloaded, generation " + std::to_string(manager.generation()));
+    return true;
+}
+
+void http_server::apply_config(const server_config& config) {
+    // 请求处理中读取的项（缓存时间、大小限制、密码等）每次都取最新快照，无需在此处理
+
+    // 线程池：与启动时一样把线程数与排队上限平分到各组
+    size_t groups = servers_.size();
+    size_t min_threads = config.thread_pool_size;
+    size_t max_threads = std::max(config.thread_pool_size, config.thread_pool_max_size);
+    for (size_t i = 0; i < groups && pools_; ++i) {
+        work_stealing_pool* pool = pools_[i];
+        if (pool) {
+            pool->resize((min_threads + groups - 1) / groups, (max_threads + groups - 1) / groups,
+                         (config.task_queue_size + groups - 1) / groups);
+        }
+    }
+
+    if (tls_sessions_) {
+        tls_sessions_->set_cache_size(config.tls_session_cache_size);
+    }
+    listing_cache_->set_capacity(config.listing_cache_size);
+    bandwidth_->configure(config.bandwidth_limit, config.bandwidth_per_ip_limit, config.bandwidth_per_transfer_limit);
+    lanes_->configure(config.bulk_threads, config.bulk_queue_size, config.bulk_queue_timeout_ms);
+    admission_->configure(config.admission_target_ms, config.admission_interval_ms);
+    batch_pool_->resize(batch_helpers(config.batch_concurrency), batch_helpers(config.batch_concurrency), 0);
+    file_manager_->trash().set_limits(config.trash_max_age, config.trash_max_size);
+
+    // 监听与目录相关的配置只在启动时读取
+    const server_config& startup = startup_config_;
+    if (config.port != startup.port || config.ssl_cert_path != startup.ssl_cert_path ||
+        config.ssl_key_path != startup.ssl_key_path || config.io_model != startup.io_model ||
+        config.acceptor_count != startup.acceptor_count || config.http2 != startup.http2 ||
+        config.ktls != startup.ktls || config.www_root != startup.www_root ||
+        config.log_dir != startup.log_dir || config.trash_dir != startup.trash_dir ||
+        config.content_store_dir != startup.content_store_dir || config.search_index != startup.search_index) {
+        logger_->log(logger::level::warning, "Listener, TLS and directory settings take effect after restart");
+    }
+}
+
+void http_server::watch_reload_signal() {
+    struct sigaction action {};
+    action.sa_handler = on_reload_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGHUP, &action, nullptr);
+
+    bool drained = false;
+    bool drain_expired = false;
+    std::unique_lock<std::mutex> lock(reload_mutex_);
+    while (running_) {
+        reload_cv_.wait_for(lock, std::chrono::milliseconds(500));
+        if (reload_signalled.exchange(false)) {
+            lock.unlock();
+            reload_config();
+            lock.lock();
+        }
+        if (draining_ && !drained) {
+            if (connections_.size() == 0) {
+                drained = true;
+                for (auto* listener : listeners_) {
+                    listener->close_listener();
+                }
+            } else if (!drain_expired && std::chrono::steady_clock::now() >= drain_deadline_) {
+                // 排空超时后强制断开仍未完成的传输
+                drain_expired = true;
+                logger_->log(logger::level::warning, "Drain timeout reached, closing " + std::to_string(connections_.size()) + " connection(s)");
+                connections_.shutdown_all();
+            }
+        }
+    }
+}
+
+bool http_server::check_admin_password(const httplib::Request& req) const {
+    return req.get_param_value("password") == current_config()->admin_password;
+}
+
+static bool has_request_body(const httplib::Request& req) {
+    if (req.get_header_value_u64("Content-Length") > 0) {
+        return true;
+    }
+    return req.get_header_value("Transfer-Encoding").find("chunked") != std::string::npos;
+}
+
 std::string http_server::query_real_ip(const httplib::Request& req) const {
 	std::string result = "Unknown_IP";
 	if(req.has_header("CF-Connecting-IP")) {
@@ -119,86 +570,252 @@ std::string http_server::query_user_agent(const httplib::Request& req) const {
 }
 
 void http_server::setup_routes() {
-    server_->set_pre_routing_handler([this](const auto& req, auto& res) {
-        std::string client_ip = get_client_ip(req);
-        
-        if (security_->is_under_attack()) {
-            res.status = 503;
-            res.set_content("服务器正在被攻击，将暂时停止服务/Server is under attack and will temporarily suspend service.", "text/plain");
+    // 路由表：静态文件、API与云盘均在此注册，新增API只需添加一行
+    router_.add("GET", "/api/visits", [this](const auto& req, auto& res) {
+        handle_visits_request(req, res);
+    });
+    router_.add("GET", "/api/stats", [this](const auto& req, auto& res) {
+        handle_stats_request(req, res);
+    });
+    router_.add("POST", "/api/reload", [this](const auto& req, auto& res) {
+        handle_reload_request(req, res);
+    });
+    router_.add("GET", "/api/search", [this](const auto& req, auto& res) {
+        handle_search_request(req, res);
+    });
+    router_.add("GET", "/api/trash", [this](const auto& req, auto& res) {
+        handle_trash_list_request(req, res);
+    });
+    router_.add("POST", "/api/trash/restore", [this](const auto& req, auto& res) {
+        handle_trash_restore_request(req, res);
+    });
+    router_.add("GET", "/api/jobs", [this](const auto& req, auto& res) {
+        handle_jobs_request(req, res);
+    });
+    router_.add("POST", "/api/batch", [this](const auto& req, auto& res) {
+        handle_batch_request(req, res);
+    });
+    router_.add_prefix("GET", "/cloud-drive", [this](const auto& req, auto& res) {
+        handle_cloud_drive_request(req, res);
+    });
+    router_.set_fallback("GET", [this](const auto& req, auto& res) {
+        handle_file_request(req, res);
+    });
+
+    router_.add_action("POST", "upload", [this](const auto& req, auto& res) {
+        handle_upload_request(req, res);
+    });
+    router_.add_action("POST", "delete", [this](const auto& req, auto& res) {
+        handle_delete_request(req, res);
+    });
+    router_.add_action("POST", "mkdir", [this](const auto& req, auto& res) {
+        handle_mkdir_request(req, res);
+    });
+    router_.add_action("POST", "copy", [this](const auto& req, auto& res) {
+        handle_transfer_request(req, res, "copy");
+    });
+    router_.add_action("POST", "move", [this](const auto& req, auto& res) {
+        handle_transfer_request(req, res, "move");
+    });
+    router_.add_action("POST", "ergodic", [this](const auto& req, auto& res) {
+        handle_list_request(req, res);
+    });
+    router_.add_action("GET", "archive", [this](const auto& req, auto& res) {
+        handle_archive_request(req, res);
+    });
+    router_.set_fallback("POST", [this](const auto& req, auto& res) {
+        if (!req.has_param("param")) {
+            res.status = 400;
+            res.set_content("No param provided.", "text/plain");
+            return;
+        }
+        handle_file_request(req, res);
+    });
+
+    router_.set_fallback("PUT", [this](const auto& req, auto& res) {
+        // 处理大文件上传
+        if (handle_chunked_upload(req, res)) {
+            return;
+        }
+
+        // 普通上传
+        handle_upload_request(req, res);
+    });
+}
+
+void http_server::install_handlers(httplib::Server& server) {
+    server.set_pre_routing_handler([this](const auto& req, auto& res) {
+        if (reject_request(req, res)) {
             return httplib::Server::HandlerResponse::Handled;
         }
-        
-        if (security_->should_block_request(client_ip)) {
-            res.status = 429;
-            res.set_content("Too many requests", "text/plain");
+        // 同一线程上的前一个请求没有走到logger时先归还bulk名额
+        leave_lane();
+        request_class cls = classify_request(req);
+        if (!admit_request(req, res, cls)) {
+            // 拒绝后关闭连接，释放处理它的工作线程。httplib按请求的Connection头生成响应头，
+            // 请求对象在process_request中本是可修改的
+            auto& closing = const_cast<httplib::Request&>(req);
+            closing.headers.erase("Connection");
+            closing.set_header("Connection", "close");
+            close_after_response();
             return httplib::Server::HandlerResponse::Handled;
         }
-        
-        // 检查上传文件大小限制
-        if (req.method == "POST" || req.method == "PUT") {
-            auto content_length = req.get_header_value("Content-Length");
-            if (!content_length.empty()) {
-                size_t size = std::stoull(content_length);
-                if (size > max_file_size_) {
-                    res.status = 413;
-                    res.set_content("File too large", "text/plain");
-                    return httplib::Server::HandlerResponse::Handled;
-                }
-            }
+        if (!enter_lane(res, cls)) {
+            return httplib::Server::HandlerResponse::Handled;
         }
         
+        // 无请求体的请求直接在此查路由表处理，不经过httplib的正则匹配
+        if (!has_request_body(req)) {
+            dispatch_request(req, res);
+            return httplib::Server::HandlerResponse::Handled;
+        }
+
         return httplib::Server::HandlerResponse::Unhandled;
     });
     
-    server_->Get(".*", [this](const auto& req, auto& res) {
-		std::string real_ip = query_real_ip(req);
-		std::string user_agent = query_user_agent(req);
-		logger_->log(logger::level::info, "Accepted a GET request from ip " + real_ip + ", path: " + req.path + ", user-agent: " + user_agent);
-		if(req.path == "/api/visits") {
-			handle_visits_request(req, res);
-			return;
-		}
-		handle_file_request(req, res);
-		logger_->log(logger::level::info, "The response for a GET request sent. Code: " + std::to_string(res.status == -1 ? 200 : res.status) + ", Request path: " + req.path);
+    // 响应完整写出后调用，bulk请求在此归还名额
+    server.set_logger([this](const auto&, const auto&) {
+        leave_lane();
+    });
+    
+    // 带请求体的请求需由httplib先读完请求体，再交给路由表分发
+    server.Get(".*", [this](const auto& req, auto& res) {
+        dispatch_request(req, res);
+    });
+    server.Post(".*", [this](const auto& req, auto& res) {
+        dispatch_request(req, res);
+    });
+    server.Put(".*", [this](const auto& req, auto& res) {
+        dispatch_request(req, res);
     });
+}
+
+bool http_server::reject_request(const httplib::Request& req, httplib::Response& res) {
+    std::string client_ip = get_client_ip(req);
     
-    // server_->Head(".*", [this](const auto& req, auto& res) {
-    //     handle_head_request(req, res);
-    // });
+    if (security_->is_under_attack()) {
+        res.status = 503;
+        res.set_content("服务器正在被攻击，将暂时停止服务/Server is under attack and will temporarily suspend service.", "text/plain");
+        return true;
+    }
     
-    server_->Post(".*", [this](const auto& req, auto& res) {
-		std::string real_ip = query_real_ip(req);
-		std::string user_agent = query_user_agent(req);
-		if(!req.has_param("param")) {
-			res.status = 400;
-			res.set_content("No param provided.", "text/plain");
-			return;
-		}
-        std::string param = req.get_param_value("param");
-		logger_->log(logger::level::info, "Accepted a POST request from ip " + real_ip + ", parameter: " + param + ", path: " + req.path + ", user-agent: " + user_agent);
-        if (param == "upload") {
-            handle_upload_request(req, res);
-        } else if (param == "delete") {
-            handle_delete_request(req, res);
-        } else if (param == "mkdir") {
-            handle_mkdir_request(req, res);
-        } else if (param == "ergodic") {
-            handle_list_request(req, res);
-        } else {
-            handle_file_request(req, res);
+    if (security_->should_block_request(client_ip)) {
+        res.status = 429;
+        res.set_content("Too many requests", "text/plain");
+        return true;
+    }
+    
+    // 检查上传文件大小限制
+    if (req.method == "POST" || req.method == "PUT") {
+        auto content_length = req.get_header_value("Content-Length");
+        if (!content_length.empty()) {
+            size_t size = std::stoull(content_length);
+            if (size > current_config()->max_file_size) {
+                res.status = 413;
+                res.set_content("File too large", "text/plain");
+                return true;
+            }
         }
-		logger_->log(logger::level::info, "The response for a POST request sent. Code: " + std::to_string(res.status == -1 ? 200 : res.status) + ", Request path: " + req.path);
-    });
+    }
     
-    server_->Put(".*", [this](const auto& req, auto& res) {
-        // 处理大文件上传
-        if (handle_chunked_upload(req, res)) {
-            return;
+    // 跨文件系统删除的暂存项：对用户而言已经删除
+    if (trash_manager::is_staging_path(req.path)) {
+        res.status = 404;
+        res.set_content("File not found", "text/plain");
+        return true;
+    }
+    return false;
+}
+
+request_class http_server::classify_request(const httplib::Request& req) const {
+    const auto config = current_config();
+    if (req.method == "POST" || req.method == "PUT") {
+        // 大上传，或长度未知的分块传输编码上传
+        auto content_length = req.get_header_value("Content-Length");
+        if (content_length.empty()) {
+            return req.has_header("Transfer-Encoding") ? request_class::bulk : request_class::interactive;
         }
-        
-        // 普通上传
-        handle_upload_request(req, res);
-    });
+        return std::strtoull(content_length.c_str(), nullptr, 10) >= config->bulk_min_size
+            ? request_class::bulk : request_class::interactive;
+    }
+    if (req.method != "GET") {
+        return request_class::interactive;
+    }
+    if (req.has_param("param")) {
+        return req.get_param_value("param") == "archive" ? request_class::bulk : request_class::interactive;
+    }
+    // /api等路由不对应文件，无需stat
+    if (router_.has_exact(req)) {
+        return request_class::interactive;
+    }
+    // 按文件大小归类；Range请求也看整个文件，断点续传与播放器通常会接着读下去
+    struct stat st;
+    std::string safe_path = file_manager_->sanitize_path(req.path);
+    if (stat(safe_path.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+        static_cast<size_t>(st.st_size) >= config->bulk_min_size) {
+        return request_class::bulk;
+    }
+    return request_class::interactive;
+}
+
+bool http_server::admit_request(const httplib::Request& req, httplib::Response& res, request_class cls) {
+    request_priority priority = request_priority::interactive;
+    if (check_admin_password(req)) {
+        priority = request_priority::admin;
+    } else if (cls == request_class::bulk) {
+        priority = request_priority::bulk;
+    }
+
+    std::chrono::microseconds delay(0);
+    bool sampled = work_stealing_pool::take_queue_delay(delay);
+    if (admission_->admit(priority, delay, sampled)) {
+        return true;
+    }
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(current_config()->admission_retry_after));
+    res.set_content("Server is busy, please retry later", "text/plain");
+    return false;
+}
+
+bool http_server::enter_lane(httplib::Response& res, request_class cls) {
+    if (!lanes_->enabled() || cls != request_class::bulk) {
+        return true;
+    }
+    // 取得名额后才补线程：排队中的请求仍占用常规容量，排队数由bulk_queue_size限制
+    if (!lanes_->enter_bulk()) {
+        res.status = 503;
+        res.set_header("Retry-After", "5");
+        res.set_content("Too many transfers in progress", "text/plain");
+        return false;
+    }
+    // 名额随bulk状态一起归还：响应没有写完(logger未被调用)时由线程池在任务结束时归还
+    request_lanes* lanes = lanes_.get();
+    work_stealing_pool::begin_bulk([lanes] { lanes->leave_bulk(); });
+    return true;
+}
+
+void http_server::leave_lane() {
+    work_stealing_pool::end_bulk();
+}
+
+void http_server::handle_http2_request(const httplib::Request& req, httplib::Response& res) {
+    // HTTP/2的请求体已由会话收齐，检查后直接查路由表
+    if (reject_request(req, res) || !admit_request(req, res, classify_request(req))) {
+        return;
+    }
+    dispatch_request(req, res);
+}
+
+void http_server::dispatch_request(const httplib::Request& req, httplib::Response& res) {
+    std::string real_ip = query_real_ip(req);
+    std::string user_agent = query_user_agent(req);
+    std::string param = req.has_param("param") ? ", parameter: " + req.get_param_value("param") : "";
+    logger_->log(logger::level::info, "Accepted a " + req.method + " request from ip " + real_ip + param + ", path: " + req.path + ", user-agent: " + user_agent);
+    if (!router_.dispatch(req, res)) {
+        res.status = 404;
+        res.set_content("404 Not Found", "text/plain");
+    }
+    logger_->log(logger::level::info, "The response for a " + req.method + " request sent. Code: " + std::to_string(res.status == -1 ? 200 : res.status) + ", Request path: " + req.path);
 }
 
 void http_server::handle_visits_request(const httplib::Request& req, httplib::Response& res) {
@@ -207,9 +824,312 @@ void http_server::handle_visits_request(const httplib::Request& req, httplib::Re
 	res.set_content(std::to_string(*visitors_cnt_), "text/plain");
 }
 
+pool_stats http_server::total_pool_stats() const {
+	// 多个监听时汇总各组线程池
+	pool_stats pool{};
+	size_t groups = servers_.size();
+	for (size_t i = 0; i < groups && pools_; ++i) {
+		work_stealing_pool* group = pools_[i];
+		if (!group) {
+			continue;
+		}
+		pool_stats stats = group->stats();
+		pool.threads += stats.threads;
+		pool.min_threads += stats.min_threads;
+		pool.max_threads += stats.max_threads;
+		pool.queued += stats.queued;
+		pool.completed += stats.completed;
+		pool.rejected += stats.rejected;
+		pool.grow_events += stats.grow_events;
+		pool.shrink_events += stats.shrink_events;
+		pool.max_wait_us = std::max(pool.max_wait_us, stats.max_wait_us);
+		pool.bulk_threads += stats.bulk_threads;
+	}
+	return pool;
+}
+
+void http_server::handle_stats_request(const httplib::Request& req, httplib::Response& res) {
+	if (!check_admin_password(req)) {
+		res.status = 403;
+		res.set_content("Password wrong", "text/plain");
+		return;
+	}
+	pool_stats pool = total_pool_stats();
+	size_t groups = servers_.size();
+
+	std::ostringstream oss;
+	oss << "{\"listeners\":" << groups
+		<< ",\"thread_pool\":{"
+		<< "\"threads\":" << pool.threads
+		<< ",\"min_threads\":" << pool.min_threads
+		<< ",\"max_threads\":" << pool.max_threads
+		<< ",\"queued\":" << pool.queued
+		<< ",\"completed\":" << pool.completed
+		<< ",\"rejected\":" << pool.rejected
+		<< ",\"grow_events\":" << pool.grow_events
+		<< ",\"shrink_events\":" << pool.shrink_events
+		<< ",\"max_wait_us\":" << pool.max_wait_us
+		<< ",\"bulk_threads\":" << pool.bulk_threads
+		<< "}";
+	admission_stats admission = admission_->stats();
+	oss << ",\"admission\":{"
+		<< "\"overloaded\":" << (admission.overloaded ? "true" : "false")
+		<< ",\"min_delay_us\":" << admission.min_delay_us
+		<< ",\"shed_bulk\":" << admission.shed_bulk
+		<< ",\"shed_interactive\":" << admission.shed_interactive
+		<< "}";
+	request_lane_stats lanes = lanes_->stats();
+	oss << ",\"bulk\":{"
+		<< "\"active\":" << lanes.bulk_active
+		<< ",\"queued\":" << lanes.bulk_queued
+		<< ",\"admitted\":" << lanes.bulk_admitted
+		<< ",\"rejected\":" << lanes.bulk_rejected
+		<< "}";
+	directory_cache_stats listing = listing_cache_->stats();
+	oss << ",\"listing_cache\":{"
+		<< "\"hits\":" << listing.hits
+		<< ",\"misses\":" << listing.misses
+		<< ",\"invalidations\":" << listing.invalidations
+		<< ",\"cached_directories\":" << listing.cached_directories
+		<< "}";
+	trash_stats trash = file_manager_->trash().stats();
+	oss << ",\"trash\":{"
+		<< "\"items\":" << trash.items
+		<< ",\"bytes\":" << trash.bytes
+		<< ",\"pending_moves\":" << trash.pending_moves
+		<< ",\"purged_items\":" << trash.purged_items
+		<< ",\"purged_bytes\":" << trash.purged_bytes
+		<< "}";
+	bandwidth_stats bandwidth = bandwidth_->stats();
+	oss << ",\"bandwidth\":{"
+		<< "\"active_transfers\":" << bandwidth.active_transfers
+		<< ",\"active_clients\":" << bandwidth.active_clients
+		<< ",\"bytes\":" << bandwidth.bytes
+		<< ",\"throttled_ms\":" << bandwidth.throttled_ms
+		<< "}";
+	if (file_manager_->store()) {
+		content_store_stats store = file_manager_->store()->stats();
+		oss << ",\"content_store\":{"
+			<< "\"objects\":" << store.objects
+			<< ",\"bytes\":" << store.bytes
+			<< ",\"references\":" << store.references
+			<< ",\"dedup_hits\":" << store.dedup_hits
+			<< ",\"saved_bytes\":" << store.saved_bytes
+			<< ",\"collected_objects\":" << store.collected_objects
+			<< "}";
+	}
+	if (search_index_) {
+		search_index_stats search = search_index_->stats();
+		oss << ",\"search_index\":{"
+			<< "\"ready\":" << (search.ready ? "true" : "false")
+			<< ",\"files\":" << search.files
+			<< ",\"directories\":" << search.directories
+			<< ",\"watches\":" << search.watches
+			<< ",\"watch_failures\":" << search.watch_failures
+			<< ",\"rebuilds\":" << search.rebuilds
+			<< "}";
+	}
+	if (tls_sessions_) {
+		tls_session_stats tls = tls_sessions_->stats();
+		oss << ",\"tls\":{"
+			<< "\"full_handshakes\":" << tls.full_handshakes
+			<< ",\"resumed_handshakes\":" << tls.resumed_handshakes
+			<< ",\"cache_hits\":" << tls.cache_hits
+			<< ",\"cache_misses\":" << tls.cache_misses
+			<< ",\"cached_sessions\":" << tls.cached_sessions
+			<< ",\"ticket_key_rotations\":" << tls.ticket_key_rotations
+			<< "}";
+		ktls_stats ktls = tls_server::stats();
+		oss << ",\"ktls\":{"
+			<< "\"ktls_connections\":" << ktls.ktls_connections
+			<< ",\"userspace_connections\":" << ktls.userspace_connections
+			<< ",\"sendfile_bytes\":" << ktls.sendfile_bytes
+			<< "}";
+	}
+	oss << "}";
+	res.status = 200;
+	res.set_header("Cache-Control", "no-store");
+	res.set_content(oss.str(), "application/json");
+}
+
+void http_server::handle_reload_request(const httplib::Request& req, httplib::Response& res) {
+	if (!check_admin_password(req)) {
+		res.status = 403;
+		res.set_content("Password wrong", "text/plain");
+		return;
+	}
+	if (!reload_config()) {
+		res.status = 500;
+		res.set_content("Failed to reload configuration", "text/plain");
+		return;
+	}
+	res.status = 200;
+	res.set_header("Cache-Control", "no-store");
+	res.set_content("{\"generation\":" + std::to_string(config_manager::instance().generation()) + "}", "application/json");
+}
+
+void http_server::handle_search_request(const httplib::Request& req, httplib::Response& res) {
+	if (!search_index_) {
+		res.status = 404;
+		res.set_content("Search is disabled", "text/plain");
+		return;
+	}
+	std::string query = req.get_param_value("q");
+	if (query.empty()) {
+		res.status = 400;
+		res.set_content("No query provided.", "text/plain");
+		return;
+	}
+	// 首次扫描完成前没有可用的索引
+	if (!search_index_->stats().ready) {
+		res.status = 503;
+		res.set_header("Retry-After", "1");
+		res.set_content("Search index is building", "text/plain");
+		return;
+	}
+
+	size_t limit = 100;
+	if (req.has_param("limit")) {
+		limit = std::min<size_t>(std::strtoull(req.get_param_value("limit").c_str(), nullptr, 10), 1000);
+	}
+	bool prefix = req.get_param_value("mode") == "prefix";
+	bool truncated = false;
+	auto results = search_index_->search(query, prefix, req.get_param_value("path"), limit, truncated);
+
+	std::ostringstream oss;
+	oss << "{\"query\":\"" << json_escape(query) << "\",\"results\":[";
+	for (size_t i = 0; i < results.size(); ++i) {
+		oss << (i == 0 ? "" : ",")
+			<< "{\"path\":\"" << json_escape(results[i].path)
+			<< "\",\"type\":\"" << (results[i].is_directory ? "directory" : "file") << "\"}";
+	}
+	oss << "],\"truncated\":" << (truncated ? "true" : "false") << "}";
+	res.status = 200;
+	res.set_header("Cache-Control", "no-store");
+	res.set_content(oss.str(), "application/json");
+}
+
+void http_server::handle_trash_list_request(const httplib::Request& req, httplib::Response& res) {
+	if (!check_admin_password(req)) {
+		res.status = 403;
+		res.set_content("Password wrong", "text/plain");
+		return;
+	}
+	auto items = file_manager_->trash().list();
+	std::ostringstream oss;
+	oss << "{\"items\":[";
+	for (size_t i = 0; i < items.size(); ++i) {
+		const trash_item& item = items[i];
+		oss << (i == 0 ? "" : ",")
+			<< "{\"id\":\"" << json_escape(item.id)
+			<< "\",\"path\":\"" << json_escape(item.original_path)
+			<< "\",\"deleted_at\":" << item.deleted_at
+			<< ",\"size\":" << item.size
+			<< ",\"pending\":" << (item.staging_path.empty() ? "false" : "true") << "}";
+	}
+	oss << "]}";
+	res.status = 200;
+	res.set_header("Cache-Control", "no-store");
+	res.set_content(oss.str(), "application/json");
+}
+
+void http_server::handle_trash_restore_request(const httplib::Request& req, httplib::Response& res) {
+	if (!check_admin_password(req)) {
+		res.status = 403;
+		res.set_content("Password wrong", "text/plain");
+		return;
+	}
+	switch (file_manager_->restore_file(req.get_param_value("id"))) {
+		case restore_result::restored:
+			res.status = 200;
+			res.set_content("File restored successfully", "text/plain");
+			break;
+		case restore_result::not_found:
+			res.status = 404;
+			res.set_content("Item not found in trash", "text/plain");
+			break;
+		case restore_result::pending:
+			res.status = 409;
+			res.set_header("Retry-After", "5");
+			res.set_content("Item is still being moved to trash", "text/plain");
+			break;
+		case restore_result::conflict:
+			res.status = 409;
+			res.set_content("Original location is occupied", "text/plain");
+			break;
+		case restore_result::unknown_origin:
+			res.status = 409;
+			res.set_content("Original location unknown", "text/plain");
+			break;
+		case restore_result::failed:
+			res.status = 500;
+			res.set_content("Restore failed", "text/plain");
+			break;
+	}
+}
+
+static void write_job(std::ostringstream& oss, const file_job_status& job) {
+	oss << "{\"id\":" << job.id
+		<< ",\"operation\":\"" << job.operation
+		<< "\",\"source\":\"" << json_escape(job.source)
+		<< "\",\"destination\":\"" << json_escape(job.destination)
+		<< "\",\"state\":\"" << file_job_state_name(job.state)
+		<< "\",\"total_bytes\":" << job.total_bytes
+		<< ",\"done_bytes\":" << job.done_bytes
+		<< ",\"files\":" << job.files
+		<< ",\"cloned_files\":" << job.cloned_files
+		<< ",\"error\":\"" << json_escape(job.error) << "\"}";
+}
+
+void http_server::handle_jobs_request(const httplib::Request& req, httplib::Response& res) {
+	if (!check_admin_password(req)) {
+		res.status = 403;
+		res.set_content("Password wrong", "text/plain");
+		return;
+	}
+	std::ostringstream oss;
+	if (req.has_param("id")) {
+		file_job_status job;
+		if (!file_jobs_->status(std::strtoull(req.get_param_value("id").c_str(), nullptr, 10), job)) {
+			res.status = 404;
+			res.set_content("Job not found", "text/plain");
+			return;
+		}
+		write_job(oss, job);
+	} else {
+		auto jobs = file_jobs_->list();
+		oss << "{\"jobs\":[";
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			oss << (i == 0 ? "" : ",");
+			write_job(oss, jobs[i]);
+		}
+		oss << "]}";
+	}
+	res.status = 200;
+	res.set_header("Cache-Control", "no-store");
+	res.set_content(oss.str(), "application/json");
+}
+
+void http_server::handle_cloud_drive_request(const httplib::Request& req, httplib::Response& res) {
+    // 云盘特殊处理，对于cloud-drive目录和其所有子目录都返回cloud-drive.html
+    if (file_manager_->is_directory(file_manager_->sanitize_path(req.path))) {
+        logger_->log(logger::level::info, "Client is visiting a directory but in cloud drive.");
+        ++(*visitors_cnt_);
+        handle_file_request(req, res, "/cloud-drive.html");
+        return;
+    }
+    handle_file_request(req, res);
+}
+
 void http_server::handle_file_request(const httplib::Request& req, httplib::Response& res) {
+    handle_file_request(req, res, req.path);
+}
+
+void http_server::handle_file_request(const httplib::Request& req, httplib::Response& res, const std::string& request_path) {
+    // 整个请求使用同一份配置快照
+    const auto config = current_config();
     try {
-        std::string path = req.path;
+        std::string path = request_path;
 
         // 处理查询参数
         size_t param_pos = path.find('?');
@@ -219,14 +1139,6 @@ void http_server::handle_file_request(const httplib::Request& req, httplib::Resp
         
         std::string safe_path = file_manager_->sanitize_path(path);
 
-		// 云盘特殊处理，对于cloud-drive目录和其所有子目录都返回cloud-drive.html
-		if(path.find("/cloud-drive") != std::string::npos && fs::is_directory(safe_path)) {
-			logger_->log(logger::level::info, "Client is visiting a directory but in cloud drive.");
-			++(*visitors_cnt_);
-			path = "/cloud-drive.html";
-			safe_path = file_manager_->sanitize_path(path);
-		}
-
         if (file_manager_->is_directory(safe_path)) {
 			std::string index_path = safe_path + "/index.html";
 			if (file_manager_->file_exists(index_path)) {
@@ -258,57 +1170,39 @@ void http_server::handle_file_request(const httplib::Request& req, httplib::Resp
         size_t file_size = file_manager_->get_file_size(safe_path);
         std::string content_type = file_manager_->get_content_type(safe_path);
         auto accept_encoding = req.get_header_value("Accept-Encoding");
+        
+        file_digests digests;
+        if (file_manager_->get_digests(safe_path, digests) && apply_digests(req, res, digests)) {
+            res.status = 304;
+            return;
+        }
 
         // 处理Range请求
         auto range_header = req.get_header_value("Range");
         if (!range_header.empty()) {
-            // 解析Range头
-            std::string range_str = range_header.substr(6); // "bytes="
-            size_t dash_pos = range_str.find('-');
-            size_t start = 0;
-            size_t end = file_size - 1;
-            
-            if (dash_pos != std::string::npos) {
-                std::string start_str = range_str.substr(0, dash_pos);
-                std::string end_str = range_str.substr(dash_pos + 1);
-                
-                if (!start_str.empty()) {
-                    start = std::stoull(start_str);
-                }
-                if (!end_str.empty()) {
-                    end = std::stoull(end_str);
-                }
-            }
-			logger_->log(logger::level::info, "Range: " + std::to_string(start) + "-" + std::to_string(end));
-            
-            if (start >= file_size || end >= file_size || start > end) {
-                res.status = 416;
-                res.set_header("Content-Range", "bytes */" + std::to_string(file_size));
-                return;
-            }
+			logger_->log(logger::level::info, "Range: " + range_header);
+            // 区间的解析、校验以及Content-Range均交由httplib处理
             
             // 对于大文件使用分块下载
-            if (file_size > buffer_chunk_size_) {
+            if (file_size > config->buffer_chunk_size) {
                 handle_chunked_download(safe_path, req, res);
                 return;
             }
             
-            // 小文件直接读取范围
+            // 小文件整体读取，由httplib截取所需区间
             std::string content;
-            file_manager_->read_file_range(safe_path, start, end, content);
+            file_manager_->read_file(safe_path, content);
             res.status = 206;
-            res.set_header("Content-Range", "bytes " + std::to_string(start) + "-" + 
-                          std::to_string(end) + "/" + std::to_string(file_size));
             res.set_header("Accept-Ranges", "bytes");
             res.set_content(content, content_type);
             return;
         }
         
         // 对于大文件使用分块下载
-        if (file_size > buffer_chunk_size_) {
-			if(cache_max_age_ != 0) {
-				logger_->log(logger::level::info, "Cache enabled. Max age: " + std::to_string(cache_max_age_));
-				res.set_header("Cache-Control", "public, max-age=" + std::to_string(cache_max_age_));
+        if (file_size > config->buffer_chunk_size) {
+			if(config->cache_max_age != 0) {
+				logger_->log(logger::level::info, "Cache enabled. Max age: " + std::to_string(config->cache_max_age));
+				res.set_header("Cache-Control", "public, max-age=" + std::to_string(config->cache_max_age));
 			}
             handle_chunked_download(safe_path, req, res);
             return;
@@ -318,13 +1212,27 @@ void http_server::handle_file_request(const httplib::Request& req, httplib::Resp
         std::string content;
         file_manager_->read_file(safe_path, content);
         
-        // Gzip压缩
-        if (should_compress(safe_path, content.size(), accept_encoding)) {
+        // Gzip压缩，级别随负载调整，过载时不压缩
+        bool compress = should_compress(safe_path, content.size(), accept_encoding);
+        int level = gzip_compressor::DEFAULT_LEVEL;
+        if (compress && config->gzip_adaptive) {
+            pool_stats pool = total_pool_stats();
+            level = compressor_->choose_level(content.size(), pool.queued, pool.threads);
+            compress = level != 0;
+        }
+        if (compress) {
             std::string compressed;
-            if (compressor_->compress(content, compressed)) {
-                res.set_content(compressed, content_type);
+            if (compressor_->compress(content, compressed, level)) {
+                size_t compressed_size = compressed.size();
+                res.set_content(std::move(compressed), content_type);
                 res.set_header("Content-Encoding", "gzip");
-				logger_->log(logger::level::info, "Gzip enabled. Compressed file size: " + std::to_string(compressed.size()));
+                // 摘要是未压缩内容的，压缩后的表示只能用弱ETag
+                if (res.has_header("ETag")) {
+                    res.headers.erase("Digest");
+                    res.headers.erase("ETag");
+                    res.set_header("ETag", "W/\"" + digests.sha256 + "\"");
+                }
+				logger_->log(logger::level::info, "Gzip enabled. Level: " + std::to_string(level) + ", compressed file size: " + std::to_string(compressed_size));
             } else {
                 res.set_content(content, content_type);
             }
@@ -373,6 +1281,11 @@ void http_server::handle_head_request(const httplib::Request& req, httplib::Resp
         res.set_header("Content-Type", content_type);
         res.set_header("Content-Length", std::to_string(file_size));
         res.set_header("Accept-Ranges", "bytes");
+        file_digests digests;
+        if (file_manager_->get_digests(safe_path, digests) && apply_digests(req, res, digests)) {
+            res.status = 304;
+            return;
+        }
         
         // 处理Range请求头
         auto range_header = req.get_header_value("Range");
@@ -418,56 +1331,45 @@ void http_server::handle_chunked_download(const std::string& path, const httplib
         size_t file_size = file_manager_->get_file_size(path);
         std::string content_type = file_manager_->get_content_type(path);
         
-        // 解析Range头
-        size_t start = 0;
-        size_t end = file_size - 1;
-        
-        auto range_header = req.get_header_value("Range");
-        if (!range_header.empty()) {
-            std::string range_str = range_header.substr(6); // "bytes="
-            size_t dash_pos = range_str.find('-');
-            
-            if (dash_pos != std::string::npos) {
-                std::string start_str = range_str.substr(0, dash_pos);
-                std::string end_str = range_str.substr(dash_pos + 1);
-                
-                if (!start_str.empty()) {
-                    start = std::stoull(start_str);
-                }
-                if (!end_str.empty()) {
-                    end = std::stoull(end_str);
-                }
-            }
+        // 整个下载过程复用同一个fd，响应结束时关闭
+        int fd = file_manager_->open_file(path);
+        if (fd < 0) {
+            res.status = 404;
+            res.set_content("404 Not Found", "text/plain");
+            return;
         }
         
-        // 设置响应头
-        res.status = range_header.empty() ? 200 : 206;
-        res.set_header("Content-Type", content_type);
+        // 设置响应头，Range由httplib换算成offset后传给content provider
+        res.status = req.ranges.empty() ? 200 : 206;
         res.set_header("Accept-Ranges", "bytes");
         
-        if (!range_header.empty()) {
-            res.set_header("Content-Range", "bytes " + std::to_string(start) + "-" + 
-                          std::to_string(end) + "/" + std::to_string(file_size));
-        }
-        
         // 使用Content Provider分块发送内容
-        size_t chunk_size = buffer_chunk_size_;
-        size_t total_size = end - start + 1;
+        size_t chunk_size = current_config()->buffer_chunk_size;
+        // 启用限速时每次只发送调度器放行的量。按连接的对端地址分组：转发头由客户端随意填写，不能作为依据
+        std::shared_ptr<bandwidth_transfer> transfer = bandwidth_->start(req.remote_addr);
         
         res.set_content_provider(
-            total_size,
+            file_size,
             content_type.c_str(),
-            [this, path, start, total_size, chunk_size](size_t offset, size_t length, httplib::DataSink &sink) {
-				(void)length;
-                size_t read_start = start + offset;
-                size_t read_end = std::min(read_start + chunk_size - 1, start + total_size - 1);
-                
-                std::string chunk;
-                if (file_manager_->read_file_range(path, read_start, read_end, chunk)) {
-                    sink.write(chunk.data(), chunk.size());
-                    return true;
+            [this, fd, chunk_size, transfer](size_t offset, size_t length, httplib::DataSink &sink) {
+                if (transfer) {
+                    length = transfer->acquire(std::min(length, chunk_size));
+                    if (length == 0) {
+                        // HTTP/2连接上被推迟，稍后再来
+                        return true;
+                    }
+                }
+                // HTTPS连接已启用kTLS时由内核直接从页缓存加密发送
+                if (tls_server::can_send_file()) {
+                    return tls_server::send_file(sink, fd, offset, length);
                 }
-                return false;
+                size_t read_length = std::min(length, chunk_size);
+                return file_manager_->read_range(fd, offset, read_length, [&sink](const char* data, size_t size) {
+                    return sink.write(data, size);
+                });
+            },
+            [fd](bool) {
+                close(fd);
             }
         );
         
@@ -481,7 +1383,7 @@ void http_server::handle_chunked_download(const std::string& path, const httplib
 void http_server::handle_upload_request(const httplib::Request& req, httplib::Response& res) {
     try {
 		std::string password = req.get_param_value("password");
-		if(password != admin_password_) {
+		if(password != current_config()->admin_password) {
 			res.status = 403;
 			res.set_content("Password wrong", "text/plain");
 			return;
@@ -498,13 +1400,7 @@ void http_server::handle_upload_request(const httplib::Request& req, httplib::Re
             if (req.form.has_file("file")) {
                 const auto& file = req.form.get_file("file");
                 if (!file.content.empty()) {
-                    std::string file_path = safe_path + "/" + file.filename;
-                    if (file_manager_->write_file(file_path, file.content)) {
-                        res.set_content("Upload successful: " + file.filename, "text/plain");
-                    } else {
-                        res.status = 500;
-                        res.set_content("Upload failed: " + file.filename, "text/plain");
-                    }
+                    store_upload(req, res, safe_path + "/" + file.filename, file.filename, file.content);
                 } else {
                     res.status = 400;
                     res.set_content("Empty file content", "text/plain");
@@ -515,16 +1411,11 @@ void http_server::handle_upload_request(const httplib::Request& req, httplib::Re
             }
         } else {
             // 处理非 multipart 的情况（原始请求体）
-            if (!req.body.empty()) {
+            if (!req.body.empty() || !upload_digest(req).empty()) {
                 // 从路径中提取文件名或使用默认名称
-                std::string filename = "upload_" + std::to_string(std::time(nullptr));
-                std::string file_path = safe_path + "/" + filename;
-                if (file_manager_->write_file(file_path, req.body)) {
-                    res.set_content("Upload successful: " + filename, "text/plain");
-                } else {
-                    res.status = 500;
-                    res.set_content("Upload failed", "text/plain");
-                }
+                std::string filename = req.has_param("filename") ? req.get_param_value("filename")
+                                                                 : "upload_" + std::to_string(std::time(nullptr));
+                store_upload(req, res, safe_path + "/" + filename, filename, req.body);
             } else {
                 res.status = 400;
                 res.set_content("No file content provided", "text/plain");
@@ -538,10 +1429,69 @@ void http_server::handle_upload_request(const httplib::Request& req, httplib::Re
     }
 }
 
+void http_server::store_upload(const httplib::Request& req, httplib::Response& res,
+                               const std::string& file_path, const std::string& filename, const std::string& content) {
+    // 客户端声明的摘要针对整个请求体，multipart中的文件部分不核对
+    bool whole_body = !req.is_multipart_form_data();
+    std::string digest = whole_body ? upload_digest(req) : "";
+    if (!digest.empty() && !content_store::valid_digest(digest)) {
+        res.status = 400;
+        res.set_content("Invalid SHA-256 digest", "text/plain");
+        return;
+    }
+    
+    // 只带摘要不带内容：存储中已有该内容时直接链接，否则让客户端再上传内容
+    if (content.empty() && !digest.empty()) {
+        if (file_manager_->link_content(file_path, digest)) {
+            res.set_content("Upload successful: " + filename, "text/plain");
+        } else {
+            res.status = 404;
+            res.set_content("Content not found, upload the file body", "text/plain");
+        }
+        return;
+    }
+    
+    // 所有摘要在同一遍扫描中算出，SHA-256再交给去重存储，不必重复计算
+    std::string content_md5 = whole_body ? req.get_header_value("Content-MD5") : "";
+    auto claimed = whole_body ? claimed_digests(req) : std::map<std::string, std::string>();
+    checksum_stream checksums(!content_md5.empty() || claimed.count("md5"));
+    checksums.update(content.data(), content.size());
+    checksums.finish();
+    file_digests digests = checksums.digests();
+    
+    std::string mismatch;
+    if (!digest.empty() && digests.sha256 != digest) {
+        mismatch = "SHA-256";
+    } else if (!content_md5.empty() && checksums.md5_base64() != content_md5) {
+        mismatch = "Content-MD5";
+    }
+    for (const auto& item : claimed) {
+        if ((item.first == "sha-256" && item.second != checksums.sha256_base64()) ||
+            (item.first == "crc32c" && item.second != checksums.crc32c_base64()) ||
+            (item.first == "md5" && item.second != checksums.md5_base64())) {
+            mismatch = item.first;
+        }
+    }
+    if (!mismatch.empty()) {
+        res.status = 400;
+        res.set_content("Checksum mismatch: " + mismatch, "text/plain");
+        return;
+    }
+    
+    if (file_manager_->write_file(file_path, content, digests.sha256)) {
+        file_manager_->set_digests(file_path, digests);
+        res.set_header("Digest", digest_header_value(digests));
+        res.set_content("Upload successful: " + filename, "text/plain");
+    } else {
+        res.status = 500;
+        res.set_content("Upload failed: " + filename, "text/plain");
+    }
+}
+
 bool http_server::handle_chunked_upload(const httplib::Request& req, httplib::Response& res) {
     try {
 		std::string password = req.get_param_value("password");
-		if(password != admin_password_) {
+		if(password != current_config()->admin_password) {
 			res.status = 403;
 			res.set_content("Password wrong", "text/plain");
 			return false;
@@ -566,23 +1516,8 @@ bool http_server::handle_chunked_upload(const httplib::Request& req, httplib::Re
             filename = "upload_" + std::to_string(std::time(nullptr));
         }
         
-        std::string file_path = safe_path + "/" + filename;
-        
-        // 创建目录
-        file_manager_->create_directory(fs::path(file_path).parent_path().string());
-        
-        // 写入文件
-        std::ofstream file(file_path, std::ios::binary);
-        if (!file) {
-            res.status = 500;
-            res.set_content("Failed to create file", "text/plain");
-            return true;
-        }
-        
-        file.write(req.body.data(), req.body.size());
-        file.close();
-        
-        res.set_content("Upload successful: " + filename, "text/plain");
+        // 写入文件（自动创建目录）
+        store_upload(req, res, safe_path + "/" + filename, filename, req.body);
         return true;
         
     } catch (const std::exception& e) {
@@ -596,7 +1531,7 @@ bool http_server::handle_chunked_upload(const httplib::Request& req, httplib::Re
 void http_server::handle_delete_request(const httplib::Request& req, httplib::Response& res) {
     try {
 		std::string password = req.get_param_value("password");
-		if(password != admin_password_) {
+		if(password != current_config()->admin_password) {
 			res.status = 403;
 			res.set_content("Password wrong", "text/plain");
 			return;
@@ -621,7 +1556,7 @@ void http_server::handle_delete_request(const httplib::Request& req, httplib::Re
 void http_server::handle_mkdir_request(const httplib::Request& req, httplib::Response& res) {
     try {
 		std::string password = req.get_param_value("password");
-		if(password != admin_password_) {
+		if(password != current_config()->admin_password) {
 			res.status = 403;
 			res.set_content("Password wrong", "text/plain");
 			return;
@@ -643,25 +1578,437 @@ void http_server::handle_mkdir_request(const httplib::Request& req, httplib::Res
     }
 }
 
+http_server::operation_result http_server::start_transfer(const std::string& operation, const std::string& source_path,
+                                                          const std::string& dest_path) {
+    std::string root = file_manager_->sanitize_path("/");
+    std::string source = file_manager_->sanitize_path(source_path);
+    std::string dest = file_manager_->sanitize_path(dest_path);
+    
+    if (source == root || trash_manager::is_staging_path(source) || !fs::exists(fs::symlink_status(source))) {
+        return {404, "File not found"};
+    }
+    if (dest == root || trash_manager::is_staging_path(dest) || dest == source || dest.compare(0, source.size() + 1, source + "/") == 0) {
+        return {400, "Invalid destination"};
+    }
+    if (fs::exists(fs::symlink_status(dest))) {
+        return {409, "Destination exists"};
+    }
+    
+    // 同一文件系统内的移动只是一次rename，直接完成
+    if (operation == "move") {
+        if (file_manager_->move_file(source, dest)) {
+            return {200, "File moved successfully"};
+        }
+        if (errno == EEXIST || errno == ENOTEMPTY) {
+            return {409, "Destination exists"};
+        }
+        if (errno != EXDEV) {
+            return {500, "Move failed: " + std::string(std::strerror(errno))};
+        }
+    }
+    
+    uint64_t id = file_jobs_->submit(operation, source, dest, source.substr(root.size()), dest.substr(root.size()));
+    return {202, std::to_string(id)};
+}
+
+void http_server::handle_transfer_request(const httplib::Request& req, httplib::Response& res, const std::string& operation) {
+    try {
+		std::string password = req.get_param_value("password");
+		if(password != current_config()->admin_password) {
+			res.status = 403;
+			res.set_content("Password wrong", "text/plain");
+			return;
+		}
+        if (!req.has_param("dest")) {
+            res.status = 400;
+            res.set_content("No destination provided.", "text/plain");
+            return;
+        }
+        
+        operation_result result = start_transfer(operation, req.path, req.get_param_value("dest"));
+        res.status = result.status;
+        if (result.status == 202) {
+            // 后台任务，返回任务号
+            res.set_header("Location", "/api/jobs?id=" + result.message);
+            res.set_content("{\"job\":" + result.message + "}", "application/json");
+        } else {
+            res.set_content(result.message, "text/plain");
+        }
+        
+    } catch (const std::exception& e) {
+        logger_->log(logger::level::error, "Transfer error: " + std::string(e.what()));
+        res.status = 500;
+        res.set_content("Transfer failed", "text/plain");
+    }
+}
+
+http_server::operation_result http_server::run_batch_operation(const std::string& line) {
+    std::vector<std::string> fields = split_batch_line(line);
+    const std::string& op = fields[0];
+    try {
+        if ((op == "copy" || op == "move") && fields.size() == 3) {
+            return start_transfer(op, fields[1], fields[2]);
+        }
+        if (fields.size() != 2) {
+            return {400, "Malformed operation"};
+        }
+        std::string safe_path = file_manager_->sanitize_path(fields[1]);
+        if (trash_manager::is_staging_path(safe_path)) {
+            return {404, "File not found"};
+        }
+        if (op == "delete") {
+            return file_manager_->delete_file(safe_path) ? operation_result{200, "File deleted successfully"}
+                                                         : operation_result{404, "File not found"};
+        }
+        if (op == "mkdir") {
+            return file_manager_->create_directory(safe_path) ? operation_result{200, "Directory created successfully"}
+                                                              : operation_result{500, "Failed to create directory"};
+        }
+        return {400, "Unknown operation"};
+    } catch (const std::exception& e) {
+        return {500, e.what()};
+    }
+}
+
+// 涉及相同路径或互为上下级路径的操作归为一组，组内保持请求中的顺序；
+// 每组按首个操作的位置排列
+std::vector<std::vector<size_t>> http_server::group_batch_operations(const std::vector<std::string>& lines) const {
+    std::vector<std::vector<std::string>> paths(lines.size());
+    std::unordered_map<std::string, size_t> owner;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::vector<std::string> fields = split_batch_line(lines[i]);
+        for (size_t f = 1; f < fields.size(); ++f) {
+            std::string path;
+            try {
+                path = file_manager_->sanitize_path(fields[f]);
+            } catch (const std::exception&) {
+                continue;
+            }
+            owner.emplace(path, i);
+            paths[i].push_back(std::move(path));
+        }
+    }
+
+    std::vector<size_t> parent(lines.size());
+    for (size_t i = 0; i < parent.size(); ++i) {
+        parent[i] = i;
+    }
+    auto find = [&parent](size_t i) {
+        while (parent[i] != i) {
+            i = parent[i] = parent[parent[i]];
+        }
+        return i;
+    };
+    // 逐级检查路径本身及其各级上级目录是否也出现在其他操作中
+    for (size_t i = 0; i < lines.size(); ++i) {
+        for (const std::string& path : paths[i]) {
+            for (size_t end = path.size(); end != std::string::npos && end > 0; end = path.rfind('/', end - 1)) {
+                auto it = owner.find(path.substr(0, end));
+                if (it != owner.end()) {
+                    size_t a = find(i), b = find(it->second);
+                    parent[std::max(a, b)] = std::min(a, b);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<size_t>> groups;
+    std::vector<size_t> group_of(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+        size_t root = find(i);
+        if (root == i) {
+            group_of[i] = groups.size();
+            groups.emplace_back();
+        }
+        groups[group_of[root]].push_back(i);
+    }
+    return groups;
+}
+
+void http_server::handle_batch_request(const httplib::Request& req, httplib::Response& res) {
+	const auto config = current_config();
+	if (!check_admin_password(req)) {
+		res.status = 403;
+		res.set_content("Password wrong", "text/plain");
+		return;
+	}
+	// 请求体(Content-Type: text/plain)每行一个操作，字段以制表符分隔：
+	// delete<TAB>路径 / mkdir<TAB>路径 / copy<TAB>源<TAB>目标 / move<TAB>源<TAB>目标
+	// 涉及相同路径或互为上下级路径的操作(如先mkdir a再move x a/x)按请求中的顺序依次执行，其余操作并行执行。
+	// copy与跨文件系统的move转为后台任务(结果为任务号)，后续操作只保证在任务提交之后执行，不等待任务完成
+	std::vector<std::string> lines;
+	std::stringstream ss(req.body);
+	std::string line;
+	while (std::getline(ss, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty()) {
+			lines.push_back(line);
+		}
+	}
+	if (lines.empty()) {
+		res.status = 400;
+		res.set_content("No operations provided.", "text/plain");
+		return;
+	}
+	if (lines.size() > config->batch_max_operations) {
+		res.status = 413;
+		res.set_content("Too many operations", "text/plain");
+		return;
+	}
+
+	// 每组操作依次执行，各组之间由当前线程与共享的辅助线程并行执行；结果按请求中的顺序返回。
+	// 状态由shared_ptr持有：辅助线程可能在全部操作完成后才取到任务，此时直接返回
+	struct batch_state {
+		std::vector<std::string> lines;
+		std::vector<std::vector<size_t>> groups;
+		std::vector<operation_result> results;
+		std::atomic<size_t> next{0};
+		size_t done = 0;
+		std::mutex mutex;
+		std::condition_variable cv;
+	};
+	auto state = std::make_shared<batch_state>();
+	state->groups = group_batch_operations(lines);
+	state->lines = std::move(lines);
+	state->results.resize(state->lines.size());
+	auto worker = [this, state] {
+		size_t count = state->groups.size();
+		for (size_t g = state->next++; g < count; g = state->next++) {
+			for (size_t i : state->groups[g]) {
+				state->results[i] = run_batch_operation(state->lines[i]);
+			}
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (++state->done == count) {
+				state->cv.notify_all();
+			}
+		}
+	};
+	size_t concurrency = std::max<size_t>(1, std::min(config->batch_concurrency, state->groups.size()));
+	for (size_t i = 1; i < concurrency; ++i) {
+		batch_pool_->enqueue(worker);
+	}
+	worker();
+	{
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->cv.wait(lock, [&] { return state->done == state->groups.size(); });
+	}
+	const std::vector<operation_result>& results = state->results;
+
+	size_t failed = 0;
+	std::ostringstream oss;
+	oss << "{\"results\":[";
+	for (size_t i = 0; i < results.size(); ++i) {
+		bool ok = results[i].status < 300;
+		failed += ok ? 0 : 1;
+		oss << (i == 0 ? "" : ",") << "{\"status\":" << results[i].status;
+		if (results[i].status == 202) {
+			oss << ",\"job\":" << results[i].message;
+		} else {
+			oss << ",\"message\":\"" << json_escape(results[i].message) << "\"";
+		}
+		oss << "}";
+	}
+	oss << "],\"failed\":" << failed << "}";
+	logger_->log(logger::level::info, "Batch of " + std::to_string(results.size()) + " operations, " +
+				 std::to_string(failed) + " failed");
+	res.status = 200;
+	res.set_header("Cache-Control", "no-store");
+	res.set_content(oss.str(), "application/json");
+}
+
+void http_server::handle_archive_request(const httplib::Request& req, httplib::Response& res) {
+	const auto config = current_config();
+	try {
+		std::string safe_path = file_manager_->sanitize_path(req.path);
+		if (!file_manager_->is_directory(safe_path)) {
+			res.status = 404;
+			res.set_content("404 Not Found", "text/plain");
+			return;
+		}
+		fs::path dir = fs::path(safe_path).lexically_normal();
+		std::string name = dir.has_filename() ? dir.filename().string() : dir.parent_path().filename().string();
+		if (name.empty()) {
+			name = "archive";
+		}
+
+		// ZIP中文本类文件deflate，其余原样存储；compress=0时全部存储，以便断点续传
+		bool tar = req.get_param_value("format") == "tar";
+		bool deflate = !tar && req.get_param_value("compress") != "0";
+		auto stream = std::make_shared<archive_stream>(
+			safe_path, name, tar ? archive_format::tar : archive_format::zip,
+			[this, deflate](const std::string& path) { return deflate && is_compressible(path); },
+			config->buffer_chunk_size);
+
+		std::string filename = name + (tar ? ".tar" : ".zip");
+		std::replace(filename.begin(), filename.end(), '"', '_');
+		const char* content_type = tar ? "application/x-tar" : "application/zip";
+		res.set_header("Content-Disposition", "attachment; filename=\"" + filename + "\"");
+		res.set_header("Cache-Control", "no-store");
+		logger_->log(logger::level::info, "Streaming " + filename + " with " + std::to_string(stream->entries()) +
+					 " entries");
+
+		// 与大文件下载一样受带宽调度(按连接的对端地址分组)，每次只生成放行的量
+		std::shared_ptr<bandwidth_transfer> transfer = bandwidth_->start(req.remote_addr);
+		size_t chunk_size = config->buffer_chunk_size;
+
+		if (stream->sized()) {
+			// 布局确定，总长已知，Range由httplib换算成offset后按区间生成
+			res.status = req.ranges.empty() ? 200 : 206;
+			res.set_header("Accept-Ranges", "bytes");
+			res.set_content_provider(
+				stream->size(), content_type,
+				[stream, transfer, chunk_size](size_t offset, size_t length, httplib::DataSink& sink) {
+					size_t granted = 0;
+					if (transfer) {
+						granted = length = transfer->acquire(std::min(length, chunk_size));
+						if (length == 0) {
+							// HTTP/2连接上被推迟，稍后再来
+							return true;
+						}
+					}
+					size_t sent = 0;
+					bool ok = stream->read(offset, length, [&sink, &sent](const char* data, size_t size) {
+						sent += size;
+						return sink.write(data, size);
+					});
+					if (transfer) {
+						transfer->settle(granted, sent);
+					}
+					return ok;
+				});
+			return;
+		}
+		// deflate后的长度事先未知：先按一段的量放行，生成后按实际长度补扣
+		res.set_chunked_content_provider(content_type, [stream, transfer, chunk_size](size_t, httplib::DataSink& sink) {
+			size_t granted = 0;
+			if (transfer) {
+				granted = transfer->acquire(chunk_size);
+				if (granted == 0) {
+					return true;
+				}
+			}
+			size_t sent = 0;
+			bool done = false;
+			bool ok = stream->next([&sink, &sent](const char* data, size_t size) {
+				sent += size;
+				return sink.write(data, size);
+			}, done);
+			if (transfer) {
+				transfer->settle(granted, sent);
+			}
+			if (ok && done) {
+				sink.done();
+			}
+			return ok;
+		});
+	} catch (const std::exception& e) {
+		logger_->log(logger::level::error, "Archive error: " + std::string(e.what()));
+		res.status = 500;
+		res.set_content("Internal Server Error", "text/plain");
+	}
+}
+
 void http_server::handle_list_request(const httplib::Request& req, httplib::Response& res) {
     try {
         std::string path = req.path;
         std::string safe_path = file_manager_->sanitize_path(path);
         
-        if (!file_manager_->is_directory(safe_path)) {
+        auto listing = listing_cache_->get(safe_path, *file_manager_);
+        if (!listing) {
             res.status = 404;
             res.set_content("Directory not found", "text/plain");
             return;
         }
+        const auto& files = listing->entries();
         
-        auto files = file_manager_->list_directory(safe_path);
+        // 不带format=json时保持原来的纯文本格式，一次返回全部条目
+        if (req.get_param_value("format") != "json") {
+            std::ostringstream oss;
+            for (uint32_t index : listing->order(listing_sort::name, false)) {
+                oss << files[index].name << (files[index].is_directory ? "/" : "") << "\n";
+            }
+            res.set_content(oss.str(), "text/plain");
+            return;
+        }
+        
+        std::string sort_param = req.get_param_value("sort");
+        listing_sort sort = listing_sort::name;
+        if (sort_param == "size") {
+            sort = listing_sort::size;
+        } else if (sort_param == "mtime") {
+            sort = listing_sort::mtime;
+        } else if (!sort_param.empty() && sort_param != "name") {
+            res.status = 400;
+            res.set_content("Invalid sort", "text/plain");
+            return;
+        }
+        bool descending = req.get_param_value("order") == "desc";
+        
+        size_t limit = current_config()->listing_page_limit;
+        if (req.has_param("limit")) {
+            size_t requested = std::strtoull(req.get_param_value("limit").c_str(), nullptr, 10);
+            if (requested > 0 && (limit == 0 || requested < limit)) {
+                limit = requested;
+            }
+        }
+        
+        // 游标是上一页最后一项的排序键"<d|f>/<大小或时间>/<名称>"，按键定位而不是按序号，
+        // 翻页期间目录有增删也不会重复或漏掉未变化的条目。名称中不会有'/'
+        const auto& order = listing->order(sort, descending);
+        auto begin = order.begin();
+        std::string cursor = req.get_param_value("cursor");
+        if (!cursor.empty()) {
+            size_t key_end = cursor.find('/', 2);
+            if (cursor.size() < 3 || (cursor[0] != 'd' && cursor[0] != 'f') || cursor[1] != '/' ||
+                key_end == std::string::npos) {
+                res.status = 400;
+                res.set_content("Invalid cursor", "text/plain");
+                return;
+            }
+            file_info last{};
+            last.is_directory = cursor[0] == 'd';
+            last.name = cursor.substr(key_end + 1);
+            std::string key = cursor.substr(2, key_end - 2);
+            if (sort == listing_sort::size) {
+                last.size = std::strtoull(key.c_str(), nullptr, 10);
+            } else if (sort == listing_sort::mtime) {
+                last.last_modified = std::strtoll(key.c_str(), nullptr, 10);
+            }
+            begin = std::upper_bound(order.begin(), order.end(), last, [&](const file_info& value, uint32_t index) {
+                return directory_listing::before(value, files[index], sort, descending);
+            });
+        }
+        auto end = limit > 0 && static_cast<size_t>(order.end() - begin) > limit ? begin + limit : order.end();
         
         std::ostringstream oss;
-        for (const auto& file : files) {
-            oss << file.name << (file.is_directory ? "/" : "") << "\n";
+        oss << "{\"path\":\"" << json_escape(path) << "\",\"total\":" << files.size() << ",\"entries\":[";
+        for (auto it = begin; it != end; ++it) {
+            const file_info& file = files[*it];
+            oss << (it == begin ? "" : ",")
+                << "{\"name\":\"" << json_escape(file.name)
+                << "\",\"type\":\"" << (file.is_directory ? "directory" : "file")
+                << "\",\"size\":" << file.size
+                << ",\"mtime\":" << file.last_modified << "}";
+        }
+        oss << "],\"next_cursor\":";
+        if (end != order.end()) {
+            const file_info& last = files[*(end - 1)];
+            std::string key;
+            if (sort == listing_sort::size) {
+                key = std::to_string(last.size);
+            } else if (sort == listing_sort::mtime) {
+                key = std::to_string(last.last_modified);
+            }
+            oss << "\"" << json_escape(std::string(last.is_directory ? "d" : "f") + "/" + key + "/" + last.name) << "\"";
+        } else {
+            oss << "null";
         }
+        oss << "}";
         
-        res.set_content(oss.str(), "text/plain");
+        res.set_header("Cache-Control", "no-store");
+        res.set_content(oss.str(), "application/json");
         
     } catch (const std::exception& e) {
         logger_->log(logger::level::error, "List error: " + std::string(e.what()));
@@ -684,20 +2031,22 @@ std::string http_server::get_client_ip(const httplib::Request& req) const {
     return req.remote_addr;
 }
 
-bool http_server::should_compress(const std::string& path, size_t size, const std::string& accept_encoding) const {
-    // 只对文本文件和小于缓冲区块大小的文件进行压缩
+bool http_server::is_compressible(const std::string& path) const {
     static const std::vector<std::string> compressible_types = {
         "text/html", "text/css", "application/javascript", "application/json", 
         "application/xml", "text/plain", "image/svg+xml"
     };
     
     std::string content_type = file_manager_->get_content_type(path);
-    bool is_compressible = std::find(compressible_types.begin(), 
-                                   compressible_types.end(), 
-                                   content_type) != compressible_types.end();
-    
-    return is_compressible && 
-           size <= buffer_chunk_size_ && 
+    return std::find(compressible_types.begin(), 
+                     compressible_types.end(), 
+                     content_type) != compressible_types.end();
+}
+
+bool http_server::should_compress(const std::string& path, size_t size, const std::string& accept_encoding) const {
+    // 只对文本文件和小于缓冲区块大小的文件进行压缩
+    return is_compressible(path) && 
+           size <= current_config()->buffer_chunk_size && 
            compressor_->is_gzip_supported(accept_encoding);
 }
 
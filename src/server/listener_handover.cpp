@@ -0,0 +1,275 @@
+#include <to_https_server/server/listener_handover.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace to_https_server {
+
+static const char REQUEST[] = "UPGRADE";
+static const char CONFIRM[] = "OK";
+// 交接过程中单次等待对方的时间
+static const int HANDOVER_TIMEOUT_MS = 10000;
+static const size_t MAX_SOCKETS = 256;
+
+void stop_accepting_socket(std::atomic<int>& sock) {
+    int current = sock;
+    if (current < 0) {
+        return;
+    }
+    int placeholder = eventfd(0, EFD_CLOEXEC);
+    if (placeholder < 0) {
+        close_listening_socket(sock);
+        return;
+    }
+    dup2(placeholder, current);
+    close(placeholder);
+}
+
+void close_listening_socket(std::atomic<int>& sock) {
+    int current = sock.exchange(-1);
+    if (current >= 0) {
+        close(current);
+    }
+}
+
+struct handover_header {
+    uint32_t socket_count;
+    uint32_t state_size;
+};
+
+static bool make_address(const std::string& path, sockaddr_un& addr) {
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+static bool wait_readable(int fd) {
+    pollfd pfd{fd, POLLIN, 0};
+    int ret;
+    do {
+        ret = poll(&pfd, 1, HANDOVER_TIMEOUT_MS);
+    } while (ret < 0 && errno == EINTR);
+    return ret > 0;
+}
+
+static bool read_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        if (!wait_readable(fd)) {
+            return false;
+        }
+        ssize_t n = read(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+listener_handover::listener_handover(const std::string& path)
+    : path_(path), client_fd_(-1), listen_fd_(-1), running_(false), handed_over_(false) {}
+
+listener_handover::~listener_handover() {
+    stop();
+    if (client_fd_ >= 0) {
+        close(client_fd_);
+    }
+}
+
+bool listener_handover::acquire(std::vector<int>& sockets, std::string& state) {
+    sockaddr_un addr;
+    if (!make_address(path_, addr)) {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        !write_all(fd, REQUEST, sizeof(REQUEST)) || !wait_readable(fd)) {
+        close(fd);
+        return false;
+    }
+
+    // 套接字随头部一起到达
+    handover_header header{};
+    iovec iov{&header, sizeof(header)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_SOCKETS)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    std::vector<int> received;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            received.insert(received.end(), fds, fds + count);
+        }
+    }
+
+    bool ok = n == static_cast<ssize_t>(sizeof(header)) && !(msg.msg_flags & MSG_CTRUNC) &&
+              received.size() == header.socket_count && !received.empty();
+    std::string received_state;
+    if (ok) {
+        received_state.resize(header.state_size);
+        ok = header.state_size == 0 || read_all(fd, &received_state[0], header.state_size);
+    }
+    if (!ok) {
+        for (int socket : received) {
+            close(socket);
+        }
+        close(fd);
+        return false;
+    }
+
+    sockets = std::move(received);
+    state = std::move(received_state);
+    client_fd_ = fd;
+    return true;
+}
+
+void listener_handover::confirm() {
+    if (client_fd_ < 0) {
+        return;
+    }
+    write_all(client_fd_, CONFIRM, sizeof(CONFIRM));
+    close(client_fd_);
+    client_fd_ = -1;
+}
+
+bool listener_handover::serve(const std::vector<int>& sockets, std::function<std::string()> export_state,
+                              std::function<void()> on_handed_over) {
+    sockaddr_un addr;
+    if (running_ || !make_address(path_, addr) || sockets.empty() || sockets.size() > MAX_SOCKETS) {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    // 旧进程交出后不会删除路径，这里先删掉遗留的套接字文件
+    unlink(path_.c_str());
+    // 交接的状态中含TLS票据密钥，只允许本用户连接
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || chmod(path_.c_str(), 0600) != 0 ||
+        listen(fd, 1) != 0) {
+        close(fd);
+        return false;
+    }
+
+    listen_fd_ = fd;
+    sockets_ = sockets;
+    export_state_ = std::move(export_state);
+    on_handed_over_ = std::move(on_handed_over);
+    handed_over_ = false;
+    running_ = true;
+    thread_ = std::thread([this] { serve_loop(); });
+    return true;
+}
+
+void listener_handover::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    close(listen_fd_);
+    listen_fd_ = -1;
+    // 路径已交给新进程时不能删除
+    if (!handed_over_) {
+        unlink(path_.c_str());
+    }
+}
+
+void listener_handover::serve_loop() {
+    while (running_) {
+        // 定时醒来检查stop()
+        pollfd pfd{listen_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        bool done = hand_over(client);
+        close(client);
+        if (done) {
+            handed_over_ = true;
+            on_handed_over_();
+            return;
+        }
+    }
+}
+
+bool listener_handover::hand_over(int client) {
+    char request[sizeof(REQUEST)];
+    if (!read_all(client, request, sizeof(request)) || std::memcmp(request, REQUEST, sizeof(REQUEST)) != 0) {
+        return false;
+    }
+
+    std::string state = export_state_ ? export_state_() : std::string();
+    handover_header header{static_cast<uint32_t>(sockets_.size()), static_cast<uint32_t>(state.size())};
+    iovec iov{&header, sizeof(header)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_SOCKETS)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * sockets_.size());
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * sockets_.size());
+    std::memcpy(CMSG_DATA(cmsg), sockets_.data(), sizeof(int) * sockets_.size());
+
+    ssize_t n;
+    do {
+        n = sendmsg(client, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n != static_cast<ssize_t>(sizeof(header)) || !write_all(client, state.data(), state.size())) {
+        return false;
+    }
+
+    // 只有收到确认才算交接完成，否则本进程继续服务
+    char reply[sizeof(CONFIRM)];
+    return read_all(client, reply, sizeof(reply)) && std::memcmp(reply, CONFIRM, sizeof(CONFIRM)) == 0;
+}
+
+} // namespace to_https_server
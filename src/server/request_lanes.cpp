@@ -0,0 +1,64 @@
+#include <to_https_server/server/request_lanes.h>
+
+namespace to_https_server {
+
+request_lanes::request_lanes()
+    : bulk_slots_(0), bulk_queue_(0), queue_timeout_(0), active_(0), queued_(0), admitted_(0), rejected_(0) {}
+
+void request_lanes::configure(size_t bulk_slots, size_t bulk_queue, size_t queue_timeout_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bulk_slots_ = bulk_slots;
+    bulk_queue_ = bulk_queue;
+    queue_timeout_ = std::chrono::milliseconds(queue_timeout_ms);
+    // 名额增加时让排队的请求重新检查
+    released_.notify_all();
+}
+
+bool request_lanes::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bulk_slots_ > 0;
+}
+
+bool request_lanes::enter_bulk() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (active_ < bulk_slots_ && queued_ == 0) {
+        active_++;
+        admitted_++;
+        return true;
+    }
+    if (queued_ >= bulk_queue_) {
+        rejected_++;
+        return false;
+    }
+    // 按到达顺序等待不作保证，但名额总会有人取走
+    queued_++;
+    bool admitted = released_.wait_for(lock, queue_timeout_, [this] { return active_ < bulk_slots_; });
+    queued_--;
+    if (!admitted) {
+        rejected_++;
+        return false;
+    }
+    active_++;
+    admitted_++;
+    return true;
+}
+
+void request_lanes::leave_bulk() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (active_ > 0) {
+        active_--;
+    }
+    released_.notify_one();
+}
+
+request_lane_stats request_lanes::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    request_lane_stats result;
+    result.bulk_active = active_;
+    result.bulk_queued = queued_;
+    result.bulk_admitted = admitted_;
+    result.bulk_rejected = rejected_;
+    return result;
+}
+
+} // namespace to_https_server
@@ -0,0 +1,157 @@
+#include <to_https_server/server/router.h>
+#include <algorithm>
+
+namespace to_https_server {
+
+// 取出下一个非空路径分段，rest 同步前移
+static bool next_segment(std::string_view& rest, std::string_view& segment) {
+    while (!rest.empty() && rest.front() == '/') {
+        rest.remove_prefix(1);
+    }
+    if (rest.empty()) {
+        return false;
+    }
+    size_t pos = rest.find('/');
+    segment = rest.substr(0, pos);
+    rest.remove_prefix(pos == std::string_view::npos ? rest.size() : pos);
+    return true;
+}
+
+router::router() : root_(std::make_unique<node>()) {}
+
+router::node* router::node::child(std::string_view segment) const {
+    auto it = std::lower_bound(children.begin(), children.end(), segment,
+        [](const auto& entry, std::string_view key) { return std::string_view(entry.first) < key; });
+    if (it == children.end() || it->first != segment) {
+        return nullptr;
+    }
+    return it->second.get();
+}
+
+router::node* router::node::add_child(std::string_view segment) {
+    auto it = std::lower_bound(children.begin(), children.end(), segment,
+        [](const auto& entry, std::string_view key) { return std::string_view(entry.first) < key; });
+    if (it != children.end() && it->first == segment) {
+        return it->second.get();
+    }
+    it = children.emplace(it, std::string(segment), std::make_unique<node>());
+    return it->second.get();
+}
+
+router::method_id router::to_method_id(const std::string& method) {
+    if (method == "GET" || method == "HEAD") return method_get;
+    if (method == "POST") return method_post;
+    if (method == "PUT") return method_put;
+    if (method == "DELETE") return method_delete;
+    if (method == "OPTIONS") return method_options;
+    if (method == "PATCH") return method_patch;
+    return method_unknown;
+}
+
+router::node* router::insert(const std::string& path) {
+    node* current = root_.get();
+    std::string_view rest(path);
+    std::string_view segment;
+    while (next_segment(rest, segment)) {
+        current = current->add_child(segment);
+    }
+    return current;
+}
+
+router& router::add(const std::string& method, const std::string& path, handler h) {
+    method_id id = to_method_id(method);
+    if (id != method_unknown) {
+        insert(path)->exact[id] = std::move(h);
+    }
+    return *this;
+}
+
+router& router::add_prefix(const std::string& method, const std::string& path, handler h) {
+    method_id id = to_method_id(method);
+    if (id != method_unknown) {
+        insert(path)->prefix[id] = std::move(h);
+    }
+    return *this;
+}
+
+router& router::add_action(const std::string& method, const std::string& action, handler h) {
+    method_id id = to_method_id(method);
+    if (id != method_unknown) {
+        actions_[id][action] = std::move(h);
+    }
+    return *this;
+}
+
+router& router::set_fallback(const std::string& method, handler h) {
+    method_id id = to_method_id(method);
+    if (id != method_unknown) {
+        fallback_[id] = std::move(h);
+    }
+    return *this;
+}
+
+const router::handler* router::find(const httplib::Request& req) const {
+    method_id id = to_method_id(req.method);
+    if (id == method_unknown) {
+        return nullptr;
+    }
+
+    // 操作优先于路径
+    if (!actions_[id].empty()) {
+        auto param = req.params.find("param");
+        if (param != req.params.end()) {
+            auto it = actions_[id].find(param->second);
+            if (it != actions_[id].end()) {
+                return &it->second;
+            }
+        }
+    }
+
+    // 沿路径下行，记录最深的前缀匹配，完整匹配优先
+    const handler* matched = root_->prefix[id] ? &root_->prefix[id] : nullptr;
+    const node* current = root_.get();
+    std::string_view rest(req.path);
+    std::string_view segment;
+    while (next_segment(rest, segment)) {
+        current = current->child(segment);
+        if (!current) {
+            break;
+        }
+        if (current->prefix[id]) {
+            matched = &current->prefix[id];
+        }
+    }
+    if (current && current->exact[id]) {
+        return &current->exact[id];
+    }
+    if (matched) {
+        return matched;
+    }
+
+    return fallback_[id] ? &fallback_[id] : nullptr;
+}
+
+bool router::dispatch(const httplib::Request& req, httplib::Response& res) const {
+    const handler* h = find(req);
+    if (!h) {
+        return false;
+    }
+    (*h)(req, res);
+    return true;
+}
+
+bool router::has_exact(const httplib::Request& req) const {
+    method_id id = to_method_id(req.method);
+    if (id == method_unknown) {
+        return false;
+    }
+    const node* current = root_.get();
+    std::string_view rest(req.path);
+    std::string_view segment;
+    while (current && next_segment(rest, segment)) {
+        current = current->child(segment);
+    }
+    return current && current->exact[id];
+}
+
+} // namespace to_https_server
@@ -0,0 +1,408 @@
+#include <to_https_server/server/search_index.h>
+#include <to_https_server/server/trash_manager.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <mutex>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace to_https_server {
+
+static const uint32_t NO_NODE = UINT32_MAX;
+static const uint32_t ROOT_NODE = 0;
+static const uint32_t WATCH_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+// 已删除的节点超过该数且多于存活节点时重建，回收倒排表中的空间
+static const size_t COMPACT_THRESHOLD = 100000;
+
+static inline unsigned char lower(char c) {
+    return static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+static inline uint32_t trigram(const char* p) {
+    return (static_cast<uint32_t>(lower(p[0])) << 16) | (static_cast<uint32_t>(lower(p[1])) << 8) | lower(p[2]);
+}
+
+// 忽略ASCII大小写比较，query已是小写
+static bool name_matches(const std::string& name, const std::string& query, bool prefix) {
+    if (name.size() < query.size()) {
+        return false;
+    }
+    size_t last = prefix ? 0 : name.size() - query.size();
+    for (size_t start = 0; start <= last; ++start) {
+        size_t i = 0;
+        while (i < query.size() && lower(name[start + i]) == static_cast<unsigned char>(query[i])) {
+            ++i;
+        }
+        if (i == query.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+search_index::search_index(const std::string& root)
+    : root_(root), inotify_fd_(-1), need_rebuild_(false), running_(false), ready_(false),
+      watch_count_(0), watch_failures_(0), rebuilds_(0) {
+    while (root_.size() > 1 && root_.back() == '/') {
+        root_.pop_back();
+    }
+}
+
+search_index::~search_index() {
+    stop();
+}
+
+void search_index::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void search_index::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+}
+
+void search_index::run() {
+    rebuild();
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (running_) {
+        // 定时醒来检查stop()
+        pollfd pfd{inotify_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 500) <= 0) {
+            continue;
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        ssize_t n;
+        while ((n = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+            handle_events(*data_, buffer, static_cast<size_t>(n));
+        }
+        lock.unlock();
+        if (need_rebuild_) {
+            rebuild();
+        }
+    }
+}
+
+void search_index::rebuild() {
+    // 换一个新的inotify实例，旧实例上的监视随之全部移除
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watches_.clear();
+    watch_count_ = 0;
+    need_rebuild_ = false;
+
+    // 扫描期间查询仍使用旧索引；扫描中产生的事件排在新实例里，替换后再处理
+    auto data = std::make_unique<index_data>();
+    data->nodes.push_back(node{"", ROOT_NODE, true, true, -1, {}});
+    data->directories = 1;
+    scan(*data, ROOT_NODE, root_);
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    data_ = std::move(data);
+    rebuilds_++;
+    ready_ = true;
+}
+
+void search_index::scan(index_data& data, uint32_t dir, const std::string& path) {
+    // 先加监视再读取目录，读取期间新建的项会以事件的形式补上
+    watch(data, dir, path);
+    DIR* handle = opendir(path.c_str());
+    if (!handle) {
+        return;
+    }
+    std::vector<uint32_t> subdirs;
+    int fd = dirfd(handle);
+    while (dirent* entry = readdir(handle)) {
+        if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0 ||
+            trash_manager::is_staging_name(entry->d_name)) {
+            continue;
+        }
+        // 不跟随符号链接，避免目录环
+        bool directory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            directory = fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        uint32_t id = add_node(data, dir, entry->d_name, directory);
+        if (directory) {
+            subdirs.push_back(id);
+        }
+    }
+    closedir(handle);
+
+    // 关闭当前目录后再递归，同时打开的目录数最多等于深度
+    for (uint32_t id : subdirs) {
+        scan(data, id, path + "/" + data.nodes[id].name);
+    }
+}
+
+void search_index::watch(index_data& data, uint32_t dir, const std::string& path) {
+    if (inotify_fd_ < 0) {
+        return;
+    }
+    int wd = inotify_add_watch(inotify_fd_, path.c_str(), WATCH_EVENTS);
+    if (wd < 0) {
+        watch_failures_++;
+        return;
+    }
+    auto result = watches_.emplace(wd, dir);
+    if (result.second) {
+        watch_count_++;
+    } else {
+        // 同一目录（inode）返回已有的监视描述符，改为指向新节点
+        data.nodes[result.first->second].watch = -1;
+        result.first->second = dir;
+    }
+    data.nodes[dir].watch = wd;
+}
+
+void search_index::handle_events(index_data& data, const char* buffer, size_t size) {
+    for (const char* p = buffer; p < buffer + size;) {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+        p += sizeof(inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+            // 丢失了事件，只能重新扫描
+            need_rebuild_ = true;
+            continue;
+        }
+        auto it = watches_.find(event->wd);
+        if (it == watches_.end()) {
+            continue;
+        }
+        uint32_t dir = it->second;
+        if (event->mask & IN_IGNORED) {
+            // 目录已删除或监视已移除
+            if (data.nodes[dir].watch == event->wd) {
+                data.nodes[dir].watch = -1;
+            }
+            watches_.erase(it);
+            watch_count_--;
+            continue;
+        }
+        if (!data.nodes[dir].alive || event->len == 0) {
+            continue;
+        }
+
+        std::string name = event->name;
+        uint32_t existing = find_child(data, dir, name);
+        if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            if (existing != NO_NODE) {
+                remove_node(data, existing, true);
+            }
+        } else if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !trash_manager::is_staging_name(name)) {
+            // 扫描时已加入的项会再收到一次IN_CREATE；移入则可能覆盖同名项
+            if (existing != NO_NODE) {
+                if (event->mask & IN_CREATE) {
+                    continue;
+                }
+                remove_node(data, existing, true);
+            }
+            bool directory = (event->mask & IN_ISDIR) != 0;
+            uint32_t id = add_node(data, dir, name, directory);
+            if (directory) {
+                // 新建或移入的目录里可能已经有内容
+                scan(data, id, root_ + path_of(data, id));
+            }
+        }
+    }
+
+    size_t alive = data.nodes.size() - data.dead;
+    if (data.dead > COMPACT_THRESHOLD && data.dead > alive) {
+        need_rebuild_ = true;
+    }
+}
+
+uint32_t search_index::add_node(index_data& data, uint32_t parent, const std::string& name, bool directory) {
+    uint32_t id = static_cast<uint32_t>(data.nodes.size());
+    data.nodes.push_back(node{name, parent, directory, true, -1, {}});
+    data.nodes[parent].children.push_back(id);
+    if (directory) {
+        data.directories++;
+    } else {
+        data.files++;
+    }
+
+    if (name.size() >= 3) {
+        std::vector<uint32_t> grams;
+        grams.reserve(name.size() - 2);
+        for (size_t i = 0; i + 3 <= name.size(); ++i) {
+            grams.push_back(trigram(name.data() + i));
+        }
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        for (uint32_t gram : grams) {
+            data.postings[gram].push_back(id);
+        }
+    }
+    return id;
+}
+
+void search_index::remove_node(index_data& data, uint32_t id, bool unlink) {
+    node& n = data.nodes[id];
+    if (!n.alive) {
+        return;
+    }
+    if (unlink) {
+        auto& siblings = data.nodes[n.parent].children;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), id));
+    }
+    for (uint32_t child : n.children) {
+        remove_node(data, child, false);
+    }
+    if (n.watch >= 0) {
+        // IN_IGNORED随后到达时再从watches_中删除
+        inotify_rm_watch(inotify_fd_, n.watch);
+        n.watch = -1;
+    }
+    n.alive = false;
+    if (n.directory) {
+        data.directories--;
+    } else {
+        data.files--;
+    }
+    data.dead++;
+    // 倒排表里的id仍保留，查询时按alive过滤
+    std::string().swap(n.name);
+    std::vector<uint32_t>().swap(n.children);
+}
+
+uint32_t search_index::find_child(const index_data& data, uint32_t parent, const std::string& name) {
+    for (uint32_t child : data.nodes[parent].children) {
+        if (data.nodes[child].name == name) {
+            return child;
+        }
+    }
+    return NO_NODE;
+}
+
+std::string search_index::path_of(const index_data& data, uint32_t id) {
+    std::vector<const std::string*> parts;
+    while (id != ROOT_NODE) {
+        parts.push_back(&data.nodes[id].name);
+        id = data.nodes[id].parent;
+    }
+    if (parts.empty()) {
+        return "/";
+    }
+    std::string path;
+    for (auto it = parts.rbegin(); it != parts.rend(); ++it) {
+        path += "/";
+        path += **it;
+    }
+    return path;
+}
+
+std::vector<search_result> search_index::search(const std::string& query, bool prefix, const std::string& scope,
+                                                size_t limit, bool& truncated) const {
+    std::vector<search_result> results;
+    truncated = false;
+    std::string q;
+    for (char c : query) {
+        q += static_cast<char>(lower(c));
+    }
+    if (q.empty() || q.find('/') != std::string::npos) {
+        return results;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (!data_) {
+        return results;
+    }
+    const index_data& data = *data_;
+
+    uint32_t scope_id = ROOT_NODE;
+    size_t start = 0;
+    while (start < scope.size()) {
+        size_t end = scope.find('/', start);
+        if (end == std::string::npos) {
+            end = scope.size();
+        }
+        if (end > start) {
+            scope_id = find_child(data, scope_id, scope.substr(start, end - start));
+            if (scope_id == NO_NODE || !data.nodes[scope_id].directory) {
+                return results;
+            }
+        }
+        start = end + 1;
+    }
+
+    auto in_scope = [&](uint32_t id) {
+        while (id != ROOT_NODE && id != scope_id) {
+            id = data.nodes[id].parent;
+        }
+        return id == scope_id;
+    };
+    auto visit = [&](uint32_t id) {
+        const node& n = data.nodes[id];
+        if (!n.alive || !name_matches(n.name, q, prefix) || !in_scope(id)) {
+            return true;
+        }
+        if (results.size() == limit) {
+            truncated = true;
+            return false;
+        }
+        results.push_back(search_result{path_of(data, id), n.directory});
+        return true;
+    };
+
+    if (q.size() >= 3) {
+        // 名称必须包含查询串的每个三元组，取其中最短的倒排表逐个核对即可
+        const std::vector<uint32_t>* candidates = nullptr;
+        for (size_t i = 0; i + 3 <= q.size(); ++i) {
+            auto it = data.postings.find(trigram(q.data() + i));
+            if (it == data.postings.end()) {
+                return results;
+            }
+            if (!candidates || it->second.size() < candidates->size()) {
+                candidates = &it->second;
+            }
+        }
+        for (uint32_t id : *candidates) {
+            if (!visit(id)) {
+                break;
+            }
+        }
+    } else {
+        for (uint32_t id = 1; id < data.nodes.size(); ++id) {
+            if (!visit(id)) {
+                break;
+            }
+        }
+    }
+    return results;
+}
+
+search_index_stats search_index::stats() const {
+    search_index_stats result{};
+    result.ready = ready_.load();
+    result.watches = watch_count_.load();
+    result.watch_failures = watch_failures_.load();
+    result.rebuilds = rebuilds_.load();
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (data_) {
+        result.files = data_->files;
+        // 不计根目录
+        result.directories = data_->directories - 1;
+    }
+    return result;
+}
+
+} // namespace to_https_server
@@ -28,15 +28,15 @@ bool security_manager::should_block_request(const std::string& client_ip) {
     client.last_request = now;
     client.request_count++;
     
-    const auto& config = config_manager::instance().get_config();
+    const auto config = config_manager::instance().get_config();
     
-    if (client.request_count > config.max_requests_per_second) {
+    if (client.request_count > config->max_requests_per_second) {
         size_t total_requests = 0;
         for (const auto& [ip, info] : clients_) {
             total_requests += info.request_count;
         }
         
-        if (total_requests > config.attack_threshold) {
+        if (total_requests > config->attack_threshold) {
             enter_attack_mode();
             return true;
         }
@@ -0,0 +1,457 @@
+#include <to_https_server/server/thread_pool.h>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+namespace to_https_server {
+
+static const size_t MIN_RING_CAPACITY = 256;
+static const int SPIN_ROUNDS = 16;
+static const auto SUPERVISE_INTERVAL = std::chrono::milliseconds(50);
+// resize能达到的线程数上限
+static const size_t MAX_WORKERS = 1024;
+
+static thread_local work_stealing_pool* current_pool_ = nullptr;
+static thread_local size_t current_index_ = 0;
+static thread_local bool current_bulk_ = false;
+// begin_bulk登记的释放函数，end_bulk时调用
+static thread_local std::function<void()> current_release_;
+// 当前任务的排队时间，已被取走或不在任务中时为-1
+static thread_local int64_t current_delay_us_ = -1;
+
+// 有界多生产者多消费者无锁环形队列（Vyukov）
+template <class T>
+class task_ring {
+public:
+    explicit task_ring(size_t capacity) : cells_(new cell[capacity]), mask_(capacity - 1), enqueue_pos_(0), dequeue_pos_(0) {
+        for (size_t i = 0; i < capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // 队列已满时返回false，item保持不变
+    bool push(T& item) {
+        cell* c;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        c->item = std::move(item);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        cell* c;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(c->item);
+        c->item = T();
+        c->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    std::unique_ptr<cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+struct work_stealing_pool::worker {
+    explicit worker(size_t capacity) : queue(capacity) {}
+
+    task_ring<queued_task> queue;
+    std::thread thread;
+};
+
+static size_t ring_capacity(size_t max_queued) {
+    size_t capacity = MIN_RING_CAPACITY;
+    while (capacity < max_queued) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+static void update_max(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+work_stealing_pool::work_stealing_pool(const pool_options& options)
+    : options_(options), min_threads_(0), max_threads_(0), max_queued_(options.max_queued),
+      workers_(new std::atomic<worker*>[MAX_WORKERS]), slots_(0),
+      active_(0), bulk_(0), queued_(0), next_worker_(0), shutdown_(false),
+      completed_(0), rejected_(0), grow_events_(0), shrink_events_(0),
+      window_max_wait_us_(0), last_max_wait_us_(0), overflow_size_(0), sleepers_(0) {
+    size_t min_threads = std::min(std::max<size_t>(options_.min_threads, 1), MAX_WORKERS);
+    min_threads_ = min_threads;
+    max_threads_ = std::min(std::max(options_.max_threads, min_threads), MAX_WORKERS);
+
+    // 有界时单个队列即可容纳全部排队任务，不会落入后备队列
+    ring_capacity_ = ring_capacity(options_.max_queued);
+    for (size_t i = 0; i < MAX_WORKERS; ++i) {
+        workers_[i] = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(resize_mutex_);
+        for (size_t i = 0; i < min_threads; ++i) {
+            start_worker(i);
+        }
+        active_ = min_threads;
+    }
+
+    // 线程数范围可在运行中调整，因此总是启动负责扩容的后台线程
+    supervisor_ = std::thread([this] { supervise(); });
+}
+
+work_stealing_pool::~work_stealing_pool() {
+    shutdown();
+    for (size_t i = 0; i < slots_.load(); ++i) {
+        delete workers_[i].load();
+    }
+}
+
+work_stealing_pool::worker* work_stealing_pool::slot(size_t index) const {
+    return workers_[index].load(std::memory_order_acquire);
+}
+
+void work_stealing_pool::start_worker(size_t index) {
+    // 调用方持有resize_mutex_；槽位按序号连续创建
+    if (index >= slots_.load()) {
+        workers_[index].store(new worker(ring_capacity_), std::memory_order_release);
+        slots_.store(index + 1, std::memory_order_release);
+    }
+    // 同一位置上已退出的旧线程先回收
+    worker* w = slot(index);
+    if (w->thread.joinable()) {
+        w->thread.join();
+    }
+    w->thread = std::thread([this, index] { run(index); });
+}
+
+void work_stealing_pool::resize(size_t min_threads, size_t max_threads, size_t max_queued) {
+    min_threads = std::min(std::max<size_t>(min_threads, 1), MAX_WORKERS);
+    max_threads = std::min(std::max(max_threads, min_threads), MAX_WORKERS);
+
+    std::lock_guard<std::mutex> lock(resize_mutex_);
+    if (shutdown_) {
+        return;
+    }
+    // 排队上限超过环形队列容量时，多出的任务进入后备队列
+    max_queued_ = max_queued;
+    min_threads_ = min_threads;
+    max_threads_ = max_threads;
+
+    size_t active = active_.load();
+    while (active < min_threads) {
+        if (active_.compare_exchange_strong(active, active + 1)) {
+            start_worker(active);
+            active++;
+        }
+    }
+
+    // 唤醒休眠的线程，让超出上限的线程退出
+    if (active > max_threads) {
+        std::lock_guard<std::mutex> park_lock(park_mutex_);
+        park_cv_.notify_all();
+    }
+}
+
+bool work_stealing_pool::enqueue(std::function<void()> fn) {
+    if (shutdown_) {
+        return false;
+    }
+
+    size_t previous = queued_.fetch_add(1);
+    size_t max_queued = max_queued_.load(std::memory_order_relaxed);
+    if (max_queued > 0 && previous >= max_queued) {
+        queued_.fetch_sub(1);
+        rejected_++;
+        return false;
+    }
+
+    queued_task task{std::move(fn), std::chrono::steady_clock::now()};
+
+    // 工作线程提交的任务放回自己的队列，其余在运行中的线程间轮询分配
+    size_t active = std::max<size_t>(active_.load(std::memory_order_relaxed), 1);
+    size_t count = slots_.load(std::memory_order_acquire);
+    size_t start = current_pool_ == this ? current_index_ : next_worker_.fetch_add(1, std::memory_order_relaxed) % active;
+    bool pushed = false;
+    for (size_t i = 0; i < count && !pushed; ++i) {
+        pushed = slot((start + i) % count)->queue.push(task);
+    }
+    if (!pushed) {
+        std::lock_guard<std::mutex> lock(overflow_mutex_);
+        overflow_.push_back(std::move(task));
+        overflow_size_++;
+    }
+
+    if (sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        park_cv_.notify_one();
+    }
+    return true;
+}
+
+void work_stealing_pool::shutdown() {
+    if (shutdown_.exchange(true)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(supervisor_mutex_);
+        supervisor_cv_.notify_all();
+    }
+    if (supervisor_.joinable()) {
+        supervisor_.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        park_cv_.notify_all();
+    }
+    // 持锁只取出线程对象，等待退出时不持锁：仍在处理请求的线程可能在begin_bulk中等这把锁。
+    // shutdown_置位后不会再启动新线程
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(resize_mutex_);
+        for (size_t i = 0; i < slots_.load(); ++i) {
+            worker* w = slot(i);
+            if (w->thread.joinable()) {
+                threads.push_back(std::move(w->thread));
+            }
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+pool_stats work_stealing_pool::stats() const {
+    pool_stats result;
+    result.threads = active_.load();
+    result.min_threads = min_threads_.load();
+    result.max_threads = max_threads_.load();
+    result.queued = queued_.load();
+    result.completed = completed_.load();
+    result.rejected = rejected_.load();
+    result.grow_events = grow_events_.load();
+    result.shrink_events = shrink_events_.load();
+    result.max_wait_us = std::max(last_max_wait_us_.load(), window_max_wait_us_.load());
+    result.bulk_threads = bulk_.load();
+    return result;
+}
+
+bool work_stealing_pool::take(size_t index, queued_task& task) {
+    // 先取自己的队列，再依次窃取其他队列（包括已退出线程遗留的任务）
+    size_t count = slots_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        if (slot((index + i) % count)->queue.pop(task)) {
+            return true;
+        }
+    }
+    if (overflow_size_.load() > 0) {
+        std::lock_guard<std::mutex> lock(overflow_mutex_);
+        if (!overflow_.empty()) {
+            task = std::move(overflow_.front());
+            overflow_.pop_front();
+            overflow_size_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void work_stealing_pool::supervise() {
+    std::unique_lock<std::mutex> lock(supervisor_mutex_);
+    while (!shutdown_) {
+        supervisor_cv_.wait_for(lock, SUPERVISE_INTERVAL);
+        if (shutdown_) {
+            break;
+        }
+
+        uint64_t max_wait_us = window_max_wait_us_.exchange(0);
+        last_max_wait_us_ = max_wait_us;
+        bool backlog = queued_.load() > options_.grow_queue_depth;
+        bool slow = max_wait_us > options_.grow_wait_ms * 1000;
+        if (!backlog && !slow) {
+            continue;
+        }
+
+        // 每个周期最多扩容一个线程；与退出中的线程竞争失败时留到下个周期
+        std::lock_guard<std::mutex> resize_lock(resize_mutex_);
+        size_t active = active_.load();
+        size_t limit = std::min(max_threads_.load() + bulk_.load(), MAX_WORKERS);
+        if (active < limit && active_.compare_exchange_strong(active, active + 1)) {
+            start_worker(active);
+            grow_events_++;
+        }
+    }
+}
+
+bool work_stealing_pool::submit(std::function<void()> fn) {
+    work_stealing_pool* pool = current_pool_;
+    return pool && pool->enqueue(std::move(fn));
+}
+
+void work_stealing_pool::pin_to_cpu(size_t index) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+
+    // 在进程允许的CPU中按序号轮流分配
+    size_t target = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        if (target-- == 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            return;
+        }
+    }
+}
+
+void work_stealing_pool::begin_bulk(std::function<void()> release) {
+    if (current_bulk_) {
+        return;
+    }
+    current_bulk_ = true;
+    current_release_ = std::move(release);
+    work_stealing_pool* pool = current_pool_;
+    if (!pool) {
+        return;
+    }
+    size_t bulk = ++pool->bulk_;
+    if (pool->shutdown_) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(pool->resize_mutex_);
+    size_t active = pool->active_.load();
+    if (!pool->shutdown_ && active < std::min(pool->min_threads_.load() + bulk, MAX_WORKERS) &&
+        pool->active_.compare_exchange_strong(active, active + 1)) {
+        pool->start_worker(active);
+        pool->grow_events_++;
+    }
+}
+
+void work_stealing_pool::end_bulk() {
+    if (!current_bulk_) {
+        return;
+    }
+    current_bulk_ = false;
+    if (current_release_) {
+        auto release = std::move(current_release_);
+        current_release_ = nullptr;
+        release();
+    }
+    work_stealing_pool* pool = current_pool_;
+    if (!pool) {
+        return;
+    }
+    pool->bulk_--;
+    // 补上的线程此时超出上限，空闲的可以退出
+    std::lock_guard<std::mutex> lock(pool->park_mutex_);
+    pool->park_cv_.notify_all();
+}
+
+bool work_stealing_pool::take_queue_delay(std::chrono::microseconds& delay) {
+    if (current_delay_us_ < 0) {
+        return false;
+    }
+    delay = std::chrono::microseconds(current_delay_us_);
+    current_delay_us_ = -1;
+    return true;
+}
+
+void work_stealing_pool::run(size_t index) {
+    current_pool_ = this;
+    current_index_ = index;
+    if (options_.pin_cpu) {
+        pin_to_cpu(options_.cpu >= 0 ? static_cast<size_t>(options_.cpu) : index);
+    }
+
+    const auto idle_timeout = std::chrono::seconds(options_.idle_timeout_sec);
+    queued_task task;
+    for (;;) {
+        bool found = take(index, task);
+        for (int i = 0; i < SPIN_ROUNDS && !found; ++i) {
+            std::this_thread::yield();
+            found = take(index, task);
+        }
+
+        if (found) {
+            queued_--;
+            auto waited = std::chrono::steady_clock::now() - task.enqueued_at;
+            current_delay_us_ = std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+            update_max(window_max_wait_us_, static_cast<uint64_t>(current_delay_us_));
+            task.fn();
+            task.fn = nullptr;
+            current_delay_us_ = -1;
+            // 连接异常结束时可能没有走到end_bulk，由此归还名额
+            end_bulk();
+            completed_++;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(park_mutex_);
+        if (shutdown_ && queued_.load() == 0) {
+            break;
+        }
+        sleepers_++;
+        // resize降低上限后，编号最大且超出上限的线程不必等到空闲超时
+        auto over_limit = [this, index] {
+            return index >= max_threads_.load() + bulk_.load() && active_.load() == index + 1;
+        };
+        auto ready = [this, &over_limit] { return queued_.load() > 0 || shutdown_ || over_limit(); };
+        bool woken = park_cv_.wait_for(lock, idle_timeout, ready);
+        sleepers_--;
+
+        // 只有编号最大的线程可以退出，保证运行中的线程编号连续
+        size_t expected = index + 1;
+        if ((over_limit() || (!woken && expected > min_threads_.load() + bulk_.load())) &&
+            active_.compare_exchange_strong(expected, index)) {
+            shrink_events_++;
+            // 下一个编号的线程可能也需要退出
+            park_cv_.notify_all();
+            break;
+        }
+    }
+}
+
+} // namespace to_https_server
@@ -0,0 +1,244 @@
+#include <to_https_server/server/tls_server.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+
+namespace to_https_server {
+
+std::atomic<uint64_t> tls_server::ktls_connections_(0);
+std::atomic<uint64_t> tls_server::userspace_connections_(0);
+std::atomic<uint64_t> tls_server::sendfile_bytes_(0);
+
+// 包装httplib::detail::SSLSocketStream（其为final），拦截send_file登记的写入
+class tls_server::ktls_stream : public httplib::Stream {
+public:
+    ktls_stream(socket_t sock, SSL* ssl, bool ktls, time_t read_timeout_sec, time_t read_timeout_usec,
+                time_t write_timeout_sec, time_t write_timeout_usec)
+        : inner_(sock, ssl, read_timeout_sec, read_timeout_usec, write_timeout_sec, write_timeout_usec),
+          ssl_(ssl), ktls_(ktls), previous_(current_) {
+        current_ = this;
+    }
+
+    ~ktls_stream() override {
+        current_ = previous_;
+    }
+
+    bool is_readable() const override { return inner_.is_readable(); }
+    bool wait_readable() const override { return inner_.wait_readable(); }
+    bool wait_writable() const override { return inner_.wait_writable(); }
+    ssize_t read(char* ptr, size_t size) override { return inner_.read(ptr, size); }
+    void get_remote_ip_and_port(std::string& ip, int& port) const override { inner_.get_remote_ip_and_port(ip, port); }
+    void get_local_ip_and_port(std::string& ip, int& port) const override { inner_.get_local_ip_and_port(ip, port); }
+    socket_t socket() const override { return inner_.socket(); }
+    time_t duration() const override { return inner_.duration(); }
+
+    ssize_t write(const char* ptr, size_t size) override {
+        // 落在登记区间内的写入表示文件内容，按相对位置换算成文件偏移后sendfile
+        uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        if (pending_.active && address >= pending_.base && address < pending_.base + pending_.length) {
+            off_t offset = static_cast<off_t>(pending_.offset + (address - pending_.base));
+            ossl_ssize_t sent = SSL_sendfile(ssl_, pending_.fd, offset, size, 0);
+            if (sent > 0) {
+                sendfile_bytes_ += static_cast<uint64_t>(sent);
+            }
+            return sent > 0 ? static_cast<ssize_t>(sent) : -1;
+        }
+        return inner_.write(ptr, size);
+    }
+
+    static ktls_stream* current() { return current_; }
+
+    bool ktls() const { return ktls_; }
+
+    bool send_file(httplib::DataSink& sink, int fd, size_t offset, size_t length) {
+        // sink.write需要一块真实的缓冲区，其地址只用于在write中换算文件偏移，内容不会被读写。
+        // 文件按缓冲区大小分段写入
+        static char placeholder[1024 * 1024];
+        pending_.active = true;
+        pending_.fd = fd;
+        pending_.base = reinterpret_cast<uintptr_t>(placeholder);
+        bool ok = true;
+        while (ok && length > 0) {
+            size_t chunk = std::min(length, sizeof(placeholder));
+            pending_.offset = offset;
+            pending_.length = chunk;
+            ok = sink.write(placeholder, chunk);
+            offset += chunk;
+            length -= chunk;
+        }
+        pending_.active = false;
+        return ok;
+    }
+
+private:
+    struct pending_file {
+        bool active = false;
+        int fd = -1;
+        size_t offset = 0;
+        uintptr_t base = 0;
+        size_t length = 0;
+    };
+
+    httplib::detail::SSLSocketStream inner_;
+    SSL* ssl_;
+    bool ktls_;
+    pending_file pending_;
+    ktls_stream* previous_;
+
+    static thread_local ktls_stream* current_;
+};
+
+thread_local tls_server::ktls_stream* tls_server::ktls_stream::current_ = nullptr;
+
+tls_server::tls_server(const char* cert_path, const char* private_key_path)
+    : httplib::SSLServer(cert_path, private_key_path), ktls_enabled_(false), http2_enabled_(false), connections_(nullptr) {}
+
+void tls_server::enable_ktls(bool enabled) {
+    ktls_enabled_ = enabled;
+    if (!is_valid()) {
+        return;
+    }
+#ifdef SSL_OP_ENABLE_KTLS
+    if (enabled) {
+        SSL_CTX_set_options(ssl_context(), SSL_OP_ENABLE_KTLS);
+    } else {
+        SSL_CTX_clear_options(ssl_context(), SSL_OP_ENABLE_KTLS);
+    }
+#else
+    ktls_enabled_ = false;
+#endif
+}
+
+void tls_server::enable_http2(const http2_options& options, http2_session::handler h) {
+    http2_enabled_ = true;
+    http2_options_ = options;
+    http2_handler_ = std::move(h);
+    if (is_valid()) {
+        SSL_CTX_set_alpn_select_cb(ssl_context(), select_alpn, nullptr);
+    }
+}
+
+int tls_server::select_alpn(SSL*, const unsigned char** out, unsigned char* outlen,
+                            const unsigned char* in, unsigned int inlen, void*) {
+    // 按我方偏好选择：优先h2，其次http/1.1
+    static const unsigned char protocols[] = "\x02h2\x08http/1.1";
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, outlen, protocols, sizeof(protocols) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        // 客户端只提供了我方不支持的协议时不选择任何协议，按HTTP/1.1继续
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+void tls_server::adopt_socket(int sock) {
+    svr_sock_ = sock;
+}
+
+int tls_server::listening_socket() const {
+    return svr_sock_;
+}
+
+void tls_server::stop_accepting() {
+    stop_accepting_socket(svr_sock_);
+}
+
+void tls_server::close_listener() {
+    close_listening_socket(svr_sock_);
+}
+
+void tls_server::track_connections(active_connections* connections) {
+    connections_ = connections;
+}
+
+bool tls_server::can_send_file() {
+    ktls_stream* stream = ktls_stream::current();
+    return stream && stream->ktls();
+}
+
+bool tls_server::send_file(httplib::DataSink& sink, int fd, size_t offset, size_t length) {
+    ktls_stream* stream = ktls_stream::current();
+    if (!stream || !stream->ktls()) {
+        return false;
+    }
+    return stream->send_file(sink, fd, offset, length);
+}
+
+ktls_stats tls_server::stats() {
+    ktls_stats result;
+    result.ktls_connections = ktls_connections_.load();
+    result.userspace_connections = userspace_connections_.load();
+    result.sendfile_bytes = sendfile_bytes_.load();
+    return result;
+}
+
+bool tls_server::process_and_close_socket(socket_t sock) {
+    // 与httplib::SSLServer的实现相同，只是把连接流换成ktls_stream
+    if (connections_) {
+        connections_->add(sock);
+    }
+    int ssl_error = 0;
+    SSL* ssl = httplib::detail::ssl_new(
+        sock, ssl_context(), ssl_mutex_,
+        [&](SSL* ssl2) {
+            return httplib::detail::ssl_connect_or_accept_nonblocking(
+                sock, ssl2, SSL_accept, read_timeout_sec_, read_timeout_usec_, &ssl_error);
+        },
+        [](SSL*) { return true; });
+
+    bool ret = false;
+    if (ssl) {
+        // 握手完成后检查内核是否真正接管了发送方向（取决于内核tls模块与协商出的加密套件）
+        bool ktls = ktls_enabled_ && BIO_get_ktls_send(SSL_get_wbio(ssl));
+        if (ktls) {
+            ktls_connections_++;
+        } else {
+            userspace_connections_++;
+        }
+
+        std::string remote_addr;
+        int remote_port = 0;
+        httplib::detail::get_remote_ip_and_port(sock, remote_addr, remote_port);
+        std::string local_addr;
+        int local_port = 0;
+        httplib::detail::get_local_ip_and_port(sock, local_addr, local_port);
+
+        const unsigned char* alpn = nullptr;
+        unsigned int alpn_len = 0;
+        SSL_get0_alpn_selected(ssl, &alpn, &alpn_len);
+        if (http2_enabled_ && alpn_len == 2 && std::memcmp(alpn, "h2", 2) == 0) {
+            // HTTP/2的DATA帧由会话自行组帧，不走send_file的sendfile路径
+            httplib::detail::SSLSocketStream strm(sock, ssl, read_timeout_sec_, read_timeout_usec_,
+                                                  write_timeout_sec_, write_timeout_usec_);
+            http2_session session(strm, http2_handler_, http2_options_);
+            session.set_remote(remote_addr, remote_port);
+            session.set_local(local_addr, local_port);
+            session.set_ssl(ssl);
+            ret = session.run();
+        } else {
+            ret = httplib::detail::process_server_socket_core(
+                svr_sock_, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
+                [&](bool close_connection, bool& connection_closed) {
+                    ktls_stream strm(sock, ssl, ktls, read_timeout_sec_, read_timeout_usec_,
+                                     write_timeout_sec_, write_timeout_usec_);
+                    bool ok = process_request(strm, remote_addr, remote_port, local_addr, local_port,
+                                              close_connection, connection_closed,
+                                              [&](httplib::Request& req) { req.ssl = ssl; });
+                    connection_closed = take_close_after_response() || connection_closed;
+                    return ok;
+                });
+        }
+
+        httplib::detail::ssl_delete(ssl_mutex_, ssl, sock, ret);
+    }
+
+    if (connections_) {
+        connections_->remove(sock);
+    }
+    httplib::detail::shutdown_socket(sock);
+    httplib::detail::close_socket(sock);
+    return ret;
+}
+
+} // namespace to_https_server
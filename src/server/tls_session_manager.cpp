@@ -0,0 +1,274 @@
+#include <to_https_server/server/tls_session_manager.h>
+#include <cstring>
+#include <ctime>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+namespace to_https_server {
+
+static const unsigned char SESSION_ID_CONTEXT[] = "to_https_server";
+
+static int ex_data_index() {
+    static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+tls_session_manager::tls_session_manager(const tls_session_options& options)
+    : options_(options), has_previous_key_(false), rotated_at_(std::chrono::steady_clock::now()),
+      full_handshakes_(0), resumed_handshakes_(0), cache_hits_(0), cache_misses_(0), ticket_key_rotations_(0) {
+    generate_key(current_key_);
+}
+
+tls_session_manager::~tls_session_manager() {
+    OPENSSL_cleanse(&current_key_, sizeof(current_key_));
+    OPENSSL_cleanse(&previous_key_, sizeof(previous_key_));
+}
+
+void tls_session_manager::attach(SSL_CTX* ctx) {
+    if (!ctx) {
+        return;
+    }
+    SSL_CTX_set_ex_data(ctx, ex_data_index(), this);
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_timeout(ctx, static_cast<long>(options_.session_timeout_sec));
+    SSL_CTX_set_info_callback(ctx, on_info);
+
+    // 会话放在本对象的缓存里而非各SSL_CTX内部，多个监听可以共享
+    if (options_.cache_size > 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+        SSL_CTX_sess_set_new_cb(ctx, on_new_session);
+        SSL_CTX_sess_set_get_cb(ctx, on_get_session);
+        SSL_CTX_sess_set_remove_cb(ctx, on_remove_session);
+    } else {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+
+    if (options_.tickets) {
+        SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, on_ticket_key);
+    } else {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+}
+
+void tls_session_manager::set_cache_size(size_t cache_size) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    options_.cache_size = cache_size;
+    while (cache_.size() > cache_size && !lru_.empty()) {
+        cache_.erase(lru_.back());
+        lru_.pop_back();
+    }
+}
+
+std::string tls_session_manager::export_ticket_keys() {
+    std::lock_guard<std::mutex> lock(keys_mutex_);
+    std::string data(reinterpret_cast<const char*>(&current_key_), sizeof(current_key_));
+    if (has_previous_key_) {
+        data.append(reinterpret_cast<const char*>(&previous_key_), sizeof(previous_key_));
+    }
+    return data;
+}
+
+bool tls_session_manager::import_ticket_keys(const std::string& data) {
+    if (data.size() != sizeof(ticket_key) && data.size() != 2 * sizeof(ticket_key)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(keys_mutex_);
+    std::memcpy(&current_key_, data.data(), sizeof(current_key_));
+    has_previous_key_ = data.size() == 2 * sizeof(ticket_key);
+    if (has_previous_key_) {
+        std::memcpy(&previous_key_, data.data() + sizeof(ticket_key), sizeof(previous_key_));
+    }
+    // 轮换周期从接管时重新计算
+    rotated_at_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+tls_session_stats tls_session_manager::stats() const {
+    tls_session_stats result;
+    result.full_handshakes = full_handshakes_.load();
+    result.resumed_handshakes = resumed_handshakes_.load();
+    result.cache_hits = cache_hits_.load();
+    result.cache_misses = cache_misses_.load();
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        result.cached_sessions = cache_.size();
+    }
+    result.ticket_key_rotations = ticket_key_rotations_.load();
+    return result;
+}
+
+tls_session_manager* tls_session_manager::from_ssl(SSL* ssl) {
+    return static_cast<tls_session_manager*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ex_data_index()));
+}
+
+int tls_session_manager::on_new_session(SSL* ssl, SSL_SESSION* session) {
+    auto* self = from_ssl(ssl);
+    if (!self) {
+        return 0;
+    }
+
+    unsigned int id_len = 0;
+    const unsigned char* id = SSL_SESSION_get_id(session, &id_len);
+    int der_len = i2d_SSL_SESSION(session, nullptr);
+    if (id_len == 0 || der_len <= 0) {
+        return 0;
+    }
+    std::string der(static_cast<size_t>(der_len), '\0');
+    auto* out = reinterpret_cast<unsigned char*>(&der[0]);
+    i2d_SSL_SESSION(session, &out);
+
+    std::string key(reinterpret_cast<const char*>(id), id_len);
+    std::lock_guard<std::mutex> lock(self->cache_mutex_);
+    if (self->options_.cache_size == 0) {
+        return 0;
+    }
+    auto it = self->cache_.find(key);
+    if (it != self->cache_.end()) {
+        self->lru_.erase(it->second.lru);
+        self->cache_.erase(it);
+    }
+    while (self->cache_.size() >= self->options_.cache_size && !self->lru_.empty()) {
+        self->cache_.erase(self->lru_.back());
+        self->lru_.pop_back();
+    }
+    self->lru_.push_front(key);
+    self->cache_[key] = cache_entry{std::move(der), self->lru_.begin()};
+
+    // 已序列化保存，不持有session的引用
+    return 0;
+}
+
+SSL_SESSION* tls_session_manager::on_get_session(SSL* ssl, const unsigned char* id, int id_len, int* copy) {
+    *copy = 0;
+    auto* self = from_ssl(ssl);
+    if (!self || id_len <= 0) {
+        return nullptr;
+    }
+
+    std::string der;
+    {
+        std::lock_guard<std::mutex> lock(self->cache_mutex_);
+        auto it = self->cache_.find(std::string(reinterpret_cast<const char*>(id), id_len));
+        if (it == self->cache_.end()) {
+            self->cache_misses_++;
+            return nullptr;
+        }
+        self->lru_.splice(self->lru_.begin(), self->lru_, it->second.lru);
+        der = it->second.der;
+    }
+    self->cache_hits_++;
+
+    // 过期检查由OpenSSL完成，过期时会回调on_remove_session
+    const auto* in = reinterpret_cast<const unsigned char*>(der.data());
+    return d2i_SSL_SESSION(nullptr, &in, static_cast<long>(der.size()));
+}
+
+void tls_session_manager::on_remove_session(SSL_CTX* ctx, SSL_SESSION* session) {
+    auto* self = static_cast<tls_session_manager*>(SSL_CTX_get_ex_data(ctx, ex_data_index()));
+    if (!self) {
+        return;
+    }
+
+    // 客户端直接断开keep-alive连接时httplib不发close_notify，SSL_free会据此移除会话，
+    // 这种情况很常见，只在会话真正过期时才删除，其余交给LRU淘汰
+    if (static_cast<time_t>(SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session)) > time(nullptr)) {
+        return;
+    }
+
+    unsigned int id_len = 0;
+    const unsigned char* id = SSL_SESSION_get_id(session, &id_len);
+    std::lock_guard<std::mutex> lock(self->cache_mutex_);
+    auto it = self->cache_.find(std::string(reinterpret_cast<const char*>(id), id_len));
+    if (it != self->cache_.end()) {
+        self->lru_.erase(it->second.lru);
+        self->cache_.erase(it);
+    }
+}
+
+bool tls_session_manager::generate_key(ticket_key& key) {
+    return RAND_bytes(key.name, sizeof(key.name)) == 1 &&
+           RAND_priv_bytes(key.aes_key, sizeof(key.aes_key)) == 1 &&
+           RAND_priv_bytes(key.hmac_key, sizeof(key.hmac_key)) == 1;
+}
+
+void tls_session_manager::rotate_if_due() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - rotated_at_ < std::chrono::seconds(options_.ticket_rotate_sec)) {
+        return;
+    }
+    ticket_key next;
+    if (!generate_key(next)) {
+        return;
+    }
+    previous_key_ = current_key_;
+    has_previous_key_ = true;
+    current_key_ = next;
+    OPENSSL_cleanse(&next, sizeof(next));
+    rotated_at_ = now;
+    ticket_key_rotations_++;
+}
+
+int tls_session_manager::on_ticket_key(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                                       EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx, int enc) {
+    auto* self = from_ssl(ssl);
+    if (!self) {
+        return -1;
+    }
+
+    ticket_key key;
+    int result = 1;
+    {
+        std::lock_guard<std::mutex> lock(self->keys_mutex_);
+        self->rotate_if_due();
+        if (enc) {
+            key = self->current_key_;
+        } else if (memcmp(key_name, self->current_key_.name, sizeof(key.name)) == 0) {
+            key = self->current_key_;
+        } else if (self->has_previous_key_ && memcmp(key_name, self->previous_key_.name, sizeof(key.name)) == 0) {
+            // 旧密钥加密的票据仍可使用，但要求客户端换一张新票据
+            key = self->previous_key_;
+            result = 2;
+        } else {
+            // 未知或已过期的密钥，退回完整握手
+            return 0;
+        }
+    }
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key, sizeof(key.hmac_key)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+        OSSL_PARAM_construct_end()
+    };
+
+    bool ok;
+    if (enc) {
+        memcpy(key_name, key.name, sizeof(key.name));
+        ok = RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) == 1 &&
+             EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) == 1;
+    } else {
+        ok = EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) == 1;
+    }
+    ok = ok && EVP_MAC_CTX_set_params(mac_ctx, params) == 1;
+    OPENSSL_cleanse(&key, sizeof(key));
+    return ok ? result : -1;
+}
+
+void tls_session_manager::on_info(const SSL* ssl, int where, int ret) {
+    (void)ret;
+    if (!(where & SSL_CB_HANDSHAKE_DONE)) {
+        return;
+    }
+    auto* self = from_ssl(const_cast<SSL*>(ssl));
+    if (!self) {
+        return;
+    }
+    if (SSL_session_reused(ssl)) {
+        self->resumed_handshakes_++;
+    } else {
+        self->full_handshakes_++;
+    }
+}
+
+} // namespace to_https_server
@@ -0,0 +1,525 @@
+#include <to_https_server/server/trash_manager.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace to_https_server {
+
+static const char* INDEX_FILE = ".index";
+static const std::string STAGING_PREFIX = ".trash-";
+// 没有新任务时后台线程多久检查一次保留期限
+static const std::chrono::seconds REAP_INTERVAL(60);
+
+// 索引中路径以制表符分隔、以换行结束，这两个字符及反斜杠需要转义
+static std::string escape_field(const std::string& value) {
+    std::string result;
+    for (char c : value) {
+        if (c == '\\') {
+            result += "\\\\";
+        } else if (c == '\t') {
+            result += "\\t";
+        } else if (c == '\n') {
+            result += "\\n";
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+static std::string unescape_field(const std::string& value) {
+    std::string result;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            char c = value[++i];
+            result += c == 't' ? '\t' : (c == 'n' ? '\n' : c);
+        } else {
+            result += value[i];
+        }
+    }
+    return result;
+}
+
+static std::vector<std::string> split_fields(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find('\t', start);
+        fields.push_back(unescape_field(line.substr(start, end == std::string::npos ? std::string::npos : end - start)));
+        if (end == std::string::npos) {
+            return fields;
+        }
+        start = end + 1;
+    }
+}
+
+static std::string add_record(const trash_item& item) {
+    return "+\t" + escape_field(item.id) + "\t" + std::to_string(item.deleted_at) + "\t" + std::to_string(item.size) +
+           "\t" + escape_field(item.staging_path) + "\t" + escape_field(item.original_path);
+}
+
+// 不跟随符号链接统计总字节数
+static int64_t measure(const std::string& path) {
+    std::error_code ec;
+    auto status = fs::symlink_status(path, ec);
+    if (ec) {
+        return 0;
+    }
+    if (!fs::is_directory(status)) {
+        return fs::is_regular_file(status) ? static_cast<int64_t>(fs::file_size(path, ec)) : 0;
+    }
+    int64_t total = 0;
+    for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_regular_file(ec) && !it->is_symlink(ec)) {
+            total += static_cast<int64_t>(it->file_size(ec));
+        }
+    }
+    return total;
+}
+
+// 启用索引之前的项只有文件名：make_id生成的"%Y%m%d_%H%M%S_"前缀即删除时间
+static bool parse_id_time(const std::string& id, std::time_t& result) {
+    std::tm tm{};
+    const char* end = strptime(id.c_str(), "%Y%m%d_%H%M%S_", &tm);
+    if (!end || end != id.c_str() + 16) {
+        return false;
+    }
+    tm.tm_isdst = -1;
+    result = mktime(&tm);
+    return result != static_cast<std::time_t>(-1);
+}
+
+bool trash_manager::is_staging_name(const std::string& name) {
+    return name.compare(0, STAGING_PREFIX.size(), STAGING_PREFIX) == 0;
+}
+
+bool trash_manager::is_staging_path(const std::string& path) {
+    for (size_t start = 0; start < path.size();) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        if (is_staging_name(path.substr(start, end - start))) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+trash_manager::trash_manager(const std::string& trash_dir)
+    : trash_dir_(trash_dir), index_path_(trash_dir + "/" + INDEX_FILE), journal_lines_(0),
+      max_age_sec_(0), max_bytes_(0), purged_items_(0), purged_bytes_(0), running_(false) {
+    load_index();
+}
+
+trash_manager::~trash_manager() {
+    stop();
+}
+
+void trash_manager::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void trash_manager::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_.exchange(false)) {
+            return;
+        }
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void trash_manager::set_limits(uint64_t max_age_sec, uint64_t max_bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_age_sec_ = max_age_sec;
+        max_bytes_ = max_bytes;
+    }
+    wake_.notify_all();
+}
+
+std::string trash_manager::make_id(const std::string& name, std::time_t now) const {
+    std::tm tm;
+    localtime_r(&now, &tm);
+    std::ostringstream prefix;
+    prefix << std::put_time(&tm, "%Y%m%d_%H%M%S_");
+    // 同一秒内删除同名项时加序号区分，避免覆盖
+    std::string id = prefix.str() + name;
+    for (int n = 1; items_.count(id) || fs::exists(fs::symlink_status(trash_dir_ + "/" + id)); ++n) {
+        id = prefix.str() + std::to_string(n) + "_" + name;
+    }
+    return id;
+}
+
+bool trash_manager::move_to_trash(const std::string& source, const std::string& original_path) {
+    std::string name = fs::path(source).filename().string();
+    std::time_t now = std::time(nullptr);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    trash_item item;
+    item.id = make_id(name, now);
+    item.original_path = original_path;
+    item.deleted_at = now;
+    item.size = -1;
+
+    if (rename(source.c_str(), (trash_dir_ + "/" + item.id).c_str()) != 0) {
+        if (errno != EXDEV) {
+            return false;
+        }
+        // 回收站在另一个文件系统上：先在原目录内改名（同一文件系统，总能成功）使其立即消失，
+        // 复制交给后台线程
+        std::string staging = fs::path(source).parent_path().string() + "/" + STAGING_PREFIX + item.id;
+        if (rename(source.c_str(), staging.c_str()) != 0) {
+            return false;
+        }
+        item.staging_path = staging;
+    } else {
+        struct stat st;
+        if (lstat((trash_dir_ + "/" + item.id).c_str(), &st) == 0 && !S_ISDIR(st.st_mode)) {
+            item.size = S_ISREG(st.st_mode) ? st.st_size : 0;
+        }
+    }
+
+    append_index(add_record(item));
+    bool pending = !item.staging_path.empty() || item.size < 0;
+    items_[item.id] = std::move(item);
+    if (pending) {
+        wake_.notify_all();
+    }
+    return true;
+}
+
+restore_result trash_manager::restore(const std::string& id,
+                                      const std::function<std::string(const std::string&)>& resolve) {
+    trash_item item;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = items_.find(id);
+        if (it == items_.end()) {
+            return restore_result::not_found;
+        }
+        if (!it->second.staging_path.empty()) {
+            return restore_result::pending;
+        }
+        if (it->second.original_path.empty()) {
+            return restore_result::unknown_origin;
+        }
+        // 先从索引中取出，避免与后台清理同时处理同一项
+        item = it->second;
+        items_.erase(it);
+    }
+
+    std::string source = trash_dir_ + "/" + id;
+    std::string target = resolve(item.original_path);
+    restore_result result = restore_result::restored;
+    std::error_code ec;
+    if (fs::exists(fs::symlink_status(target, ec))) {
+        result = restore_result::conflict;
+    } else {
+        fs::create_directories(fs::path(target).parent_path(), ec);
+        if (rename(source.c_str(), target.c_str()) != 0) {
+            if (errno == EXDEV) {
+                // 恢复是用户主动等待的操作，跨文件系统时直接同步复制
+                fs::copy(source, target, fs::copy_options::recursive | fs::copy_options::copy_symlinks, ec);
+                if (!ec) {
+                    fs::remove_all(source, ec);
+                    ec.clear();
+                } else {
+                    fs::remove_all(target, ec);
+                    result = restore_result::failed;
+                }
+            } else {
+                result = restore_result::failed;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (result == restore_result::restored) {
+        append_index("-\t" + escape_field(id));
+    } else {
+        items_[id] = std::move(item);
+    }
+    return result;
+}
+
+std::vector<trash_item> trash_manager::list() const {
+    std::vector<trash_item> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        result.reserve(items_.size());
+        for (const auto& item : items_) {
+            result.push_back(item.second);
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const trash_item& a, const trash_item& b) {
+        return a.deleted_at != b.deleted_at ? a.deleted_at > b.deleted_at : a.id > b.id;
+    });
+    return result;
+}
+
+trash_stats trash_manager::stats() const {
+    trash_stats result{};
+    std::lock_guard<std::mutex> lock(mutex_);
+    result.items = items_.size();
+    for (const auto& item : items_) {
+        result.bytes += item.second.size > 0 ? static_cast<uint64_t>(item.second.size) : 0;
+        result.pending_moves += item.second.staging_path.empty() ? 0 : 1;
+    }
+    result.purged_items = purged_items_;
+    result.purged_bytes = purged_bytes_;
+    return result;
+}
+
+void trash_manager::load_index() {
+    std::ifstream in(index_path_);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields = split_fields(line);
+        try {
+            if (fields[0] == "+" && fields.size() == 6) {
+                trash_item item;
+                item.id = fields[1];
+                item.deleted_at = static_cast<std::time_t>(std::stoll(fields[2]));
+                item.size = std::stoll(fields[3]);
+                item.staging_path = fields[4];
+                item.original_path = fields[5];
+                items_[item.id] = std::move(item);
+            } else if (fields[0] == "-" && fields.size() == 2) {
+                items_.erase(fields[1]);
+            } else if (fields[0] == "s" && fields.size() == 3 && items_.count(fields[1])) {
+                items_[fields[1]].size = std::stoll(fields[2]);
+            } else if (fields[0] == "c" && fields.size() == 2 && items_.count(fields[1])) {
+                items_[fields[1]].staging_path.clear();
+            }
+        } catch (const std::exception&) {
+            // 写到一半的最后一行
+        }
+    }
+
+    // 与磁盘核对：文件已不在的项丢弃；索引之外的文件（启用索引之前删除的）按文件名中的删除时间收录，
+    // 原路径未知。不能用修改时间：改名进回收站不改变它，那只是内容的修改时间
+    for (auto it = items_.begin(); it != items_.end();) {
+        trash_item& item = it->second;
+        if (!item.staging_path.empty() && !fs::exists(fs::symlink_status(item.staging_path))) {
+            // 暂存已不在：复制完成后未及记录就退出了，或者被手动移走
+            item.staging_path.clear();
+            item.size = -1;
+        }
+        if (!item.staging_path.empty() || fs::exists(fs::symlink_status(trash_dir_ + "/" + it->first))) {
+            ++it;
+        } else {
+            it = items_.erase(it);
+        }
+    }
+    std::error_code ec;
+    std::time_t now = std::time(nullptr);
+    for (const auto& entry : fs::directory_iterator(trash_dir_, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name == INDEX_FILE || name == std::string(INDEX_FILE) + ".tmp" || items_.count(name)) {
+            continue;
+        }
+        struct stat st;
+        if (lstat(entry.path().c_str(), &st) != 0) {
+            continue;
+        }
+        trash_item item;
+        item.id = name;
+        if (!parse_id_time(name, item.deleted_at) || item.deleted_at > now) {
+            // 不是本程序生成的名字：从收录时算起
+            item.deleted_at = now;
+        }
+        item.size = S_ISDIR(st.st_mode) ? -1 : (S_ISREG(st.st_mode) ? st.st_size : 0);
+        items_[name] = std::move(item);
+    }
+
+    rewrite_index();
+}
+
+void trash_manager::rewrite_index() {
+    // 写入临时文件后改名替换，中途崩溃也不会留下半个索引
+    journal_.close();
+    std::string temp = index_path_ + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        for (const auto& item : items_) {
+            out << add_record(item.second) << "\n";
+        }
+    }
+    std::rename(temp.c_str(), index_path_.c_str());
+    journal_.open(index_path_, std::ios::app);
+    journal_lines_ = items_.size();
+}
+
+void trash_manager::append_index(const std::string& line) {
+    journal_ << line << "\n";
+    journal_.flush();
+    // 日志中已失效的记录过多时压缩
+    if (++journal_lines_ > items_.size() * 4 + 1024) {
+        rewrite_index();
+    }
+}
+
+void trash_manager::run() {
+    // 只影响当前线程：I/O用idle调度类，只在磁盘空闲时进行；CPU优先级最低
+    const int IOPRIO_WHO_PROCESS = 1;
+    const int IOPRIO_CLASS_IDLE = 3;
+    const int IOPRIO_CLASS_SHIFT = 13;
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+    while (running_) {
+        // 一次只做一项，做完重新检查是否要停止
+        if (finish_pending_move() || measure_one()) {
+            continue;
+        }
+        enforce_limits();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!running_) {
+            break;
+        }
+        wake_.wait_for(lock, REAP_INTERVAL);
+    }
+}
+
+bool trash_manager::finish_pending_move() {
+    std::string id;
+    std::string staging;
+    std::time_t now = std::time(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& item : items_) {
+            // 复制失败的项等到下个周期，不挡住其后的项
+            if (!item.second.staging_path.empty() && item.second.retry_at <= now) {
+                id = item.first;
+                staging = item.second.staging_path;
+                break;
+            }
+        }
+    }
+    if (id.empty()) {
+        return false;
+    }
+
+    std::string target = trash_dir_ + "/" + id;
+    std::error_code ec;
+    // 上次复制可能中途中断
+    fs::remove_all(target, ec);
+    int64_t size = measure(staging);
+    fs::copy(staging, target, fs::copy_options::recursive | fs::copy_options::copy_symlinks, ec);
+    if (ec) {
+        // 回收站所在磁盘已满等情况：撤掉半成品，下个周期再试；暂存在此期间不对外可见
+        fs::remove_all(target, ec);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = items_.find(id);
+        if (it != items_.end()) {
+            it->second.retry_at = now + REAP_INTERVAL.count();
+        }
+        return true;
+    }
+
+    {
+        // 先在索引中记下复制完成再删除暂存，中途崩溃也不会从残缺的暂存重新复制
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = items_.find(id);
+        if (it != items_.end()) {
+            it->second.staging_path.clear();
+            it->second.size = size;
+            append_index("c\t" + escape_field(id));
+            append_index("s\t" + escape_field(id) + "\t" + std::to_string(size));
+        }
+    }
+    fs::remove_all(staging, ec);
+    return true;
+}
+
+bool trash_manager::measure_one() {
+    std::string id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& item : items_) {
+            if (item.second.size < 0 && item.second.staging_path.empty()) {
+                id = item.first;
+                break;
+            }
+        }
+    }
+    if (id.empty()) {
+        return false;
+    }
+
+    int64_t size = measure(trash_dir_ + "/" + id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = items_.find(id);
+    if (it != items_.end()) {
+        it->second.size = size;
+        append_index("s\t" + escape_field(id) + "\t" + std::to_string(size));
+    }
+    return true;
+}
+
+void trash_manager::enforce_limits() {
+    std::vector<std::pair<std::string, int64_t>> victims;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<const trash_item*> order;
+        uint64_t total = 0;
+        for (const auto& item : items_) {
+            if (item.second.staging_path.empty()) {
+                order.push_back(&item.second);
+                total += item.second.size > 0 ? static_cast<uint64_t>(item.second.size) : 0;
+            }
+        }
+        std::sort(order.begin(), order.end(), [](const trash_item* a, const trash_item* b) {
+            return a->deleted_at < b->deleted_at;
+        });
+
+        // 从最早删除的开始：超过保留期的全部清理，之后继续清理直到总大小不超过上限
+        std::time_t expire_before = max_age_sec_ > 0 ? std::time(nullptr) - static_cast<std::time_t>(max_age_sec_) : 0;
+        for (const trash_item* item : order) {
+            bool expired = max_age_sec_ > 0 && item->deleted_at < expire_before;
+            bool over_quota = max_bytes_ > 0 && total > max_bytes_;
+            if (!expired && !over_quota) {
+                break;
+            }
+            int64_t size = item->size > 0 ? item->size : 0;
+            total -= static_cast<uint64_t>(size);
+            victims.emplace_back(item->id, size);
+        }
+        // 先从索引中移除，删除文件时不持锁
+        for (const auto& victim : victims) {
+            items_.erase(victim.first);
+            append_index("-\t" + escape_field(victim.first));
+        }
+    }
+
+    for (const auto& victim : victims) {
+        std::error_code ec;
+        fs::remove_all(trash_dir_ + "/" + victim.first, ec);
+        std::lock_guard<std::mutex> lock(mutex_);
+        purged_items_++;
+        purged_bytes_ += static_cast<uint64_t>(victim.second);
+    }
+}
+
+} // namespace to_https_server